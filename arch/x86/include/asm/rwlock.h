@@ -1,6 +1,10 @@
 #ifndef _ASM_X86_RWLOCK_H
 #define _ASM_X86_RWLOCK_H
 
+#ifdef CONFIG_QUEUED_RWLOCKS
+#include <asm-generic/qrwlock_types.h>
+#else
+
 #include <asm/asm.h>
 
 #if CONFIG_NR_CPUS <= 2048
@@ -46,4 +50,6 @@ typedef union {
 
 /* Actual code is in asm/spinlock.h or in arch/x86/lib/rwlock.S */
 
+#endif /* CONFIG_QUEUED_RWLOCKS */
+
 #endif /* _ASM_X86_RWLOCK_H */
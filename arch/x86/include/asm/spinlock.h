@@ -13,7 +13,8 @@
  * on the local processor, one does not.
  *
  * These are fair FIFO ticket locks, which are currently limited to 256
- * CPUs.
+ * CPUs, or queued spinlocks with CONFIG_QUEUED_SPINLOCKS, where every
+ * waiter spins on a per-cpu node of its own instead of the lock word.
  *
  * (the type definitions are in asm/spinlock_types.h)
  */
@@ -37,6 +38,9 @@
 # define UNLOCK_LOCK_PREFIX
 #endif
 
+#ifdef CONFIG_QUEUED_SPINLOCKS
+#include <asm/qspinlock.h>
+#else
 /*
  * Ticket locks are conceptually two parts, one indicating the current head of
  * the queue, and the other indicating the current tail. The lock is acquired
@@ -139,7 +143,11 @@ static inline void arch_spin_unlock_wait(arch_spinlock_t *lock)
 	while (arch_spin_is_locked(lock))
 		cpu_relax();
 }
+#endif	/* CONFIG_QUEUED_SPINLOCKS */
 
+#ifdef CONFIG_QUEUED_RWLOCKS
+#include <asm/qrwlock.h>
+#else
 /*
  * Read-write spinlocks, allowing multiple readers
  * but only one writer.
@@ -223,14 +231,15 @@ static inline void arch_write_unlock(arch_rwlock_t *rw)
 		     : "+m" (rw->write) : "i" (RW_LOCK_BIAS) : "memory");
 }
 
-#define arch_read_lock_flags(lock, flags) arch_read_lock(lock)
-#define arch_write_lock_flags(lock, flags) arch_write_lock(lock)
-
 #undef READ_LOCK_SIZE
 #undef READ_LOCK_ATOMIC
 #undef WRITE_LOCK_ADD
 #undef WRITE_LOCK_SUB
 #undef WRITE_LOCK_CMP
+#endif	/* CONFIG_QUEUED_RWLOCKS */
+
+#define arch_read_lock_flags(lock, flags) arch_read_lock(lock)
+#define arch_write_lock_flags(lock, flags) arch_write_lock(lock)
 
 #define arch_spin_relax(lock)	cpu_relax()
 #define arch_read_relax(lock)	cpu_relax()
@@ -118,6 +118,21 @@ struct blkio_cgroup *task_blkio_cgroup(struct task_struct *tsk)
 }
 EXPORT_SYMBOL_GPL(task_blkio_cgroup);
 
+/*
+ * The cgroup to charge @bio to: the one it was associated with when issued
+ * on behalf of another cgroup, the submitting task's otherwise.  Must be
+ * called under rcu_read_lock().
+ */
+struct blkio_cgroup *bio_blkio_cgroup(struct bio *bio)
+{
+#ifdef CONFIG_BLK_CGROUP
+	if (bio->bi_css)
+		return container_of(bio->bi_css, struct blkio_cgroup, css);
+#endif
+	return task_blkio_cgroup(current);
+}
+EXPORT_SYMBOL_GPL(bio_blkio_cgroup);
+
 static inline void
 blkio_update_group_weight(struct blkio_group *blkg, unsigned int weight)
 {
@@ -1695,6 +1695,12 @@ void submit_bio(int rw, struct bio *bio)
 
 	bio->bi_rw |= rw;
 
+#ifdef CONFIG_BLK_CGROUP
+	/* writeback on behalf of another cgroup, see writeback_single_inode() */
+	if ((rw & WRITE) && current->wb_blkcg_css)
+		bio_associate_blkcg(bio, current->wb_blkcg_css);
+#endif
+
 	/*
 	 * If it's a regular read/write or a barrier with data attached,
 	 * go through the normal accounting stuff before submission.
@@ -303,7 +303,8 @@ throtl_grp *throtl_find_tg(struct throtl_data *td, struct blkio_cgroup *blkcg)
 	return tg;
 }
 
-static struct throtl_grp * throtl_get_tg(struct throtl_data *td)
+static struct throtl_grp * throtl_get_tg(struct throtl_data *td,
+					  struct bio *bio)
 {
 	struct throtl_grp *tg = NULL, *__tg = NULL;
 	struct blkio_cgroup *blkcg;
@@ -314,7 +315,7 @@ static struct throtl_grp * throtl_get_tg(struct throtl_data *td)
 		return NULL;
 
 	rcu_read_lock();
-	blkcg = task_blkio_cgroup(current);
+	blkcg = bio_blkio_cgroup(bio);
 	tg = throtl_find_tg(td, blkcg);
 	if (tg) {
 		rcu_read_unlock();
@@ -344,7 +345,7 @@ static struct throtl_grp * throtl_get_tg(struct throtl_data *td)
 	 * Initialize the new group. After sleeping, read the blkcg again.
 	 */
 	rcu_read_lock();
-	blkcg = task_blkio_cgroup(current);
+	blkcg = bio_blkio_cgroup(bio);
 
 	/*
 	 * If some other thread already allocated the group while we were
@@ -1129,7 +1130,7 @@ bool blk_throtl_bio(struct request_queue *q, struct bio *bio)
 	 */
 
 	rcu_read_lock();
-	blkcg = task_blkio_cgroup(current);
+	blkcg = bio_blkio_cgroup(bio);
 	tg = throtl_find_tg(td, blkcg);
 	if (tg) {
 		throtl_tg_fill_dev_details(td, tg);
@@ -1148,7 +1149,7 @@ bool blk_throtl_bio(struct request_queue *q, struct bio *bio)
 	 * IO group
 	 */
 	spin_lock_irq(q->queue_lock);
-	tg = throtl_get_tg(td);
+	tg = throtl_get_tg(td, bio);
 	if (unlikely(!tg))
 		goto out_unlock;
 
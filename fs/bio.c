@@ -25,6 +25,7 @@
 #include <linux/export.h>
 #include <linux/mempool.h>
 #include <linux/workqueue.h>
+#include <linux/cgroup.h>
 #include <scsi/sg.h>		/* for struct sg_iovec */
 
 #include <trace/events/block.h>
@@ -418,12 +419,47 @@ void bio_put(struct bio *bio)
 	 * last put frees it
 	 */
 	if (atomic_dec_and_test(&bio->bi_cnt)) {
+		bio_disassociate_blkcg(bio);
 		bio->bi_next = NULL;
 		bio->bi_destructor(bio);
 	}
 }
 EXPORT_SYMBOL(bio_put);
 
+#ifdef CONFIG_BLK_CGROUP
+/**
+ * bio_associate_blkcg - charge a bio to a blkio cgroup
+ * @bio: target bio
+ * @css: css of the blkio cgroup to charge
+ *
+ * Used when a bio is issued on behalf of somebody else, e.g. by the flusher
+ * for pages another cgroup dirtied, so that the block layer does not charge
+ * the submitting task.  The bio pins @css until it is freed.  A bio that is
+ * already associated keeps its original cgroup.
+ */
+void bio_associate_blkcg(struct bio *bio, struct cgroup_subsys_state *css)
+{
+	if (bio->bi_css)
+		return;
+	css_get(css);
+	bio->bi_css = css;
+}
+EXPORT_SYMBOL(bio_associate_blkcg);
+
+/**
+ * bio_disassociate_blkcg - undo bio_associate_blkcg()
+ * @bio: target bio
+ */
+void bio_disassociate_blkcg(struct bio *bio)
+{
+	if (bio->bi_css) {
+		css_put(bio->bi_css);
+		bio->bi_css = NULL;
+	}
+}
+EXPORT_SYMBOL(bio_disassociate_blkcg);
+#endif
+
 inline int bio_phys_segments(struct request_queue *q, struct bio *bio)
 {
 	if (unlikely(!bio_flagged(bio, BIO_SEG_VALID)))
@@ -458,6 +494,10 @@ void __bio_clone(struct bio *bio, struct bio *bio_src)
 	bio->bi_vcnt = bio_src->bi_vcnt;
 	bio->bi_size = bio_src->bi_size;
 	bio->bi_idx = bio_src->bi_idx;
+#ifdef CONFIG_BLK_CGROUP
+	if (bio_src->bi_css)
+		bio_associate_blkcg(bio, bio_src->bi_css);
+#endif
 }
 EXPORT_SYMBOL(__bio_clone);
 
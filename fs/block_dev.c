@@ -50,24 +50,27 @@ EXPORT_SYMBOL(I_BDEV);
 
 /*
  * Move the inode from its current bdi to a new bdi. If the inode is dirty we
- * need to move it onto the dirty list of @dst so that the inode is always on
- * the right list.
+ * need to move it onto the dirty list of @dst's default flusher so that the
+ * inode is always on the right list.
  */
 static void bdev_inode_switch_bdi(struct inode *inode,
 			struct backing_dev_info *dst)
 {
 	struct backing_dev_info *old = inode->i_data.backing_dev_info;
+	struct bdi_writeback *old_wb = inode->i_wb ? inode->i_wb : &old->wb;
+	struct bdi_writeback *dst_wb = &dst->wb;
 
 	if (unlikely(dst == old))		/* deadlock avoidance */
 		return;
-	bdi_lock_two(&old->wb, &dst->wb);
+	bdi_lock_two(old_wb, dst_wb);
 	spin_lock(&inode->i_lock);
 	inode->i_data.backing_dev_info = dst;
+	inode->i_wb = dst_wb;
 	if (inode->i_state & I_DIRTY)
-		list_move(&inode->i_wb_list, &dst->wb.b_dirty);
+		list_move(&inode->i_wb_list, &dst_wb->b_dirty);
 	spin_unlock(&inode->i_lock);
-	spin_unlock(&old->wb.list_lock);
-	spin_unlock(&dst->wb.list_lock);
+	spin_unlock(&old_wb->list_lock);
+	spin_unlock(&dst_wb->list_lock);
 }
 
 sector_t blkdev_max_block(struct block_device *bdev)
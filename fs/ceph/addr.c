@@ -8,6 +8,7 @@
 #include <linux/slab.h>
 #include <linux/pagevec.h>
 #include <linux/task_io_accounting_ops.h>
+#include <linux/memcontrol.h>
 
 #include "super.h"
 #include "mds_client.h"
@@ -67,11 +68,15 @@ static int ceph_set_page_dirty(struct page *page)
 	struct ceph_inode_info *ci;
 	int undo = 0;
 	struct ceph_snap_context *snapc;
+	unsigned long flags, memcg_flags;
+	bool locked;
 
 	if (unlikely(!mapping))
 		return !TestSetPageDirty(page);
 
+	mem_cgroup_begin_update_page_stat(page, &locked, &memcg_flags);
 	if (TestSetPageDirty(page)) {
+		mem_cgroup_end_update_page_stat(page, &locked, &memcg_flags);
 		dout("%p set_page_dirty %p idx %lu -- already dirty\n",
 		     mapping->host, page, page->index);
 		return 0;
@@ -103,7 +108,7 @@ static int ceph_set_page_dirty(struct page *page)
 	spin_unlock(&ci->i_ceph_lock);
 
 	/* now adjust page */
-	spin_lock_irq(&mapping->tree_lock);
+	spin_lock_irqsave(&mapping->tree_lock, flags);
 	if (page->mapping) {	/* Race with truncate? */
 		WARN_ON_ONCE(!PageUptodate(page));
 		account_page_dirtied(page, page->mapping);
@@ -121,7 +126,8 @@ static int ceph_set_page_dirty(struct page *page)
 		undo = 1;
 	}
 
-	spin_unlock_irq(&mapping->tree_lock);
+	spin_unlock_irqrestore(&mapping->tree_lock, flags);
+	mem_cgroup_end_update_page_stat(page, &locked, &memcg_flags);
 
 	if (undo)
 		/* whoops, we failed to dirty the page */
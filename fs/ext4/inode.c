@@ -3109,6 +3109,7 @@ void ext4_set_aops(struct inode *inode)
 	default:
 		BUG();
 	}
+	mapping_set_large_units(inode->i_mapping);
 }
 
 
@@ -27,6 +27,8 @@
 #include <linux/blkdev.h>
 #include <linux/backing-dev.h>
 #include <linux/tracepoint.h>
+#include <linux/hash.h>
+#include <linux/cgroup.h>
 #include "internal.h"
 
 /*
@@ -47,9 +49,14 @@ struct wb_writeback_work {
 	unsigned int range_cyclic:1;
 	unsigned int for_background:1;
 	enum wb_reason reason;		/* why was writeback initiated? */
+	unsigned short memcg_id;	/* only inodes this memcg dirtied */
 
 	struct list_head list;		/* pending work list */
 	struct completion *done;	/* set if the caller waits */
+
+	/* both protected by bdi->wb_lock */
+	unsigned long wb_todo;		/* flushers yet to pick this up */
+	unsigned int nr_active;		/* flushers not yet done with it */
 };
 
 /*
@@ -66,7 +73,7 @@ int nr_pdflush_threads;
  */
 int writeback_in_progress(struct backing_dev_info *bdi)
 {
-	return test_bit(BDI_writeback_running, &bdi->state);
+	return atomic_read(&bdi->nr_writeback_running) != 0;
 }
 
 static inline struct backing_dev_info *inode_to_bdi(struct inode *inode)
@@ -84,6 +91,23 @@ static inline struct inode *wb_inode(struct list_head *head)
 	return list_entry(head, struct inode, i_wb_list);
 }
 
+/*
+ * Pick the flusher a newly dirtied inode is queued on.  Inodes are spread
+ * by inode number, so that all of one file's pages are written by the same
+ * thread and still go out in ascending order.
+ */
+static struct bdi_writeback *bdi_pick_wb(struct backing_dev_info *bdi,
+					 struct inode *inode)
+{
+	unsigned int nr = ACCESS_ONCE(bdi->nr_flushers);
+
+	if (nr <= 1)
+		return &bdi->wb;
+	/* pairs with the barrier in bdi_set_flushers() */
+	smp_rmb();
+	return bdi_wb(bdi, hash_long(inode->i_ino, 16) % nr);
+}
+
 /*
  * Include the creation of the trace points after defining the
  * wb_writeback_work structure and inline functions so that the definition
@@ -93,10 +117,10 @@ static inline struct inode *wb_inode(struct list_head *head)
 #include <trace/events/writeback.h>
 
 /* Wakeup flusher thread or forker thread to fork it. Requires bdi->wb_lock. */
-static void bdi_wakeup_flusher(struct backing_dev_info *bdi)
+static void wb_wakeup_flusher(struct bdi_writeback *wb)
 {
-	if (bdi->wb.task) {
-		wake_up_process(bdi->wb.task);
+	if (wb->task) {
+		wake_up_process(wb->task);
 	} else {
 		/*
 		 * The bdi thread isn't there, wake up the forker thread which
@@ -106,22 +130,61 @@ static void bdi_wakeup_flusher(struct backing_dev_info *bdi)
 	}
 }
 
+/*
+ * Wake every flusher of @bdi that has something to write.  Requires
+ * bdi->wb_lock.
+ */
+static void bdi_wakeup_flushers(struct backing_dev_info *bdi)
+{
+	struct bdi_writeback *wb;
+	unsigned int i;
+
+	bdi_for_each_wb(wb, bdi, i) {
+		if (i == 0 || wb->task || wb_has_dirty_io(wb))
+			wb_wakeup_flusher(wb);
+	}
+}
+
+/*
+ * Queue @work for all flushers of @bdi that currently hold dirty inodes;
+ * each of them writes back its own share of the pages asked for.  If none
+ * does, the default flusher still runs the work so that waiters complete.
+ */
 static void bdi_queue_work(struct backing_dev_info *bdi,
 			   struct wb_writeback_work *work)
 {
+	struct bdi_writeback *wb;
+	unsigned int i;
+
 	trace_writeback_queue(bdi, work);
 
 	spin_lock_bh(&bdi->wb_lock);
+	work->wb_todo = 0;
+	bdi_for_each_wb(wb, bdi, i) {
+		if (wb_has_dirty_io(wb))
+			work->wb_todo |= 1UL << i;
+	}
+	if (!work->wb_todo)
+		work->wb_todo = 1;
+	work->nr_active = hweight_long(work->wb_todo);
+	if (work->nr_pages != LONG_MAX)
+		work->nr_pages = DIV_ROUND_UP(work->nr_pages, work->nr_active);
+
 	list_add_tail(&work->list, &bdi->work_list);
-	if (!bdi->wb.task)
-		trace_writeback_nothread(bdi, work);
-	bdi_wakeup_flusher(bdi);
+	bdi_for_each_wb(wb, bdi, i) {
+		if (!(work->wb_todo & (1UL << i)))
+			continue;
+		if (!wb->task)
+			trace_writeback_nothread(bdi, work);
+		wb_wakeup_flusher(wb);
+	}
 	spin_unlock_bh(&bdi->wb_lock);
 }
 
 static void
 __bdi_start_writeback(struct backing_dev_info *bdi, long nr_pages,
-		      bool range_cyclic, enum wb_reason reason)
+		      bool range_cyclic, enum wb_reason reason,
+		      unsigned short memcg_id)
 {
 	struct wb_writeback_work *work;
 
@@ -131,10 +194,10 @@ __bdi_start_writeback(struct backing_dev_info *bdi, long nr_pages,
 	 */
 	work = kzalloc(sizeof(*work), GFP_ATOMIC);
 	if (!work) {
-		if (bdi->wb.task) {
-			trace_writeback_nowork(bdi);
-			wake_up_process(bdi->wb.task);
-		}
+		trace_writeback_nowork(bdi);
+		spin_lock_bh(&bdi->wb_lock);
+		bdi_wakeup_flushers(bdi);
+		spin_unlock_bh(&bdi->wb_lock);
 		return;
 	}
 
@@ -142,6 +205,7 @@ __bdi_start_writeback(struct backing_dev_info *bdi, long nr_pages,
 	work->nr_pages	= nr_pages;
 	work->range_cyclic = range_cyclic;
 	work->reason	= reason;
+	work->memcg_id	= memcg_id;
 
 	bdi_queue_work(bdi, work);
 }
@@ -161,7 +225,25 @@ __bdi_start_writeback(struct backing_dev_info *bdi, long nr_pages,
 void bdi_start_writeback(struct backing_dev_info *bdi, long nr_pages,
 			enum wb_reason reason)
 {
-	__bdi_start_writeback(bdi, nr_pages, true, reason);
+	__bdi_start_writeback(bdi, nr_pages, true, reason, 0);
+}
+
+/**
+ * bdi_start_memcg_writeback - start writeback on behalf of a memcg
+ * @bdi: the backing device to write from
+ * @nr_pages: the number of pages to write
+ * @memcg_id: css_id of the memcg
+ *
+ * Description:
+ *   Like bdi_start_writeback(), but only inodes whose pages were first
+ *   dirtied by tasks in the given memcg are written.  Used to bring a
+ *   memcg back under its dirty limits without flushing everybody else.
+ */
+void bdi_start_memcg_writeback(struct backing_dev_info *bdi, long nr_pages,
+			       unsigned short memcg_id)
+{
+	__bdi_start_writeback(bdi, nr_pages, true, WB_REASON_BACKGROUND,
+			      memcg_id);
 }
 
 /**
@@ -182,7 +264,7 @@ void bdi_start_background_writeback(struct backing_dev_info *bdi)
 	 */
 	trace_writeback_wake_background(bdi);
 	spin_lock_bh(&bdi->wb_lock);
-	bdi_wakeup_flusher(bdi);
+	bdi_wakeup_flushers(bdi);
 	spin_unlock_bh(&bdi->wb_lock);
 }
 
@@ -191,11 +273,11 @@ void bdi_start_background_writeback(struct backing_dev_info *bdi)
  */
 void inode_wb_list_del(struct inode *inode)
 {
-	struct backing_dev_info *bdi = inode_to_bdi(inode);
+	struct bdi_writeback *wb = inode->i_wb;
 
-	spin_lock(&bdi->wb.list_lock);
+	spin_lock(&wb->list_lock);
 	list_del_init(&inode->i_wb_list);
-	spin_unlock(&bdi->wb.list_lock);
+	spin_unlock(&wb->list_lock);
 }
 
 /*
@@ -347,6 +429,74 @@ static void inode_wait_for_writeback(struct inode *inode,
 	}
 }
 
+#ifdef CONFIG_BLK_CGROUP
+/*
+ * The flusher writes pages on behalf of whoever dirtied them, so remember
+ * the blkio cgroup that first dirtied the pages of a clean inode and charge
+ * the writeback bios to it instead of to the flusher thread.
+ */
+static void inode_set_blkcg(struct inode *inode)
+{
+	rcu_read_lock();
+	inode->i_blkcg_id = css_id(task_subsys_state(current, blkio_subsys_id));
+	rcu_read_unlock();
+}
+
+static void inode_blkcg_begin(struct inode *inode)
+{
+	struct cgroup_subsys_state *css;
+
+	if (!inode->i_blkcg_id)
+		return;
+
+	rcu_read_lock();
+	css = css_lookup(&blkio_subsys, inode->i_blkcg_id);
+	if (css && !css_tryget(css))
+		css = NULL;
+	rcu_read_unlock();
+	current->wb_blkcg_css = css;
+}
+
+static void inode_blkcg_end(void)
+{
+	if (current->wb_blkcg_css) {
+		css_put(current->wb_blkcg_css);
+		current->wb_blkcg_css = NULL;
+	}
+}
+#else
+static inline void inode_set_blkcg(struct inode *inode) { }
+static inline void inode_blkcg_begin(struct inode *inode) { }
+static inline void inode_blkcg_end(void) { }
+#endif
+
+#ifdef CONFIG_CGROUP_MEM_RES_CTLR
+/*
+ * Likewise remember the memcg that first dirtied the pages of a clean
+ * inode, so that a memcg over its dirty limits can have the flusher write
+ * back its own inodes.
+ */
+static void inode_set_memcg(struct inode *inode)
+{
+	rcu_read_lock();
+	inode->i_memcg_id = css_id(task_subsys_state(current,
+						     mem_cgroup_subsys_id));
+	rcu_read_unlock();
+}
+
+static bool inode_in_memcg(struct inode *inode, unsigned short memcg_id)
+{
+	return !memcg_id || inode->i_memcg_id == memcg_id;
+}
+#else
+static inline void inode_set_memcg(struct inode *inode) { }
+static inline bool inode_in_memcg(struct inode *inode,
+				  unsigned short memcg_id)
+{
+	return true;
+}
+#endif
+
 /*
  * Write out an inode's dirty pages.  Called under wb->list_lock and
  * inode->i_lock.  Either the caller has an active reference on the inode or
@@ -405,7 +555,9 @@ writeback_single_inode(struct inode *inode, struct bdi_writeback *wb,
 	spin_unlock(&inode->i_lock);
 	spin_unlock(&wb->list_lock);
 
+	inode_blkcg_begin(inode);
 	ret = do_writepages(mapping, wbc);
+	inode_blkcg_end();
 
 	/*
 	 * Make sure to wait on the data before writing out the metadata.
@@ -569,6 +721,11 @@ static long writeback_sb_inodes(struct super_block *sb,
 			break;
 		}
 
+		if (!inode_in_memcg(inode, work->memcg_id)) {
+			redirty_tail(inode, wb);
+			continue;
+		}
+
 		/*
 		 * Don't bother with new inodes or inodes beeing freed, first
 		 * kind does not need peridic writeout yet, and for the latter
@@ -688,13 +845,21 @@ static bool over_bground_thresh(struct backing_dev_info *bdi)
 }
 
 /*
- * Called under wb->list_lock. If there are multiple wb per bdi,
- * only the flusher working on the first wb should do it.
+ * Called under wb->list_lock. The bandwidth estimate is shared by all the
+ * flushers of a bdi and serialised by the default one's list_lock, which
+ * the others only try to take so as not to nest two list_locks.
  */
 static void wb_update_bandwidth(struct bdi_writeback *wb,
 				unsigned long start_time)
 {
-	__bdi_update_bandwidth(wb->bdi, 0, 0, 0, 0, 0, start_time);
+	struct backing_dev_info *bdi = wb->bdi;
+
+	if (wb == &bdi->wb) {
+		__bdi_update_bandwidth(bdi, 0, 0, 0, 0, 0, start_time);
+	} else if (spin_trylock(&bdi->wb.list_lock)) {
+		__bdi_update_bandwidth(bdi, 0, 0, 0, 0, 0, start_time);
+		spin_unlock(&bdi->wb.list_lock);
+	}
 }
 
 /*
@@ -739,7 +904,7 @@ static long wb_writeback(struct bdi_writeback *wb,
 		 * after the other works are all done.
 		 */
 		if ((work->for_background || work->for_kupdate) &&
-		    !list_empty(&wb->bdi->work_list))
+		    wb_has_work(wb))
 			break;
 
 		/*
@@ -806,21 +971,72 @@ static long wb_writeback(struct bdi_writeback *wb,
 }
 
 /*
- * Return the next wb_writeback_work struct that hasn't been processed yet.
+ * Return the next wb_writeback_work struct that hasn't been processed yet
+ * by @wb.  The last flusher to pick a work item up takes it off the list.
  */
 static struct wb_writeback_work *
-get_next_work_item(struct backing_dev_info *bdi)
+get_next_work_item(struct bdi_writeback *wb)
 {
-	struct wb_writeback_work *work = NULL;
+	struct backing_dev_info *bdi = wb->bdi;
+	struct wb_writeback_work *work;
 
 	spin_lock_bh(&bdi->wb_lock);
-	if (!list_empty(&bdi->work_list)) {
-		work = list_entry(bdi->work_list.next,
-				  struct wb_writeback_work, list);
-		list_del_init(&work->list);
+	list_for_each_entry(work, &bdi->work_list, list) {
+		if (!(work->wb_todo & (1UL << wb->nr)))
+			continue;
+		work->wb_todo &= ~(1UL << wb->nr);
+		if (!work->wb_todo)
+			list_del_init(&work->list);
+		spin_unlock_bh(&bdi->wb_lock);
+		return work;
 	}
 	spin_unlock_bh(&bdi->wb_lock);
-	return work;
+	return NULL;
+}
+
+/*
+ * Drop @wb's hold on @work.  Notify the caller of completion once every
+ * flusher is done if this is a synchronous work item, otherwise free it.
+ */
+static void wb_work_done(struct bdi_writeback *wb,
+			 struct wb_writeback_work *work)
+{
+	struct backing_dev_info *bdi = wb->bdi;
+	bool last;
+
+	spin_lock_bh(&bdi->wb_lock);
+	last = !--work->nr_active;
+	spin_unlock_bh(&bdi->wb_lock);
+
+	if (!last)
+		return;
+	if (work->done)
+		complete(work->done);
+	else
+		kfree(work);
+}
+
+/*
+ * Is there queued work that @wb has not picked up yet?
+ */
+bool wb_has_work(struct bdi_writeback *wb)
+{
+	struct backing_dev_info *bdi = wb->bdi;
+	struct wb_writeback_work *work;
+	bool ret = false;
+
+	if (list_empty(&bdi->work_list))
+		return false;
+
+	spin_lock_bh(&bdi->wb_lock);
+	list_for_each_entry(work, &bdi->work_list, list) {
+		if (work->wb_todo & (1UL << wb->nr)) {
+			ret = true;
+			break;
+		}
+	}
+	spin_unlock_bh(&bdi->wb_lock);
+	return ret;
 }
 
 /*
@@ -892,30 +1108,29 @@ static long wb_check_old_data_flush(struct bdi_writeback *wb)
 long wb_do_writeback(struct bdi_writeback *wb, int force_wait)
 {
 	struct backing_dev_info *bdi = wb->bdi;
-	struct wb_writeback_work *work;
+	struct wb_writeback_work *work, this;
 	long wrote = 0;
 
-	set_bit(BDI_writeback_running, &wb->bdi->state);
-	while ((work = get_next_work_item(bdi)) != NULL) {
+	atomic_inc(&bdi->nr_writeback_running);
+	while ((work = get_next_work_item(wb)) != NULL) {
+		/*
+		 * Other flushers of this bdi may be running the same work
+		 * item over their own inodes, so write through a copy.
+		 */
+		this = *work;
+
 		/*
 		 * Override sync mode, in case we must wait for completion
 		 * because this thread is exiting now.
 		 */
 		if (force_wait)
-			work->sync_mode = WB_SYNC_ALL;
+			this.sync_mode = WB_SYNC_ALL;
 
-		trace_writeback_exec(bdi, work);
+		trace_writeback_exec(bdi, &this);
 
-		wrote += wb_writeback(wb, work);
+		wrote += wb_writeback(wb, &this);
 
-		/*
-		 * Notify the caller of completion if this is a synchronous
-		 * work item, otherwise just free it.
-		 */
-		if (work->done)
-			complete(work->done);
-		else
-			kfree(work);
+		wb_work_done(wb, work);
 	}
 
 	/*
@@ -923,7 +1138,7 @@ long wb_do_writeback(struct bdi_writeback *wb, int force_wait)
 	 */
 	wrote += wb_check_old_data_flush(wb);
 	wrote += wb_check_background_flush(wb);
-	clear_bit(BDI_writeback_running, &wb->bdi->state);
+	atomic_dec(&bdi->nr_writeback_running);
 
 	return wrote;
 }
@@ -964,7 +1179,7 @@ int bdi_writeback_thread(void *data)
 			wb->last_active = jiffies;
 
 		set_current_state(TASK_INTERRUPTIBLE);
-		if (!list_empty(&bdi->work_list) || kthread_should_stop()) {
+		if (wb_has_work(wb) || kthread_should_stop()) {
 			__set_current_state(TASK_RUNNING);
 			continue;
 		}
@@ -982,7 +1197,7 @@ int bdi_writeback_thread(void *data)
 	}
 
 	/* Flush any work that raced with us exiting */
-	if (!list_empty(&bdi->work_list))
+	if (wb_has_work(wb))
 		wb_do_writeback(wb, 1);
 
 	trace_writeback_thread_stop(bdi);
@@ -1007,7 +1222,7 @@ void wakeup_flusher_threads(long nr_pages, enum wb_reason reason)
 	list_for_each_entry_rcu(bdi, &bdi_list, bdi_list) {
 		if (!bdi_has_dirty_io(bdi))
 			continue;
-		__bdi_start_writeback(bdi, nr_pages, false, reason);
+		__bdi_start_writeback(bdi, nr_pages, false, reason, 0);
 	}
 	rcu_read_unlock();
 }
@@ -1089,6 +1304,11 @@ void __mark_inode_dirty(struct inode *inode, int flags)
 	if ((inode->i_state & flags) != flags) {
 		const int was_dirty = inode->i_state & I_DIRTY;
 
+		if ((flags & I_DIRTY_PAGES) &&
+		    !(inode->i_state & I_DIRTY_PAGES)) {
+			inode_set_blkcg(inode);
+			inode_set_memcg(inode);
+		}
 		inode->i_state |= flags;
 
 		/*
@@ -1115,31 +1335,41 @@ void __mark_inode_dirty(struct inode *inode, int flags)
 		 * reposition it (that would break b_dirty time-ordering).
 		 */
 		if (!was_dirty) {
+			struct bdi_writeback *wb;
 			bool wakeup_bdi = false;
 			bdi = inode_to_bdi(inode);
 
+			/*
+			 * A clean inode is on no list and can be handed to
+			 * whichever flusher bdi_pick_wb() chooses; i_wb then
+			 * stays put until the inode is clean again.
+			 */
+			if (list_empty(&inode->i_wb_list))
+				inode->i_wb = bdi_pick_wb(bdi, inode);
+			wb = inode->i_wb;
+
 			if (bdi_cap_writeback_dirty(bdi)) {
 				WARN(!test_bit(BDI_registered, &bdi->state),
 				     "bdi-%s not registered\n", bdi->name);
 
 				/*
 				 * If this is the first dirty inode for this
-				 * bdi, we have to wake-up the corresponding
+				 * flusher, we have to wake-up the corresponding
 				 * bdi thread to make sure background
 				 * write-back happens later.
 				 */
-				if (!wb_has_dirty_io(&bdi->wb))
+				if (!wb_has_dirty_io(wb))
 					wakeup_bdi = true;
 			}
 
 			spin_unlock(&inode->i_lock);
-			spin_lock(&bdi->wb.list_lock);
+			spin_lock(&wb->list_lock);
 			inode->dirtied_when = jiffies;
-			list_move(&inode->i_wb_list, &bdi->wb.b_dirty);
-			spin_unlock(&bdi->wb.list_lock);
+			list_move(&inode->i_wb_list, &wb->b_dirty);
+			spin_unlock(&wb->list_lock);
 
 			if (wakeup_bdi)
-				bdi_wakeup_thread_delayed(bdi);
+				wb_wakeup_delayed(wb);
 			return;
 		}
 	}
@@ -1152,6 +1382,7 @@ EXPORT_SYMBOL(__mark_inode_dirty);
 static void wait_sb_inodes(struct super_block *sb)
 {
 	struct inode *inode, *old_inode = NULL;
+	int cpu;
 
 	/*
 	 * We need to be protected against the filesystem going from
@@ -1159,8 +1390,6 @@ static void wait_sb_inodes(struct super_block *sb)
 	 */
 	WARN_ON(!rwsem_is_locked(&sb->s_umount));
 
-	spin_lock(&inode_sb_list_lock);
-
 	/*
 	 * Data integrity sync. Must wait for all pages under writeback,
 	 * because there may have been pages dirtied before our sync
@@ -1168,37 +1397,40 @@ static void wait_sb_inodes(struct super_block *sb)
 	 * In which case, the inode may not be on the dirty list, but
 	 * we still have to wait for that writeout.
 	 */
-	list_for_each_entry(inode, &sb->s_inodes, i_sb_list) {
-		struct address_space *mapping = inode->i_mapping;
+	for_each_possible_cpu(cpu) {
+		lg_local_lock_cpu(inode_sb_list_lglock, cpu);
+		list_for_each_entry(inode, sb_inode_list(sb, cpu), i_sb_list) {
+			struct address_space *mapping = inode->i_mapping;
 
-		spin_lock(&inode->i_lock);
-		if ((inode->i_state & (I_FREEING|I_WILL_FREE|I_NEW)) ||
-		    (mapping->nrpages == 0)) {
+			spin_lock(&inode->i_lock);
+			if ((inode->i_state & (I_FREEING|I_WILL_FREE|I_NEW)) ||
+			    (mapping->nrpages == 0)) {
+				spin_unlock(&inode->i_lock);
+				continue;
+			}
+			__iget(inode);
 			spin_unlock(&inode->i_lock);
-			continue;
-		}
-		__iget(inode);
-		spin_unlock(&inode->i_lock);
-		spin_unlock(&inode_sb_list_lock);
+			lg_local_unlock_cpu(inode_sb_list_lglock, cpu);
 
-		/*
-		 * We hold a reference to 'inode' so it couldn't have been
-		 * removed from s_inodes list while we dropped the
-		 * inode_sb_list_lock.  We cannot iput the inode now as we can
-		 * be holding the last reference and we cannot iput it under
-		 * inode_sb_list_lock. So we keep the reference and iput it
-		 * later.
-		 */
-		iput(old_inode);
-		old_inode = inode;
+			/*
+			 * We hold a reference to 'inode' so it couldn't have
+			 * been removed from s_inodes list while we dropped
+			 * the list lock.  We cannot iput the inode now as we
+			 * can be holding the last reference and we cannot
+			 * iput it under the list lock. So we keep the
+			 * reference and iput it later.
+			 */
+			iput(old_inode);
+			old_inode = inode;
 
-		filemap_fdatawait(mapping);
+			filemap_fdatawait(mapping);
 
-		cond_resched();
+			cond_resched();
 
-		spin_lock(&inode_sb_list_lock);
+			lg_local_lock_cpu(inode_sb_list_lglock, cpu);
+		}
+		lg_local_unlock_cpu(inode_sb_list_lglock, cpu);
 	}
-	spin_unlock(&inode_sb_list_lock);
 	iput(old_inode);
 }
 
@@ -1318,6 +1550,34 @@ void sync_inodes_sb(struct super_block *sb)
 }
 EXPORT_SYMBOL(sync_inodes_sb);
 
+/*
+ * Lock the list_lock of the flusher whose lists @inode sits on, and then
+ * i_lock.  i_wb is reassigned under i_lock when a clean inode is redirtied
+ * and under the old flusher's list_lock when bdi_set_flushers() moves
+ * inodes around, so it is stable once both are held; retry if it moved
+ * while we were getting there.  An inode that was never dirtied has no
+ * i_wb yet; point it at the bdi's default flusher, since
+ * writeback_single_inode() may put it on that flusher's lists.
+ */
+static struct bdi_writeback *inode_lock_wb(struct inode *inode)
+{
+	struct bdi_writeback *wb;
+
+	for (;;) {
+		wb = ACCESS_ONCE(inode->i_wb);
+		if (!wb)
+			wb = &inode_to_bdi(inode)->wb;
+		spin_lock(&wb->list_lock);
+		spin_lock(&inode->i_lock);
+		if (!inode->i_wb)
+			inode->i_wb = wb;
+		if (inode->i_wb == wb)
+			return wb;
+		spin_unlock(&inode->i_lock);
+		spin_unlock(&wb->list_lock);
+	}
+}
+
 /**
  * write_inode_now	-	write an inode to disk
  * @inode: inode to write to disk
@@ -1330,7 +1590,7 @@ EXPORT_SYMBOL(sync_inodes_sb);
  */
 int write_inode_now(struct inode *inode, int sync)
 {
-	struct bdi_writeback *wb = &inode_to_bdi(inode)->wb;
+	struct bdi_writeback *wb;
 	int ret;
 	struct writeback_control wbc = {
 		.nr_to_write = LONG_MAX,
@@ -1343,8 +1603,7 @@ int write_inode_now(struct inode *inode, int sync)
 		wbc.nr_to_write = 0;
 
 	might_sleep();
-	spin_lock(&wb->list_lock);
-	spin_lock(&inode->i_lock);
+	wb = inode_lock_wb(inode);
 	ret = writeback_single_inode(inode, wb, &wbc);
 	spin_unlock(&inode->i_lock);
 	spin_unlock(&wb->list_lock);
@@ -1365,11 +1624,10 @@ EXPORT_SYMBOL(write_inode_now);
  */
 int sync_inode(struct inode *inode, struct writeback_control *wbc)
 {
-	struct bdi_writeback *wb = &inode_to_bdi(inode)->wb;
+	struct bdi_writeback *wb;
 	int ret;
 
-	spin_lock(&wb->list_lock);
-	spin_lock(&inode->i_lock);
+	wb = inode_lock_wb(inode);
 	ret = writeback_single_inode(inode, wb, wbc);
 	spin_unlock(&inode->i_lock);
 	spin_unlock(&wb->list_lock);
@@ -25,11 +25,12 @@ MODULE_ALIAS("devname:fuse");
 
 static struct kmem_cache *fuse_req_cachep;
 
-static struct fuse_conn *fuse_get_conn(struct file *file)
+static struct fuse_dev *fuse_get_dev(struct file *file)
 {
 	/*
 	 * Lockless access is OK, because file->private data is set
-	 * once during mount and is valid until the file is released.
+	 * once during mount or clone and is valid until the file is
+	 * released.
 	 */
 	return file->private_data;
 }
@@ -237,17 +238,40 @@ static u64 fuse_get_unique(struct fuse_conn *fc)
 	return fc->reqctr;
 }
 
+/*
+ * Requests go to the queue of the submitting CPU if one of its readers
+ * is waiting for work, otherwise to the connection-wide queue, which
+ * every reader takes from: a request is never left on the local queue
+ * of a reader that is busy with another one.  A reader just about to
+ * wait checks the connection-wide queue too, so missing it here only
+ * costs locality.
+ *
+ * Called under fc->lock
+ */
+static struct fuse_iqueue *fuse_select_iq(struct fuse_conn *fc)
+{
+	struct fuse_iqueue *iq;
+
+	if (!fc->iqs)
+		return &fc->iq;
+
+	iq = this_cpu_ptr(fc->iqs);
+	return waitqueue_active(&iq->waitq) ? iq : &fc->iq;
+}
+
 static void queue_request(struct fuse_conn *fc, struct fuse_req *req)
 {
+	struct fuse_iqueue *iq = fuse_select_iq(fc);
+
 	req->in.h.len = sizeof(struct fuse_in_header) +
 		len_args(req->in.numargs, (struct fuse_arg *) req->in.args);
-	list_add_tail(&req->list, &fc->pending);
+	list_add_tail(&req->list, &iq->pending);
 	req->state = FUSE_REQ_PENDING;
 	if (!req->waiting) {
 		req->waiting = 1;
 		atomic_inc(&fc->num_waiting);
 	}
-	wake_up(&fc->waitq);
+	wake_up(&iq->waitq);
 	kill_fasync(&fc->fasync, SIGIO, POLL_IN);
 }
 
@@ -261,7 +285,7 @@ void fuse_queue_forget(struct fuse_conn *fc, struct fuse_forget_link *forget,
 	if (fc->connected) {
 		fc->forget_list_tail->next = forget;
 		fc->forget_list_tail = forget;
-		wake_up(&fc->waitq);
+		wake_up(&fc->iq.waitq);
 		kill_fasync(&fc->fasync, SIGIO, POLL_IN);
 	} else {
 		kfree(forget);
@@ -338,7 +362,7 @@ __acquires(fc->lock)
 static void queue_interrupt(struct fuse_conn *fc, struct fuse_req *req)
 {
 	list_add_tail(&req->intr_entry, &fc->interrupts);
-	wake_up(&fc->waitq);
+	wake_up(&fc->iq.waitq);
 	kill_fasync(&fc->fasync, SIGIO, POLL_IN);
 }
 
@@ -911,31 +935,52 @@ static int forget_pending(struct fuse_conn *fc)
 	return fc->forget_list_head.next != NULL;
 }
 
-static int request_pending(struct fuse_conn *fc)
+static int request_queued(struct fuse_conn *fc, struct fuse_iqueue *iq)
 {
-	return !list_empty(&fc->pending) || !list_empty(&fc->interrupts) ||
+	return !list_empty(&iq->pending) || !list_empty(&fc->iq.pending);
+}
+
+static int request_pending(struct fuse_conn *fc, struct fuse_iqueue *iq)
+{
+	return request_queued(fc, iq) || !list_empty(&fc->interrupts) ||
 		forget_pending(fc);
 }
 
-/* Wait until a request is available on the pending list */
-static void request_wait(struct fuse_conn *fc)
-__releases(fc->lock)
-__acquires(fc->lock)
+/*
+ * Wait until a request is available on the queue of the device or on
+ * the connection-wide queue.  This is done without fc->lock, the
+ * caller checks again under it.
+ *
+ * Readers of a per-CPU queue wait exclusively on the connection-wide
+ * queue as well, so a request queued there wakes just one reader.  One
+ * that then serves its own queue instead passes the wakeup on, see
+ * fuse_dev_do_read().
+ */
+static int request_wait(struct fuse_conn *fc, struct fuse_iqueue *iq)
 {
 	DECLARE_WAITQUEUE(wait, current);
+	DECLARE_WAITQUEUE(wait_conn, current);
+	int err = 0;
 
-	add_wait_queue_exclusive(&fc->waitq, &wait);
-	while (fc->connected && !request_pending(fc)) {
+	add_wait_queue_exclusive(&iq->waitq, &wait);
+	if (iq != &fc->iq)
+		add_wait_queue_exclusive(&fc->iq.waitq, &wait_conn);
+	for (;;) {
 		set_current_state(TASK_INTERRUPTIBLE);
-		if (signal_pending(current))
+		if (!fc->connected || request_pending(fc, iq))
 			break;
-
-		spin_unlock(&fc->lock);
+		if (signal_pending(current)) {
+			err = -ERESTARTSYS;
+			break;
+		}
 		schedule();
-		spin_lock(&fc->lock);
 	}
 	set_current_state(TASK_RUNNING);
-	remove_wait_queue(&fc->waitq, &wait);
+	if (iq != &fc->iq)
+		remove_wait_queue(&fc->iq.waitq, &wait_conn);
+	remove_wait_queue(&iq->waitq, &wait);
+
+	return err;
 }
 
 /*
@@ -1099,28 +1144,36 @@ __releases(fc->lock)
  * request_end().  Otherwise add it to the processing list, and set
  * the 'sent' flag.
  */
-static ssize_t fuse_dev_do_read(struct fuse_conn *fc, struct file *file,
+static ssize_t fuse_dev_do_read(struct fuse_dev *fud, struct file *file,
 				struct fuse_copy_state *cs, size_t nbytes)
 {
 	int err;
+	struct fuse_conn *fc = fud->fc;
+	struct fuse_iqueue *iq = fud->iq;
+	struct list_head *pending;
 	struct fuse_req *req;
 	struct fuse_in *in;
 	unsigned reqsize;
 
  restart:
-	spin_lock(&fc->lock);
-	err = -EAGAIN;
 	if ((file->f_flags & O_NONBLOCK) && fc->connected &&
-	    !request_pending(fc))
-		goto err_unlock;
+	    !request_pending(fc, iq))
+		return -EAGAIN;
 
-	request_wait(fc);
-	err = -ENODEV;
-	if (!fc->connected)
-		goto err_unlock;
-	err = -ERESTARTSYS;
-	if (!request_pending(fc))
+	err = request_wait(fc, iq);
+
+	spin_lock(&fc->lock);
+	if (!fc->connected) {
+		err = -ENODEV;
 		goto err_unlock;
+	}
+	if (!request_pending(fc, iq)) {
+		spin_unlock(&fc->lock);
+		if (err)
+			return err;
+		/* Another reader got there first */
+		goto restart;
+	}
 
 	if (!list_empty(&fc->interrupts)) {
 		req = list_entry(fc->interrupts.next, struct fuse_req,
@@ -1129,14 +1182,22 @@ static ssize_t fuse_dev_do_read(struct fuse_conn *fc, struct file *file,
 	}
 
 	if (forget_pending(fc)) {
-		if (list_empty(&fc->pending) || fc->forget_batch-- > 0)
+		if (!request_queued(fc, iq) || fc->forget_batch-- > 0)
 			return fuse_read_forget(fc, cs, nbytes);
 
 		if (fc->forget_batch <= -8)
 			fc->forget_batch = 16;
 	}
 
-	req = list_entry(fc->pending.next, struct fuse_req, list);
+	if (list_empty(&iq->pending)) {
+		pending = &fc->iq.pending;
+	} else {
+		pending = &iq->pending;
+		/* the wakeup we took may have been for the connection queue */
+		if (!list_empty(&fc->iq.pending))
+			wake_up(&fc->iq.waitq);
+	}
+	req = list_entry(pending->next, struct fuse_req, list);
 	req->state = FUSE_REQ_READING;
 	list_move(&req->list, &fc->io);
 
@@ -1190,13 +1251,13 @@ static ssize_t fuse_dev_read(struct kiocb *iocb, const struct iovec *iov,
 {
 	struct fuse_copy_state cs;
 	struct file *file = iocb->ki_filp;
-	struct fuse_conn *fc = fuse_get_conn(file);
-	if (!fc)
+	struct fuse_dev *fud = fuse_get_dev(file);
+	if (!fud)
 		return -EPERM;
 
-	fuse_copy_init(&cs, fc, 1, iov, nr_segs);
+	fuse_copy_init(&cs, fud->fc, 1, iov, nr_segs);
 
-	return fuse_dev_do_read(fc, file, &cs, iov_length(iov, nr_segs));
+	return fuse_dev_do_read(fud, file, &cs, iov_length(iov, nr_segs));
 }
 
 static int fuse_dev_pipe_buf_steal(struct pipe_inode_info *pipe,
@@ -1224,18 +1285,18 @@ static ssize_t fuse_dev_splice_read(struct file *in, loff_t *ppos,
 	int do_wakeup = 0;
 	struct pipe_buffer *bufs;
 	struct fuse_copy_state cs;
-	struct fuse_conn *fc = fuse_get_conn(in);
-	if (!fc)
+	struct fuse_dev *fud = fuse_get_dev(in);
+	if (!fud)
 		return -EPERM;
 
 	bufs = kmalloc(pipe->buffers * sizeof(struct pipe_buffer), GFP_KERNEL);
 	if (!bufs)
 		return -ENOMEM;
 
-	fuse_copy_init(&cs, fc, 1, NULL, 0);
+	fuse_copy_init(&cs, fud->fc, 1, NULL, 0);
 	cs.pipebufs = bufs;
 	cs.pipe = pipe;
-	ret = fuse_dev_do_read(fc, in, &cs, len);
+	ret = fuse_dev_do_read(fud, in, &cs, len);
 	if (ret < 0)
 		goto out;
 
@@ -1799,13 +1860,13 @@ static ssize_t fuse_dev_write(struct kiocb *iocb, const struct iovec *iov,
 			      unsigned long nr_segs, loff_t pos)
 {
 	struct fuse_copy_state cs;
-	struct fuse_conn *fc = fuse_get_conn(iocb->ki_filp);
-	if (!fc)
+	struct fuse_dev *fud = fuse_get_dev(iocb->ki_filp);
+	if (!fud)
 		return -EPERM;
 
-	fuse_copy_init(&cs, fc, 0, iov, nr_segs);
+	fuse_copy_init(&cs, fud->fc, 0, iov, nr_segs);
 
-	return fuse_dev_do_write(fc, &cs, iov_length(iov, nr_segs));
+	return fuse_dev_do_write(fud->fc, &cs, iov_length(iov, nr_segs));
 }
 
 static ssize_t fuse_dev_splice_write(struct pipe_inode_info *pipe,
@@ -1816,13 +1877,15 @@ static ssize_t fuse_dev_splice_write(struct pipe_inode_info *pipe,
 	unsigned idx;
 	struct pipe_buffer *bufs;
 	struct fuse_copy_state cs;
+	struct fuse_dev *fud;
 	struct fuse_conn *fc;
 	size_t rem;
 	ssize_t ret;
 
-	fc = fuse_get_conn(out);
-	if (!fc)
+	fud = fuse_get_dev(out);
+	if (!fud)
 		return -EPERM;
+	fc = fud->fc;
 
 	bufs = kmalloc(pipe->buffers * sizeof(struct pipe_buffer), GFP_KERNEL);
 	if (!bufs)
@@ -1889,16 +1952,20 @@ out:
 static unsigned fuse_dev_poll(struct file *file, poll_table *wait)
 {
 	unsigned mask = POLLOUT | POLLWRNORM;
-	struct fuse_conn *fc = fuse_get_conn(file);
-	if (!fc)
+	struct fuse_dev *fud = fuse_get_dev(file);
+	struct fuse_conn *fc;
+	if (!fud)
 		return POLLERR;
 
-	poll_wait(file, &fc->waitq, wait);
+	fc = fud->fc;
+	poll_wait(file, &fud->iq->waitq, wait);
+	if (fud->iq != &fc->iq)
+		poll_wait(file, &fc->iq.waitq, wait);
 
 	spin_lock(&fc->lock);
 	if (!fc->connected)
 		mask = POLLERR;
-	else if (request_pending(fc))
+	else if (request_pending(fc, fud->iq))
 		mask |= POLLIN | POLLRDNORM;
 	spin_unlock(&fc->lock);
 
@@ -1964,9 +2031,15 @@ static void end_queued_requests(struct fuse_conn *fc)
 __releases(fc->lock)
 __acquires(fc->lock)
 {
+	int cpu;
+
 	fc->max_background = UINT_MAX;
 	flush_bg_queue(fc);
-	end_requests(fc, &fc->pending);
+	end_requests(fc, &fc->iq.pending);
+	if (fc->iqs) {
+		for_each_possible_cpu(cpu)
+			end_requests(fc, &per_cpu_ptr(fc->iqs, cpu)->pending);
+	}
 	end_requests(fc, &fc->processing);
 	while (forget_pending(fc))
 		kfree(dequeue_forget(fc, 1, NULL));
@@ -2015,7 +2088,7 @@ void fuse_abort_conn(struct fuse_conn *fc)
 		end_io_requests(fc);
 		end_queued_requests(fc);
 		end_polls(fc);
-		wake_up_all(&fc->waitq);
+		fuse_dev_wake_readers(fc);
 		wake_up_all(&fc->blocked_waitq);
 		kill_fasync(&fc->fasync, SIGIO, POLL_IN);
 	}
@@ -2023,19 +2096,76 @@ void fuse_abort_conn(struct fuse_conn *fc)
 }
 EXPORT_SYMBOL_GPL(fuse_abort_conn);
 
+void fuse_dev_wake_readers(struct fuse_conn *fc)
+{
+	int cpu;
+
+	wake_up_all(&fc->iq.waitq);
+	if (fc->iqs) {
+		for_each_possible_cpu(cpu)
+			wake_up_all(&per_cpu_ptr(fc->iqs, cpu)->waitq);
+	}
+}
+
+struct fuse_dev *fuse_dev_alloc(struct fuse_conn *fc)
+{
+	struct fuse_dev *fud;
+
+	fud = kzalloc(sizeof(struct fuse_dev), GFP_KERNEL);
+	if (fud) {
+		fud->fc = fuse_conn_get(fc);
+		fud->iq = &fc->iq;
+		INIT_LIST_HEAD(&fud->entry);
+	}
+	return fud;
+}
+EXPORT_SYMBOL_GPL(fuse_dev_alloc);
+
+void fuse_dev_install(struct fuse_dev *fud, struct file *file)
+{
+	struct fuse_conn *fc = fud->fc;
+
+	spin_lock(&fc->lock);
+	list_add_tail(&fud->entry, &fc->devices);
+	fud->iq->nr_devs++;
+	spin_unlock(&fc->lock);
+	file->private_data = fud;
+}
+EXPORT_SYMBOL_GPL(fuse_dev_install);
+
+void fuse_dev_free(struct fuse_dev *fud)
+{
+	fuse_conn_put(fud->fc);
+	kfree(fud);
+}
+EXPORT_SYMBOL_GPL(fuse_dev_free);
+
 int fuse_dev_release(struct inode *inode, struct file *file)
 {
-	struct fuse_conn *fc = fuse_get_conn(file);
-	if (fc) {
-		spin_lock(&fc->lock);
+	struct fuse_dev *fud = fuse_get_dev(file);
+	struct fuse_conn *fc;
+
+	if (!fud)
+		return 0;
+
+	fc = fud->fc;
+	spin_lock(&fc->lock);
+	list_del(&fud->entry);
+	fud->iq->nr_devs--;
+	if (list_empty(&fc->devices)) {
+		/* The last device is gone: end the connection */
 		fc->connected = 0;
 		fc->blocked = 0;
 		end_queued_requests(fc);
 		end_polls(fc);
 		wake_up_all(&fc->blocked_waitq);
-		spin_unlock(&fc->lock);
-		fuse_conn_put(fc);
+	} else if (!fud->iq->nr_devs && fud->iq != &fc->iq) {
+		/* Nobody reads this queue anymore, hand its requests over */
+		list_splice_tail_init(&fud->iq->pending, &fc->iq.pending);
+		wake_up_all(&fc->iq.waitq);
 	}
+	spin_unlock(&fc->lock);
+	fuse_dev_free(fud);
 
 	return 0;
 }
@@ -2043,12 +2173,96 @@ EXPORT_SYMBOL_GPL(fuse_dev_release);
 
 static int fuse_dev_fasync(int fd, struct file *file, int on)
 {
-	struct fuse_conn *fc = fuse_get_conn(file);
-	if (!fc)
+	struct fuse_dev *fud = fuse_get_dev(file);
+	if (!fud)
 		return -EPERM;
 
 	/* No locking - fasync_helper does its own locking */
-	return fasync_helper(fd, file, on, &fc->fasync);
+	return fasync_helper(fd, file, on, &fud->fc->fasync);
+}
+
+/*
+ * Attach @new, an open of /dev/fuse not yet used for a mount, to the
+ * connection of @fc.  It reads the queue of the current CPU.
+ */
+static int fuse_device_clone(struct fuse_conn *fc, struct file *new)
+{
+	struct fuse_iqueue __percpu *iqs = NULL;
+	struct fuse_dev *fud;
+	int cpu;
+
+	if (new->private_data)
+		return -EINVAL;
+
+	if (!fc->iqs) {
+		iqs = alloc_percpu(struct fuse_iqueue);
+		if (!iqs)
+			return -ENOMEM;
+
+		for_each_possible_cpu(cpu) {
+			struct fuse_iqueue *iq = per_cpu_ptr(iqs, cpu);
+
+			init_waitqueue_head(&iq->waitq);
+			INIT_LIST_HEAD(&iq->pending);
+			iq->nr_devs = 0;
+		}
+	}
+
+	fud = fuse_dev_alloc(fc);
+	if (!fud) {
+		free_percpu(iqs);
+		return -ENOMEM;
+	}
+
+	spin_lock(&fc->lock);
+	if (!fc->iqs) {
+		fc->iqs = iqs;
+		iqs = NULL;
+	}
+	fud->iq = this_cpu_ptr(fc->iqs);
+	spin_unlock(&fc->lock);
+	free_percpu(iqs);
+
+	fuse_dev_install(fud, new);
+
+	return 0;
+}
+
+static long fuse_dev_ioctl(struct file *file, unsigned int cmd,
+			   unsigned long arg)
+{
+	struct fuse_dev *fud;
+	struct file *old;
+	u32 oldfd;
+	int err;
+
+	if (cmd != FUSE_DEV_IOC_CLONE)
+		return -ENOTTY;
+
+	if (get_user(oldfd, (u32 __user *) arg))
+		return -EFAULT;
+
+	old = fget(oldfd);
+	if (!old)
+		return -EINVAL;
+
+	/*
+	 * Check against the fuse device operations: CUSE channels share
+	 * this handler, but can't be cloned.
+	 */
+	err = -EINVAL;
+	if (old->f_op == &fuse_dev_operations &&
+	    file->f_op == &fuse_dev_operations) {
+		fud = fuse_get_dev(old);
+		if (fud) {
+			mutex_lock(&fuse_mutex);
+			err = fuse_device_clone(fud->fc, file);
+			mutex_unlock(&fuse_mutex);
+		}
+	}
+	fput(old);
+
+	return err;
 }
 
 const struct file_operations fuse_dev_operations = {
@@ -2063,6 +2277,8 @@ const struct file_operations fuse_dev_operations = {
 	.poll		= fuse_dev_poll,
 	.release	= fuse_dev_release,
 	.fasync		= fuse_dev_fasync,
+	.unlocked_ioctl	= fuse_dev_ioctl,
+	.compat_ioctl	= fuse_dev_ioctl,
 };
 EXPORT_SYMBOL_GPL(fuse_dev_operations);
 
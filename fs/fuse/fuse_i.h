@@ -312,6 +312,38 @@ struct fuse_req {
 	struct file *stolen_file;
 };
 
+/**
+ * A queue of requests waiting to be read by the filesystem daemon.
+ *
+ * Every connection has one connection-wide queue.  Once a device is
+ * cloned, it also gets one queue per CPU: requests submitted on a CPU
+ * are queued there if a reader of that queue is idle.
+ */
+struct fuse_iqueue {
+	/** Readers of the queue are waiting on this */
+	wait_queue_head_t waitq;
+
+	/** The list of pending requests.  Protected by fc->lock */
+	struct list_head pending;
+
+	/** Number of devices reading this queue.  Protected by fc->lock */
+	unsigned nr_devs;
+};
+
+/**
+ * An open fuse device: the one passed to mount, or a clone of it.
+ */
+struct fuse_dev {
+	/** The connection the device belongs to */
+	struct fuse_conn *fc;
+
+	/** The queue the device reads before the connection-wide one */
+	struct fuse_iqueue *iq;
+
+	/** Entry on fc->devices.  Protected by fc->lock */
+	struct list_head entry;
+};
+
 /**
  * A Fuse connection.
  *
@@ -344,11 +376,14 @@ struct fuse_conn {
 	/** Maximum write size */
 	unsigned max_write;
 
-	/** Readers of the connection are waiting on this */
-	wait_queue_head_t waitq;
+	/** The connection-wide input queue */
+	struct fuse_iqueue iq;
 
-	/** The list of pending requests */
-	struct list_head pending;
+	/** Per-CPU input queues, allocated on the first device clone */
+	struct fuse_iqueue __percpu *iqs;
+
+	/** The list of fuse devices attached to the connection */
+	struct list_head devices;
 
 	/** The list of requests being processed */
 	struct list_head processing;
@@ -478,6 +513,10 @@ struct fuse_conn {
 	/** Are BSD file locking primitives not implemented by fs? */
 	unsigned no_flock:1;
 
+	/** Buffered writes go to the page cache and are written back
+	    later.  Only set in INIT */
+	unsigned writeback_cache:1;
+
 	/** The number of requests waiting for completion */
 	atomic_t num_waiting;
 
@@ -776,6 +815,23 @@ long fuse_ioctl_common(struct file *file, unsigned int cmd,
 unsigned fuse_file_poll(struct file *file, poll_table *wait);
 int fuse_dev_release(struct inode *inode, struct file *file);
 
+/**
+ * Allocate a fuse device reading the connection-wide queue of @fc
+ */
+struct fuse_dev *fuse_dev_alloc(struct fuse_conn *fc);
+
+/**
+ * Attach the fuse device to the connection and to @file
+ */
+void fuse_dev_install(struct fuse_dev *fud, struct file *file);
+
+void fuse_dev_free(struct fuse_dev *fud);
+
+/**
+ * Wake up all the readers of the connection
+ */
+void fuse_dev_wake_readers(struct fuse_conn *fc);
+
 void fuse_write_update_size(struct inode *inode, loff_t pos);
 
 #endif /* _FS_FUSE_I_H */
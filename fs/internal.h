@@ -97,6 +97,9 @@ extern struct file *do_filp_open(int dfd, const char *pathname,
 		const struct open_flags *op, int lookup_flags);
 extern struct file *do_file_open_root(struct dentry *, struct vfsmount *,
 		const char *, const struct open_flags *, int lookup_flags);
+extern int path_lookup_base(const struct path *base, const char *name,
+			    unsigned int flags, struct path *path);
+extern int build_open_flags(int flags, umode_t mode, struct open_flags *op);
 
 extern long do_handle_open(int mountdirfd,
 			   struct file_handle __user *ufh, int open_flag);
@@ -104,7 +107,22 @@ extern long do_handle_open(int mountdirfd,
 /*
  * inode.c
  */
-extern spinlock_t inode_sb_list_lock;
+DECLARE_LGLOCK(inode_sb_list_lglock);
+
+/*
+ * The inodes of a superblock are spread over per-CPU lists, each
+ * protected by the inode_sb_list_lglock lock of that CPU.
+ */
+static inline struct list_head *sb_inode_list(struct super_block *sb, int cpu)
+{
+#ifdef CONFIG_SMP
+	return per_cpu_ptr(sb->s_inodes, cpu);
+#else
+	return &sb->s_inodes;
+#endif
+}
+
+extern bool sb_has_inodes(struct super_block *sb);
 
 /*
  * fs-writeback.c
@@ -119,3 +137,11 @@ extern int invalidate_inodes(struct super_block *, bool);
  * dcache.c
  */
 extern struct dentry *__d_alloc(struct super_block *, const struct qstr *);
+
+/*
+ * stat.c
+ */
+struct kstat;
+struct stat_attr;
+extern void fill_stat_attr(struct kstat *, struct stat_attr *);
+extern int cp_stat_attr(struct kstat *, struct stat_attr __user *);
@@ -33,6 +33,7 @@
 #include <linux/device_cgroup.h>
 #include <linux/fs_struct.h>
 #include <linux/posix_acl.h>
+#include <linux/lookup_batch.h>
 #include <asm/uaccess.h>
 
 #include "internal.h"
@@ -1639,6 +1640,27 @@ static int path_init(int dfd, const char *name, unsigned int flags,
 			path_get(&nd->root);
 		}
 		nd->path = nd->root;
+	} else if (flags & LOOKUP_BASE) {
+		/*
+		 * The caller holds a reference to the directory in nd->path.
+		 * Unlike LOOKUP_ROOT it is only where the walk starts: ".."
+		 * and absolute symlinks still go by the process root.
+		 */
+		struct inode *inode = nd->path.dentry->d_inode;
+		if (*name) {
+			if (!inode->i_op->lookup)
+				return -ENOTDIR;
+			retval = inode_permission(inode, MAY_EXEC);
+			if (retval)
+				return retval;
+		}
+		if (flags & LOOKUP_RCU) {
+			br_read_lock(vfsmount_lock);
+			rcu_read_lock();
+			nd->seq = __read_seqcount_begin(&nd->path.dentry->d_seq);
+		} else {
+			path_get(&nd->path);
+		}
 	} else if (dfd == AT_FDCWD) {
 		if (flags & LOOKUP_RCU) {
 			struct fs_struct *fs = current->fs;
@@ -1826,6 +1848,36 @@ int vfs_path_lookup(struct dentry *dentry, struct vfsmount *mnt,
 	return err;
 }
 
+/*
+ * Look @name up starting at the directory @base instead of a dfd.  The
+ * walk restarts from @base when rcu-walk or a stale dentry fails it.
+ */
+int path_lookup_base(const struct path *base, const char *name,
+		     unsigned int flags, struct path *path)
+{
+	struct nameidata nd;
+	int err;
+
+	flags |= LOOKUP_BASE;
+	nd.path = *base;
+	err = path_lookupat(AT_FDCWD, name, flags | LOOKUP_RCU, &nd);
+	if (unlikely(err == -ECHILD)) {
+		nd.path = *base;
+		err = path_lookupat(AT_FDCWD, name, flags, &nd);
+	}
+	if (unlikely(err == -ESTALE)) {
+		nd.path = *base;
+		err = path_lookupat(AT_FDCWD, name, flags | LOOKUP_REVAL, &nd);
+	}
+
+	if (likely(!err)) {
+		if (unlikely(!audit_dummy_context()))
+			audit_inode(name, nd.path.dentry);
+		*path = nd.path;
+	}
+	return err;
+}
+
 /*
  * Restricted form of lookup. Doesn't follow links, single-component only,
  * needs parent already locked. Doesn't follow mounts.
@@ -2460,6 +2512,26 @@ struct file *do_file_open_root(struct dentry *dentry, struct vfsmount *mnt,
 	return file;
 }
 
+static struct file *do_filp_open_base(const struct path *base,
+		const char *name, const struct open_flags *op, int flags)
+{
+	struct nameidata nd;
+	struct file *file;
+
+	flags |= LOOKUP_BASE;
+	nd.path = *base;
+	file = path_openat(-1, name, &nd, op, flags | LOOKUP_RCU);
+	if (unlikely(file == ERR_PTR(-ECHILD))) {
+		nd.path = *base;
+		file = path_openat(-1, name, &nd, op, flags);
+	}
+	if (unlikely(file == ERR_PTR(-ESTALE))) {
+		nd.path = *base;
+		file = path_openat(-1, name, &nd, op, flags | LOOKUP_REVAL);
+	}
+	return file;
+}
+
 struct dentry *kern_path_create(int dfd, const char *pathname, struct path *path, int is_dir)
 {
 	struct dentry *dentry = ERR_PTR(-EEXIST);
@@ -3331,6 +3403,250 @@ SYSCALL_DEFINE2(rename, const char __user *, oldname, const char __user *, newna
 	return sys_renameat(AT_FDCWD, oldname, AT_FDCWD, newname);
 }
 
+/*
+ * lookup_batch() stats or opens a vector of names relative to @dfd.
+ * Names are split into their directory and last component.  The
+ * directories along the previous name stay resolved and referenced,
+ * one per component, so a name only walks the components past the
+ * longest directory prefix it shares with the previous one: the last
+ * component for names in the same directory, a few more when a tree
+ * scan moves on to a sibling or back up.  Search permission on the
+ * directory is still checked for every name, but a rename of one of
+ * the cached directories between two names is not noticed, exactly as
+ * if the caller had opened it and used openat() and fstatat() on that
+ * fd.
+ */
+#define LOOKUP_BATCH_DEPTH	8
+
+struct lookup_batch_dir {
+	char		*name;	/* prefix the levels were resolved from */
+	int		depth;	/* number of levels resolved */
+	struct {
+		struct path	path;
+		int		end;	/* @path is name[0..end) */
+	} level[LOOKUP_BATCH_DEPTH];
+};
+
+/* End of the component of @name at @pos, with the slashes after it */
+static int lookup_batch_next(const char *name, int pos, int len)
+{
+	if (name[pos] != '/')
+		while (pos < len && name[pos] != '/')
+			pos++;
+	while (pos < len && name[pos] == '/')
+		pos++;
+	return pos;
+}
+
+/*
+ * Resolve the directory holding the last component of @name into @base
+ * and return that component in @last.  Trailing slashes stay with the
+ * last component, so that it still has to be a directory.  Level 0 is
+ * @dfd itself, each further level one more component of the prefix; the
+ * deepest one takes whatever is left once the levels run out.
+ */
+static int lookup_batch_dir(int dfd, struct lookup_batch_dir *dir,
+			    const char *name, const char **last,
+			    struct path **base)
+{
+	const char *p = name + strlen(name);
+	int common = 0;
+	int len;
+	int pos;
+	int err;
+
+	while (p > name && p[-1] == '/')
+		p--;
+	while (p > name && p[-1] != '/')
+		p--;
+	len = p - name;
+	*last = p;
+
+	if (!dir->depth) {
+		struct nameidata nd;
+
+		err = do_path_lookup(dfd, "", LOOKUP_FOLLOW | LOOKUP_DIRECTORY,
+				     &nd);
+		if (err)
+			return err;
+		dir->level[0].path = nd.path;
+		dir->level[0].end = 0;
+		dir->depth = 1;
+	}
+
+	/* keep the levels for the prefix shared with the previous name */
+	pos = dir->level[dir->depth - 1].end;
+	while (common < len && common < pos &&
+	       name[common] == dir->name[common])
+		common++;
+	while (dir->depth > 1) {
+		int end = dir->level[dir->depth - 1].end;
+
+		if (end <= common && (end == len || name[end] != '/'))
+			break;
+		path_put(&dir->level[--dir->depth].path);
+	}
+
+	pos = dir->level[dir->depth - 1].end;
+	memcpy(dir->name + pos, name + pos, len - pos);
+	while (pos < len) {
+		int end = len;
+		char c;
+
+		if (dir->depth < LOOKUP_BATCH_DEPTH - 1)
+			end = lookup_batch_next(name, pos, len);
+		c = dir->name[end];
+		dir->name[end] = '\0';
+		err = path_lookup_base(&dir->level[dir->depth - 1].path,
+				       dir->name + pos,
+				       LOOKUP_FOLLOW | LOOKUP_DIRECTORY,
+				       &dir->level[dir->depth].path);
+		dir->name[end] = c;
+		if (err)
+			return err;
+		dir->level[dir->depth++].end = end;
+		pos = end;
+	}
+
+	*base = &dir->level[dir->depth - 1].path;
+	return 0;
+}
+
+static long lookup_batch_stat(struct path *dir, const char *last,
+			      const struct lookup_batch *req)
+{
+	unsigned int lookup_flags = 0;
+	struct kstat stat;
+	struct path path;
+	int error;
+
+	if (req->flags & ~(AT_SYMLINK_NOFOLLOW | AT_NO_AUTOMOUNT))
+		return -EINVAL;
+	if (!(req->flags & AT_SYMLINK_NOFOLLOW))
+		lookup_flags |= LOOKUP_FOLLOW;
+	if (!(req->flags & AT_NO_AUTOMOUNT))
+		lookup_flags |= LOOKUP_AUTOMOUNT;
+
+	error = path_lookup_base(dir, last, lookup_flags, &path);
+	if (error)
+		return error;
+	error = vfs_getattr(path.mnt, path.dentry, &stat);
+	path_put(&path);
+	if (error)
+		return error;
+	return cp_stat_attr(&stat,
+			(struct stat_attr __user *)(unsigned long)req->buf);
+}
+
+static long lookup_batch_open(struct path *dir, const char *last,
+			      const struct lookup_batch *req)
+{
+	int flags = req->flags;
+	struct open_flags op;
+	struct file *f;
+	int lookup;
+	int fd;
+
+	/* this looks up existing files, there is no mode to create with */
+	if (flags & O_CREAT)
+		return -EINVAL;
+	if (force_o_largefile())
+		flags |= O_LARGEFILE;
+
+	lookup = build_open_flags(flags, 0, &op);
+	fd = get_unused_fd_flags(flags);
+	if (fd < 0)
+		return fd;
+	f = do_filp_open_base(dir, last, &op, lookup);
+	if (IS_ERR(f)) {
+		put_unused_fd(fd);
+		return PTR_ERR(f);
+	}
+	fsnotify_open(f);
+	fd_install(fd, f);
+	return fd;
+}
+
+static long lookup_batch_one(int dfd, struct lookup_batch_dir *dir,
+			     const struct lookup_batch *req)
+{
+	struct path *base;
+	const char *last;
+	char *name;
+	long ret;
+
+	name = getname((const char __user *)(unsigned long)req->pathname);
+	if (IS_ERR(name))
+		return PTR_ERR(name);
+
+	ret = lookup_batch_dir(dfd, dir, name, &last, &base);
+	if (ret)
+		goto out;
+
+	switch (req->op) {
+	case LOOKUP_BATCH_STAT:
+		ret = lookup_batch_stat(base, last, req);
+		break;
+	case LOOKUP_BATCH_OPEN:
+		ret = lookup_batch_open(base, last, req);
+		break;
+	default:
+		ret = -EINVAL;
+	}
+out:
+	putname(name);
+	return ret;
+}
+
+/*
+ * Returns the number of requests completed, each with its own result,
+ * or an error if none could be.  Processing stops early on a fault or
+ * a fatal signal.
+ */
+SYSCALL_DEFINE4(lookup_batch, int, dfd, struct lookup_batch __user *, batch,
+		unsigned int, nr, unsigned int, flags)
+{
+	struct lookup_batch_dir dir;
+	unsigned int i;
+	long error = 0;
+
+	if (flags)
+		return -EINVAL;
+
+	dir.name = __getname();
+	if (!dir.name)
+		return -ENOMEM;
+	dir.depth = 0;
+
+	for (i = 0; i < nr; i++) {
+		struct lookup_batch req;
+		long ret;
+
+		if (copy_from_user(&req, &batch[i], sizeof(req))) {
+			error = -EFAULT;
+			break;
+		}
+		ret = lookup_batch_one(dfd, &dir, &req);
+		if (put_user(ret, &batch[i].result)) {
+			if (req.op == LOOKUP_BATCH_OPEN && ret >= 0)
+				sys_close(ret);
+			error = -EFAULT;
+			break;
+		}
+		if (fatal_signal_pending(current)) {
+			error = -EINTR;
+			i++;
+			break;
+		}
+		cond_resched();
+	}
+
+	while (dir.depth)
+		path_put(&dir.level[--dir.depth].path);
+	__putname(dir.name);
+	return i ? i : error;
+}
+
 int vfs_readlink(struct dentry *dentry, char __user *buffer, int buflen, const char *link)
 {
 	int len;
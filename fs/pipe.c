@@ -1197,6 +1197,24 @@ static long pipe_set_size(struct pipe_inode_info *pipe, unsigned long nr_pages)
 	return nr_pages * PAGE_SIZE;
 }
 
+/*
+ * Grow the ring of @pipe to at least @nr_pages buffers, but no further
+ * than pipe_max_size.  Used by splice on its internal sendfile pipe; the
+ * pipe must be locked or private to the caller.  Returns 0 if it grew.
+ */
+int pipe_grow_ring(struct pipe_inode_info *pipe, unsigned int nr_pages)
+{
+	nr_pages = min(nr_pages, pipe_max_size >> PAGE_SHIFT);
+	/* also keeps 0, e.g. from an empty sendfile(), out of roundup */
+	if (nr_pages <= pipe->buffers)
+		return -ENOSPC;
+	nr_pages = roundup_pow_of_two(nr_pages);
+
+	if (pipe_set_size(pipe, nr_pages) < 0)
+		return -ENOMEM;
+	return 0;
+}
+
 /*
  * Currently we rely on the pipe array holding a power-of-2 number
  * of pages.
@@ -17,9 +17,14 @@
 #include <linux/security.h>
 #include <linux/syscalls.h>
 #include <linux/unistd.h>
+#include <linux/namei.h>
+#include <linux/slab.h>
+#include <linux/direntplus.h>
 
 #include <asm/uaccess.h>
 
+#include "internal.h"
+
 int vfs_readdir(struct file *file, filldir_t filler, void *buf)
 {
 	struct inode *inode = file->f_path.dentry->d_inode;
@@ -309,3 +314,134 @@ SYSCALL_DEFINE3(getdents64, unsigned int, fd,
 out:
 	return error;
 }
+
+/*
+ * readdirplus() returns the entries of a directory together with the
+ * attributes of the inodes they name, saving the stat() per entry that
+ * listing tools otherwise issue.  The entries are collected into a
+ * kernel buffer under the directory's i_mutex, then their attributes
+ * are looked up in directory order once it is dropped.  Filesystems
+ * that place inodes near their directory, like ext4 with its inode
+ * table readahead, read them in few mostly sequential I/Os that way.
+ */
+#define READDIRPLUS_BUF_MAX	(64 * 1024)
+
+struct readdirplus_callback {
+	struct linux_direntplus *current_dir;
+	struct linux_direntplus *previous;
+	int count;
+	int error;
+};
+
+static int filldirplus(void *__buf, const char *name, int namlen,
+		       loff_t offset, u64 ino, unsigned int d_type)
+{
+	struct readdirplus_callback *buf = __buf;
+	struct linux_direntplus *dirent;
+	int reclen = ALIGN(offsetof(struct linux_direntplus, d_name) +
+			   namlen + 1, sizeof(u64));
+
+	buf->error = -EINVAL;	/* only used if we fail.. */
+	if (reclen > buf->count)
+		return -EINVAL;
+	dirent = buf->previous;
+	if (dirent)
+		dirent->d_off = offset;
+	dirent = buf->current_dir;
+	dirent->d_ino = ino;
+	dirent->d_off = 0;
+	dirent->d_reclen = reclen;
+	dirent->d_type = d_type;
+	dirent->__pad = 0;
+	dirent->d_error = 0;
+	memcpy(dirent->d_name, name, namlen);
+	/* the terminating NUL and the padding up to the next record */
+	memset(dirent->d_name + namlen, 0,
+	       reclen - offsetof(struct linux_direntplus, d_name) - namlen);
+	buf->previous = dirent;
+	buf->current_dir = (void *)dirent + reclen;
+	buf->count -= reclen;
+	return 0;
+}
+
+static void readdirplus_fill_attrs(struct file *file,
+				   struct linux_direntplus *dirent, int len)
+{
+	void *end = (void *)dirent + len;
+
+	for (; (void *)dirent < end; dirent = (void *)dirent + dirent->d_reclen) {
+		struct kstat stat;
+		struct path path;
+		int error;
+
+		/* entries are reported as lstat() would: links not followed */
+		error = path_lookup_base(&file->f_path, dirent->d_name, 0, &path);
+		if (!error) {
+			error = vfs_getattr(path.mnt, path.dentry, &stat);
+			path_put(&path);
+		}
+		if (error) {
+			memset(&dirent->d_stat, 0, sizeof(dirent->d_stat));
+			dirent->d_error = error;
+		} else {
+			fill_stat_attr(&stat, &dirent->d_stat);
+		}
+		cond_resched();
+	}
+}
+
+SYSCALL_DEFINE4(readdirplus, unsigned int, fd,
+		struct linux_direntplus __user *, dirent, unsigned int, count,
+		unsigned int, flags)
+{
+	struct readdirplus_callback buf;
+	struct linux_direntplus *kbuf;
+	struct file *file;
+	unsigned int size;
+	int error;
+
+	error = -EINVAL;
+	if (flags)
+		goto out;
+
+	error = -EFAULT;
+	if (!access_ok(VERIFY_WRITE, dirent, count))
+		goto out;
+
+	error = -EBADF;
+	file = fget(fd);
+	if (!file)
+		goto out;
+
+	/* a short buffer only means fewer entries per call */
+	size = min_t(unsigned int, count, READDIRPLUS_BUF_MAX);
+	kbuf = kmalloc(size, GFP_KERNEL | __GFP_NOWARN);
+	if (!kbuf && size > PAGE_SIZE) {
+		size = PAGE_SIZE;
+		kbuf = kmalloc(size, GFP_KERNEL);
+	}
+	error = -ENOMEM;
+	if (!kbuf)
+		goto out_fput;
+
+	buf.current_dir = kbuf;
+	buf.previous = NULL;
+	buf.count = size;
+	buf.error = 0;
+
+	error = vfs_readdir(file, filldirplus, &buf);
+	if (error >= 0)
+		error = buf.error;
+	if (buf.previous) {
+		buf.previous->d_off = file->f_pos;
+		error = size - buf.count;
+		readdirplus_fill_attrs(file, kbuf, error);
+		if (copy_to_user(dirent, kbuf, error))
+			error = -EFAULT;
+	}
+	kfree(kbuf);
+out_fput:
+	fput(file);
+out:
+	return error;
+}
@@ -25,6 +25,7 @@
 #include <linux/mm_inline.h>
 #include <linux/swap.h>
 #include <linux/writeback.h>
+#include <linux/backing-dev.h>
 #include <linux/export.h>
 #include <linux/syscalls.h>
 #include <linux/uio.h>
@@ -91,13 +92,11 @@ static void page_cache_pipe_buf_release(struct pipe_inode_info *pipe,
 }
 
 /*
- * Check whether the contents of buf is OK to access. Since the content
- * is a page cache page, IO may be in flight.
+ * Check whether the contents of a page cache page is OK to access, IO
+ * may be in flight.
  */
-static int page_cache_pipe_buf_confirm(struct pipe_inode_info *pipe,
-				       struct pipe_buffer *buf)
+static int page_cache_splice_confirm(struct page *page)
 {
-	struct page *page = buf->page;
 	int err;
 
 	if (!PageUptodate(page)) {
@@ -132,6 +131,12 @@ error:
 	return err;
 }
 
+static int page_cache_pipe_buf_confirm(struct pipe_inode_info *pipe,
+				       struct pipe_buffer *buf)
+{
+	return page_cache_splice_confirm(buf->page);
+}
+
 const struct pipe_buf_operations page_cache_pipe_buf_ops = {
 	.can_merge = 0,
 	.map = generic_pipe_buf_map,
@@ -228,6 +233,16 @@ ssize_t splice_to_pipe(struct pipe_inode_info *pipe,
 			break;
 		}
 
+		/*
+		 * The ring is full.  The internal sendfile pipe is ours to
+		 * size and is worth a bigger ring rather than a sleep per
+		 * ring-full; a pipe user space owns keeps the size it was
+		 * given, and with it the usual backpressure.
+		 */
+		if (pipe == current->splice_pipe &&
+		    !pipe_grow_ring(pipe, pipe->buffers * 2))
+			continue;
+
 		if (spd->flags & SPLICE_F_NONBLOCK) {
 			if (!ret)
 				ret = -EAGAIN;
@@ -275,11 +290,18 @@ void spd_release_page(struct splice_pipe_desc *spd, unsigned int i)
  */
 int splice_grow_spd(struct pipe_inode_info *pipe, struct splice_pipe_desc *spd)
 {
-	if (pipe->buffers <= PIPE_DEF_BUFFERS)
+	unsigned int buffers = ACCESS_ONCE(pipe->buffers);
+
+	/*
+	 * The pipe may be resized under us, so size the arrays once here
+	 * and have everybody use spd->nr_pages_max from now on.
+	 */
+	spd->nr_pages_max = buffers;
+	if (buffers <= PIPE_DEF_BUFFERS)
 		return 0;
 
-	spd->pages = kmalloc(pipe->buffers * sizeof(struct page *), GFP_KERNEL);
-	spd->partial = kmalloc(pipe->buffers * sizeof(struct partial_page), GFP_KERNEL);
+	spd->pages = kmalloc(buffers * sizeof(struct page *), GFP_KERNEL);
+	spd->partial = kmalloc(buffers * sizeof(struct partial_page), GFP_KERNEL);
 
 	if (spd->pages && spd->partial)
 		return 0;
@@ -289,61 +311,53 @@ int splice_grow_spd(struct pipe_inode_info *pipe, struct splice_pipe_desc *spd)
 	return -ENOMEM;
 }
 
-void splice_shrink_spd(struct pipe_inode_info *pipe,
-		       struct splice_pipe_desc *spd)
+void splice_shrink_spd(struct splice_pipe_desc *spd)
 {
-	if (pipe->buffers <= PIPE_DEF_BUFFERS)
+	if (spd->nr_pages_max <= PIPE_DEF_BUFFERS)
 		return;
 
 	kfree(spd->pages);
 	kfree(spd->partial);
 }
 
-static int
-__generic_file_splice_read(struct file *in, loff_t *ppos,
-			   struct pipe_inode_info *pipe, size_t len,
-			   unsigned int flags)
+/*
+ * Look up, read in and pin the page cache pages backing @len bytes of @in
+ * at @pos, filling in @spd up to its nr_pages_max.  On return
+ * spd->nr_pages pages are held with spd->partial describing the valid
+ * part of each; the caller owns those references.
+ */
+static int splice_gather_page_cache(struct file *in, loff_t pos, size_t len,
+				    struct splice_pipe_desc *spd)
 {
 	struct address_space *mapping = in->f_mapping;
 	unsigned int loff, nr_pages, req_pages;
-	struct page *pages[PIPE_DEF_BUFFERS];
-	struct partial_page partial[PIPE_DEF_BUFFERS];
 	struct page *page;
 	pgoff_t index, end_index;
 	loff_t isize;
 	int error, page_nr;
-	struct splice_pipe_desc spd = {
-		.pages = pages,
-		.partial = partial,
-		.flags = flags,
-		.ops = &page_cache_pipe_buf_ops,
-		.spd_release = spd_release_page,
-	};
 
-	if (splice_grow_spd(pipe, &spd))
-		return -ENOMEM;
-
-	index = *ppos >> PAGE_CACHE_SHIFT;
-	loff = *ppos & ~PAGE_CACHE_MASK;
+	index = pos >> PAGE_CACHE_SHIFT;
+	loff = pos & ~PAGE_CACHE_MASK;
 	req_pages = (len + loff + PAGE_CACHE_SIZE - 1) >> PAGE_CACHE_SHIFT;
-	nr_pages = min(req_pages, pipe->buffers);
+	nr_pages = min(req_pages, spd->nr_pages_max);
 
 	/*
 	 * Lookup the (hopefully) full range of pages we need.
 	 */
-	spd.nr_pages = find_get_pages_contig(mapping, index, nr_pages, spd.pages);
-	index += spd.nr_pages;
+	spd->nr_pages = find_get_pages_contig(mapping, index, nr_pages,
+					      spd->pages);
+	index += spd->nr_pages;
 
 	/*
 	 * If find_get_pages_contig() returned fewer pages than we needed,
 	 * readahead/allocate the rest and fill in the holes.
 	 */
-	if (spd.nr_pages < nr_pages)
+	if (spd->nr_pages < nr_pages)
 		page_cache_sync_readahead(mapping, &in->f_ra, in,
-				index, req_pages - spd.nr_pages);
+				index, req_pages - spd->nr_pages);
 
 	error = 0;
-	while (spd.nr_pages < nr_pages) {
+	while (spd->nr_pages < nr_pages) {
 		/*
 		 * Page could be there, find_get_pages_contig() breaks on
 		 * the first hole.
@@ -372,7 +386,7 @@ __generic_file_splice_read(struct file *in, loff_t *ppos,
 			unlock_page(page);
 		}
 
-		spd.pages[spd.nr_pages++] = page;
+		spd->pages[spd->nr_pages++] = page;
 		index++;
 	}
 
@@ -380,9 +394,9 @@ __generic_file_splice_read(struct file *in, loff_t *ppos,
 	 * Now loop over the map and see if we need to start IO on any
 	 * pages, fill in the partial map, etc.
 	 */
-	index = *ppos >> PAGE_CACHE_SHIFT;
-	nr_pages = spd.nr_pages;
-	spd.nr_pages = 0;
+	index = pos >> PAGE_CACHE_SHIFT;
+	nr_pages = spd->nr_pages;
+	spd->nr_pages = 0;
 	for (page_nr = 0; page_nr < nr_pages; page_nr++) {
 		unsigned int this_len;
 
@@ -393,7 +407,7 @@ __generic_file_splice_read(struct file *in, loff_t *ppos,
 		 * this_len is the max we'll use from this page
 		 */
 		this_len = min_t(unsigned long, len, PAGE_CACHE_SIZE - loff);
-		page = spd.pages[page_nr];
+		page = spd->pages[page_nr];
 
 		if (PageReadahead(page))
 			page_cache_async_readahead(mapping, &in->f_ra, in,
@@ -420,8 +434,8 @@ __generic_file_splice_read(struct file *in, loff_t *ppos,
 					error = -ENOMEM;
 					break;
 				}
-				page_cache_release(spd.pages[page_nr]);
-				spd.pages[page_nr] = page;
+				page_cache_release(spd->pages[page_nr]);
+				spd->pages[page_nr] = page;
 			}
 			/*
 			 * page was already under io and is now done, great
@@ -478,11 +492,11 @@ fill_it:
 			len = this_len;
 		}
 
-		spd.partial[page_nr].offset = loff;
-		spd.partial[page_nr].len = this_len;
+		spd->partial[page_nr].offset = loff;
+		spd->partial[page_nr].len = this_len;
 		len -= this_len;
 		loff = 0;
-		spd.nr_pages++;
+		spd->nr_pages++;
 		index++;
 	}
 
@@ -491,13 +505,37 @@ fill_it:
 	 * we got, 'nr_pages' is how many pages are in the map.
 	 */
 	while (page_nr < nr_pages)
-		page_cache_release(spd.pages[page_nr++]);
+		page_cache_release(spd->pages[page_nr++]);
 	in->f_ra.prev_pos = (loff_t)index << PAGE_CACHE_SHIFT;
 
+	return error;
+}
+
+static int
+__generic_file_splice_read(struct file *in, loff_t *ppos,
+			   struct pipe_inode_info *pipe, size_t len,
+			   unsigned int flags)
+{
+	struct page *pages[PIPE_DEF_BUFFERS];
+	struct partial_page partial[PIPE_DEF_BUFFERS];
+	struct splice_pipe_desc spd = {
+		.pages = pages,
+		.partial = partial,
+		.nr_pages_max = PIPE_DEF_BUFFERS,
+		.flags = flags,
+		.ops = &page_cache_pipe_buf_ops,
+		.spd_release = spd_release_page,
+	};
+	int error;
+
+	if (splice_grow_spd(pipe, &spd))
+		return -ENOMEM;
+
+	error = splice_gather_page_cache(in, *ppos, len, &spd);
 	if (spd.nr_pages)
 		error = splice_to_pipe(pipe, &spd);
 
-	splice_shrink_spd(pipe, &spd);
+	splice_shrink_spd(&spd);
 	return error;
 }
 
@@ -598,6 +636,7 @@ ssize_t default_file_splice_read(struct file *in, loff_t *ppos,
 	struct splice_pipe_desc spd = {
 		.pages = pages,
 		.partial = partial,
+		.nr_pages_max = PIPE_DEF_BUFFERS,
 		.flags = flags,
 		.ops = &default_pipe_buf_ops,
 		.spd_release = spd_release_page,
@@ -608,8 +647,8 @@ ssize_t default_file_splice_read(struct file *in, loff_t *ppos,
 
 	res = -ENOMEM;
 	vec = __vec;
-	if (pipe->buffers > PIPE_DEF_BUFFERS) {
-		vec = kmalloc(pipe->buffers * sizeof(struct iovec), GFP_KERNEL);
+	if (spd.nr_pages_max > PIPE_DEF_BUFFERS) {
+		vec = kmalloc(spd.nr_pages_max * sizeof(struct iovec), GFP_KERNEL);
 		if (!vec)
 			goto shrink_ret;
 	}
@@ -617,7 +656,7 @@ ssize_t default_file_splice_read(struct file *in, loff_t *ppos,
 	offset = *ppos & ~PAGE_CACHE_MASK;
 	nr_pages = (len + offset + PAGE_CACHE_SIZE - 1) >> PAGE_CACHE_SHIFT;
 
-	for (i = 0; i < nr_pages && i < pipe->buffers && len; i++) {
+	for (i = 0; i < nr_pages && i < spd.nr_pages_max && len; i++) {
 		struct page *page;
 
 		page = alloc_page(GFP_USER);
@@ -665,7 +704,7 @@ ssize_t default_file_splice_read(struct file *in, loff_t *ppos,
 shrink_ret:
 	if (vec != __vec)
 		kfree(vec);
-	splice_shrink_spd(pipe, &spd);
+	splice_shrink_spd(&spd);
 	return res;
 
 err:
@@ -698,6 +737,72 @@ static int pipe_to_sendpage(struct pipe_inode_info *pipe,
 				    sd->len, &pos, more);
 }
 
+/*
+ * Put the pipe page in place of the page cache page ->write_begin() gave
+ * us, for SPLICE_F_MOVE.  Called with @page locked; returns the new page,
+ * locked and referenced for ->write_end(), or NULL to have the data copied.
+ * ->write_end() works on the buffers ->write_begin() attached, so pages
+ * of buffer-head filesystems (ext*, xfs, ...) are never stolen.
+ */
+static struct page *splice_steal_page(struct pipe_inode_info *pipe,
+				      struct pipe_buffer *buf,
+				      struct page *page)
+{
+	struct address_space *mapping = page->mapping;
+	struct page *newpage = buf->page;
+
+	/*
+	 * Only a page that nothing but the page cache knows about can be
+	 * swapped out for the pipe page: no buffers or other fs state, no
+	 * mappings, nothing in flight.
+	 */
+	if (page_has_private(page) || page_mapped(page) || PageDirty(page) ||
+	    PageWriteback(page) || PageMlocked(page) ||
+	    mapping_cap_swap_backed(mapping))
+		return NULL;
+
+	if (buf->ops->steal(pipe, buf))
+		return NULL;
+
+	/*
+	 * A gifted user page (vmsplice) is still anonymous, detach it from
+	 * its anon_vma before it can become page cache.  That takes it off
+	 * the anon LRU, have it added to the file LRU below.
+	 */
+	if (PageAnon(newpage)) {
+		if (page_cache_take_anon_page(newpage))
+			goto out_unlock;
+		buf->flags &= ~PIPE_BUF_FLAG_LRU;
+	}
+
+	ClearPageMappedToDisk(newpage);
+	if (page_mapcount(newpage) || newpage->mapping ||
+	    page_count(newpage) != 1 || !PageUptodate(newpage) ||
+	    (newpage->flags & PAGE_FLAGS_CHECK_AT_PREP &
+	     ~(1 << PG_locked | 1 << PG_referenced | 1 << PG_uptodate |
+	       1 << PG_lru | 1 << PG_active | 1 << PG_reclaim)))
+		goto out_unlock;
+
+	if (replace_page_cache_page(page, newpage, GFP_KERNEL))
+		goto out_unlock;
+
+	if (!(buf->flags & PIPE_BUF_FLAG_LRU))
+		lru_cache_add_file(newpage);
+
+	/*
+	 * The pipe buffer keeps its reference, take another one for the
+	 * page cache write_end will drop.
+	 */
+	page_cache_get(newpage);
+	unlock_page(page);
+	page_cache_release(page);
+	return newpage;
+
+out_unlock:
+	unlock_page(newpage);
+	return NULL;
+}
+
 /*
  * This is a little more tricky than the file -> pipe splicing. There are
  * basically three cases:
@@ -739,6 +844,14 @@ int pipe_to_file(struct pipe_inode_info *pipe, struct pipe_buffer *buf,
 	if (unlikely(ret))
 		goto out;
 
+	if ((sd->flags & SPLICE_F_MOVE) && !offset &&
+	    this_len == PAGE_CACHE_SIZE && buf->page != page) {
+		struct page *newpage = splice_steal_page(pipe, buf, page);
+
+		if (newpage)
+			page = newpage;
+	}
+
 	if (buf->page != page) {
 		char *src = buf->ops->map(pipe, buf, 1);
 		char *dst = kmap_atomic(page);
@@ -1186,6 +1299,16 @@ ssize_t splice_direct_to_actor(struct file *in, struct splice_desc *sd,
 		current->splice_pipe = pipe;
 	}
 
+	/*
+	 * Size the internal pipe for the transfer so that it goes in as
+	 * few round trips as pipe-max-size allows.  Failing to grow is not
+	 * an error, the default ring just takes more trips.
+	 */
+	if (sd->total_len)
+		pipe_grow_ring(pipe,
+			min_t(size_t, DIV_ROUND_UP(sd->total_len, PAGE_SIZE),
+			      pipe_max_size >> PAGE_SHIFT));
+
 	/*
 	 * Do the splice.
 	 */
@@ -1266,6 +1389,101 @@ static int direct_splice_actor(struct pipe_inode_info *pipe,
 			      sd->flags);
 }
 
+/*
+ * sendfile() from the page cache straight into a socket: hand each page
+ * to ->sendpage() without parking it in the internal pipe first.
+ */
+static long splice_file_to_sendpage(struct file *in, loff_t *ppos,
+				    struct file *out, size_t len,
+				    unsigned int flags)
+{
+	struct page *pages[PIPE_DEF_BUFFERS];
+	struct partial_page partial[PIPE_DEF_BUFFERS];
+	struct splice_pipe_desc spd = {
+		.pages = pages,
+		.partial = partial,
+		.nr_pages_max = PIPE_DEF_BUFFERS,
+		.flags = flags,
+	};
+	loff_t pos = *ppos, opos, isize;
+	umode_t i_mode;
+	long bytes = 0;
+	bool stop = false;
+	int ret, i;
+
+	i_mode = in->f_path.dentry->d_inode->i_mode;
+	if (unlikely(!S_ISREG(i_mode) && !S_ISBLK(i_mode)))
+		return -EINVAL;
+
+	if (unlikely(!(in->f_mode & FMODE_READ)))
+		return -EBADF;
+	ret = rw_verify_area(READ, in, ppos, len);
+	if (unlikely(ret < 0))
+		return ret;
+	len = ret;
+
+	if (unlikely(!(out->f_mode & FMODE_WRITE)))
+		return -EBADF;
+	if (unlikely(out->f_flags & O_APPEND))
+		return -EINVAL;
+	ret = rw_verify_area(WRITE, out, &out->f_pos, len);
+	if (unlikely(ret < 0))
+		return ret;
+
+	ret = 0;
+	while (len) {
+		isize = i_size_read(in->f_mapping->host);
+		if (pos >= isize)
+			break;
+		if (len > isize - pos)
+			len = isize - pos;
+
+		ret = splice_gather_page_cache(in, pos, len, &spd);
+		if (!spd.nr_pages)
+			break;
+
+		ret = 0;
+		for (i = 0; i < spd.nr_pages; i++) {
+			struct page *page = spd.pages[i];
+			unsigned int plen = spd.partial[i].len;
+			int more;
+
+			if (!stop) {
+				ret = page_cache_splice_confirm(page);
+				if (ret)
+					stop = true;
+			}
+			if (!stop) {
+				more = (flags & SPLICE_F_MORE) ? MSG_MORE : 0;
+				if (plen < len)
+					more |= MSG_SENDPAGE_NOTLAST;
+				opos = out->f_pos;
+				ret = out->f_op->sendpage(out, page,
+							  spd.partial[i].offset,
+							  plen, &opos, more);
+				if (ret > 0) {
+					bytes += ret;
+					pos += ret;
+					len -= ret;
+				}
+				/* short send: stop, but drop the rest */
+				if (ret < (int)plen)
+					stop = true;
+			}
+			page_cache_release(page);
+		}
+		if (stop)
+			break;
+	}
+
+	if (bytes) {
+		*ppos = pos;
+		file_accessed(in);
+		return bytes;
+	}
+	return ret;
+}
+
 /**
  * do_splice_direct - splices data directly between two files
  * @in:		file to splice from
@@ -1293,6 +1511,15 @@ long do_splice_direct(struct file *in, loff_t *ppos, struct file *out,
 	};
 	long ret;
 
+	/*
+	 * Page cache to socket needs no pipe in between, the pages can go
+	 * to ->sendpage() as they are looked up.
+	 */
+	if (in->f_op && in->f_op->splice_read == generic_file_splice_read &&
+	    out->f_op && out->f_op->splice_write == generic_splice_sendpage &&
+	    out->f_op->sendpage)
+		return splice_file_to_sendpage(in, ppos, out, len, flags);
+
 	ret = splice_direct_to_actor(in, &sd, direct_splice_actor);
 	if (ret > 0)
 		*ppos = sd.pos;
@@ -1612,6 +1839,7 @@ static long vmsplice_to_pipe(struct file *file, const struct iovec __user *iov,
 	struct splice_pipe_desc spd = {
 		.pages = pages,
 		.partial = partial,
+		.nr_pages_max = PIPE_DEF_BUFFERS,
 		.flags = flags,
 		.ops = &user_page_pipe_buf_ops,
 		.spd_release = spd_release_page,
@@ -1627,13 +1855,13 @@ static long vmsplice_to_pipe(struct file *file, const struct iovec __user *iov,
 
 	spd.nr_pages = get_iovec_page_array(iov, nr_segs, spd.pages,
 					    spd.partial, flags & SPLICE_F_GIFT,
-					    pipe->buffers);
+					    spd.nr_pages_max);
 	if (spd.nr_pages <= 0)
 		ret = spd.nr_pages;
 	else
 		ret = splice_to_pipe(pipe, &spd);
 
-	splice_shrink_spd(pipe, &spd);
+	splice_shrink_spd(&spd);
 	return ret;
 }
 
@@ -14,10 +14,13 @@
 #include <linux/security.h>
 #include <linux/syscalls.h>
 #include <linux/pagemap.h>
+#include <linux/stat_attr.h>
 
 #include <asm/uaccess.h>
 #include <asm/unistd.h>
 
+#include "internal.h"
+
 void generic_fillattr(struct inode *inode, struct kstat *stat)
 {
 	stat->dev = inode->i_sb->s_dev;
@@ -240,6 +243,39 @@ static int cp_new_stat(struct kstat *stat, struct stat __user *statbuf)
 	return copy_to_user(statbuf,&tmp,sizeof(tmp)) ? -EFAULT : 0;
 }
 
+/*
+ * Convert @stat to the struct stat_attr layout shared by the batched
+ * lookup and directory calls.
+ */
+void fill_stat_attr(struct kstat *stat, struct stat_attr *sa)
+{
+	memset(sa, 0, sizeof(*sa));
+	sa->sa_dev = new_encode_dev(stat->dev);
+	sa->sa_ino = stat->ino;
+	sa->sa_mode = stat->mode;
+	sa->sa_nlink = stat->nlink;
+	sa->sa_uid = stat->uid;
+	sa->sa_gid = stat->gid;
+	sa->sa_rdev = new_encode_dev(stat->rdev);
+	sa->sa_size = stat->size;
+	sa->sa_blocks = stat->blocks;
+	sa->sa_blksize = stat->blksize;
+	sa->sa_atime = stat->atime.tv_sec;
+	sa->sa_mtime = stat->mtime.tv_sec;
+	sa->sa_ctime = stat->ctime.tv_sec;
+	sa->sa_atime_nsec = stat->atime.tv_nsec;
+	sa->sa_mtime_nsec = stat->mtime.tv_nsec;
+	sa->sa_ctime_nsec = stat->ctime.tv_nsec;
+}
+
+int cp_stat_attr(struct kstat *stat, struct stat_attr __user *ubuf)
+{
+	struct stat_attr tmp;
+
+	fill_stat_attr(stat, &tmp);
+	return copy_to_user(ubuf, &tmp, sizeof(tmp)) ? -EFAULT : 0;
+}
+
 SYSCALL_DEFINE2(newstat, const char __user *, filename,
 		struct stat __user *, statbuf)
 {
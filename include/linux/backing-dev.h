@@ -31,7 +31,6 @@ enum bdi_state {
 	BDI_async_congested,	/* The async (write) queue is getting full */
 	BDI_sync_congested,	/* The sync queue is getting full */
 	BDI_registered,		/* bdi_register() was done */
-	BDI_writeback_running,	/* Writeback is in progress */
 	BDI_unused,		/* Available bits start here */
 };
 
@@ -47,9 +46,15 @@ enum bdi_stat_item {
 
 #define BDI_STAT_BATCH (8*(1+ilog2(nr_cpu_ids)))
 
+/*
+ * Upper limit on the number of flusher threads a single bdi can run.  Work
+ * items record which of them still have to process them in a bitmask.
+ */
+#define BDI_MAX_FLUSHERS	16
+
 struct bdi_writeback {
 	struct backing_dev_info *bdi;	/* our parent bdi */
-	unsigned int nr;
+	unsigned int nr;		/* index within the bdi */
 
 	unsigned long last_old_flush;	/* last old data flush */
 	unsigned long last_active;	/* last time bdi thread was active */
@@ -96,7 +101,10 @@ struct backing_dev_info {
 	unsigned int max_ratio, max_prop_frac;
 
 	struct bdi_writeback wb;  /* default writeback info for this bdi */
-	spinlock_t wb_lock;	  /* protects work_list */
+	struct bdi_writeback *extra_wb;	/* BDI_MAX_FLUSHERS - 1 more, if any */
+	unsigned int nr_flushers; /* flushers new dirty inodes spread over */
+	atomic_t nr_writeback_running; /* flushers currently writing */
+	spinlock_t wb_lock;	  /* protects work_list and extra_wb */
 
 	struct list_head work_list;
 
@@ -120,12 +128,15 @@ void bdi_unregister(struct backing_dev_info *bdi);
 int bdi_setup_and_register(struct backing_dev_info *, char *, unsigned int);
 void bdi_start_writeback(struct backing_dev_info *bdi, long nr_pages,
 			enum wb_reason reason);
+void bdi_start_memcg_writeback(struct backing_dev_info *bdi, long nr_pages,
+			       unsigned short memcg_id);
 void bdi_start_background_writeback(struct backing_dev_info *bdi);
 int bdi_writeback_thread(void *data);
 int bdi_has_dirty_io(struct backing_dev_info *bdi);
 void bdi_arm_supers_timer(void);
-void bdi_wakeup_thread_delayed(struct backing_dev_info *bdi);
+void wb_wakeup_delayed(struct bdi_writeback *wb);
 void bdi_lock_two(struct bdi_writeback *wb1, struct bdi_writeback *wb2);
+int bdi_set_flushers(struct backing_dev_info *bdi, unsigned int nr);
 
 extern spinlock_t bdi_lock;
 extern struct list_head bdi_list;
@@ -138,6 +149,25 @@ static inline int wb_has_dirty_io(struct bdi_writeback *wb)
 	       !list_empty(&wb->b_more_io);
 }
 
+/*
+ * Number of writeback contexts that may hold dirty inodes.  Once the extra
+ * flushers have been allocated they stay around until bdi_destroy(), so
+ * inodes already queued on one of them never lose their list.
+ */
+static inline unsigned int bdi_nr_wb(struct backing_dev_info *bdi)
+{
+	return ACCESS_ONCE(bdi->extra_wb) ? BDI_MAX_FLUSHERS : 1;
+}
+
+static inline struct bdi_writeback *bdi_wb(struct backing_dev_info *bdi,
+					   unsigned int nr)
+{
+	return nr ? &bdi->extra_wb[nr - 1] : &bdi->wb;
+}
+
+#define bdi_for_each_wb(wb, bdi, i)					\
+	for ((i) = 0; (i) < bdi_nr_wb(bdi) && ((wb) = bdi_wb(bdi, i)); (i)++)
+
 static inline void __add_bdi_stat(struct backing_dev_info *bdi,
 		enum bdi_stat_item item, s64 amount)
 {
@@ -227,6 +227,16 @@ extern struct bio *bio_clone(struct bio *, gfp_t);
 
 extern void bio_init(struct bio *);
 
+struct cgroup_subsys_state;
+#ifdef CONFIG_BLK_CGROUP
+extern void bio_associate_blkcg(struct bio *, struct cgroup_subsys_state *);
+extern void bio_disassociate_blkcg(struct bio *);
+#else
+static inline void bio_associate_blkcg(struct bio *bio,
+				       struct cgroup_subsys_state *css) { }
+static inline void bio_disassociate_blkcg(struct bio *bio) { }
+#endif
+
 extern int bio_add_page(struct bio *, struct page *, unsigned int,unsigned int);
 extern int bio_add_pc_page(struct request_queue *, struct bio *, struct page *,
 			   unsigned int, unsigned int);
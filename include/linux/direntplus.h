@@ -0,0 +1,30 @@
+/*
+ *  include/linux/direntplus.h
+ *
+ *  Records returned by readdirplus(): a directory entry together with
+ *  the attributes of the inode it names.
+ */
+
+#ifndef _LINUX_DIRENTPLUS_H
+#define _LINUX_DIRENTPLUS_H
+
+#include <linux/types.h>
+#include <linux/stat_attr.h>
+
+/*
+ * d_error is 0 when d_stat is valid.  Otherwise it is the error the
+ * lookup of the entry failed with, e.g. -ENOENT if the entry was
+ * removed after it was read.
+ */
+struct linux_direntplus {
+	__u64		d_ino;
+	__s64		d_off;
+	__u16		d_reclen;
+	__u8		d_type;
+	__u8		__pad;
+	__s32		d_error;
+	struct stat_attr d_stat;
+	char		d_name[0];
+};
+
+#endif /* _LINUX_DIRENTPLUS_H */
@@ -401,6 +401,7 @@ struct inodes_stat_t {
 #include <linux/rculist_bl.h>
 #include <linux/atomic.h>
 #include <linux/shrinker.h>
+#include <linux/list_lru.h>
 #include <linux/migrate_mode.h>
 
 #include <asm/byteorder.h>
@@ -417,6 +418,7 @@ struct kstatfs;
 struct vm_area_struct;
 struct vfsmount;
 struct cred;
+struct mem_cgroup;
 
 extern void __init inode_init(void);
 extern void __init inode_init_early(void);
@@ -643,6 +645,7 @@ int pagecache_write_end(struct file *, struct address_space *mapping,
 				struct page *page, void *fsdata);
 
 struct backing_dev_info;
+struct bdi_writeback;
 struct address_space {
 	struct inode		*host;		/* owner: inode, block_device */
 	struct radix_tree_root	page_tree;	/* radix tree of all pages */
@@ -812,8 +815,18 @@ struct inode {
 
 	struct hlist_node	i_hash;
 	struct list_head	i_wb_list;	/* backing dev IO list */
+	struct bdi_writeback	*i_wb;		/* flusher owning i_wb_list */
+#ifdef CONFIG_BLK_CGROUP
+	unsigned short		i_blkcg_id;	/* blkio cgroup that dirtied it */
+#endif
+#ifdef CONFIG_CGROUP_MEM_RES_CTLR
+	unsigned short		i_memcg_id;	/* memcg that dirtied it */
+#endif
 	struct list_head	i_lru;		/* inode LRU list */
 	struct list_head	i_sb_list;
+#ifdef CONFIG_SMP
+	int			i_sb_list_cpu;
+#endif
 	union {
 		struct list_head	i_dentry;
 		struct rcu_head		i_rcu;
@@ -1439,7 +1452,11 @@ struct super_block {
 #endif
 	const struct xattr_handler **s_xattr;
 
+#ifdef CONFIG_SMP
+	struct list_head __percpu *s_inodes;	/* all inodes */
+#else
 	struct list_head	s_inodes;	/* all inodes */
+#endif
 	struct hlist_bl_head	s_anon;		/* anonymous dentries for (nfs) exporting */
 #ifdef CONFIG_SMP
 	struct list_head __percpu *s_files;
@@ -1447,14 +1464,9 @@ struct super_block {
 	struct list_head	s_files;
 #endif
 	struct list_head	s_mounts;	/* list of mounts; _not_ for fs use */
-	/* s_dentry_lru, s_nr_dentry_unused protected by dcache.c lru locks */
-	struct list_head	s_dentry_lru;	/* unused dentry lru */
-	int			s_nr_dentry_unused;	/* # of dentry on lru */
-
-	/* s_inode_lru_lock protects s_inode_lru and s_nr_inodes_unused */
-	spinlock_t		s_inode_lru_lock ____cacheline_aligned_in_smp;
-	struct list_head	s_inode_lru;		/* unused inode lru */
-	int			s_nr_inodes_unused;	/* # of inodes on lru */
+	/* per-node unused dentry and inode lrus, with their own locks */
+	struct list_lru		s_dentry_lru ____cacheline_aligned_in_smp;
+	struct list_lru		s_inode_lru ____cacheline_aligned_in_smp;
 
 	struct block_device	*s_bdev;
 	struct backing_dev_info *s_bdi;
@@ -1510,8 +1522,10 @@ struct super_block {
 };
 
 /* superblock cache pruning functions */
-extern void prune_icache_sb(struct super_block *sb, int nr_to_scan);
-extern void prune_dcache_sb(struct super_block *sb, int nr_to_scan);
+extern void prune_icache_sb(struct super_block *sb, unsigned long nr_to_scan,
+			    int nid, struct mem_cgroup *memcg);
+extern void prune_dcache_sb(struct super_block *sb, unsigned long nr_to_scan,
+			    int nid, struct mem_cgroup *memcg);
 
 extern struct timespec current_fs_time(struct super_block *sb);
 
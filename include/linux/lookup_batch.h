@@ -0,0 +1,33 @@
+/*
+ *  include/linux/lookup_batch.h
+ *
+ *  Interface to lookup_batch(), which stats or opens a vector of paths
+ *  relative to one directory in a single call.
+ */
+
+#ifndef _LINUX_LOOKUP_BATCH_H
+#define _LINUX_LOOKUP_BATCH_H
+
+#include <linux/types.h>
+#include <linux/stat_attr.h>
+
+/* lookup_batch.op */
+#define LOOKUP_BATCH_STAT	0	/* fill the struct stat_attr at buf */
+#define LOOKUP_BATCH_OPEN	1	/* open(2) the path, without O_CREAT */
+
+/*
+ * One request.  Pointers are passed as 64-bit values so that the layout
+ * is the same for 32-bit and 64-bit callers.  For LOOKUP_BATCH_STAT,
+ * flags takes AT_SYMLINK_NOFOLLOW and AT_NO_AUTOMOUNT; for
+ * LOOKUP_BATCH_OPEN it takes the open(2) flags.  The kernel stores 0 or
+ * the new file descriptor in result, or a negative errno.
+ */
+struct lookup_batch {
+	__u64	pathname;	/* const char * */
+	__u64	buf;		/* struct stat_attr *, for LOOKUP_BATCH_STAT */
+	__u32	op;
+	__u32	flags;
+	__s64	result;
+};
+
+#endif /* _LINUX_LOOKUP_BATCH_H */
@@ -30,6 +30,17 @@ struct mm_struct;
 /* Stats that can be updated by kernel. */
 enum mem_cgroup_page_stat_item {
 	MEMCG_NR_FILE_MAPPED, /* # of pages charged as file rss */
+	MEMCG_NR_FILE_DIRTY, /* # of dirty pages in page cache */
+	MEMCG_NR_FILE_WRITEBACK, /* # of pages under writeback */
+};
+
+/* Dirty limits and usage of a memcg, see mem_cgroup_dirty_info() */
+struct mem_cgroup_dirty_info {
+	unsigned long dirty_thresh;
+	unsigned long background_thresh;
+	unsigned long nr_file_dirty;
+	unsigned long nr_writeback;
+	unsigned short memcg_id;	/* css_id, see bdi_start_memcg_writeback */
 };
 
 struct mem_cgroup_reclaim_cookie {
@@ -185,6 +196,11 @@ static inline void mem_cgroup_dec_page_stat(struct page *page,
 	mem_cgroup_update_page_stat(page, idx, -1);
 }
 
+bool mem_cgroup_dirty_info(unsigned long dirtyable,
+			   unsigned long background_thresh,
+			   unsigned long dirty_thresh,
+			   struct mem_cgroup_dirty_info *info);
+
 unsigned long mem_cgroup_soft_limit_reclaim(struct zone *zone, int order,
 						gfp_t gfp_mask,
 						unsigned long *total_scanned);
@@ -389,6 +405,14 @@ static inline void mem_cgroup_dec_page_stat(struct page *page,
 {
 }
 
+static inline bool mem_cgroup_dirty_info(unsigned long dirtyable,
+					 unsigned long background_thresh,
+					 unsigned long dirty_thresh,
+					 struct mem_cgroup_dirty_info *info)
+{
+	return false;
+}
+
 static inline
 unsigned long mem_cgroup_soft_limit_reclaim(struct zone *zone, int order,
 					    gfp_t gfp_mask,
@@ -437,9 +461,17 @@ enum {
 };
 
 struct sock;
+struct kmem_cache;
 #ifdef CONFIG_CGROUP_MEM_RES_CTLR_KMEM
 void sock_update_memcg(struct sock *sk);
 void sock_release_memcg(struct sock *sk);
+
+bool mem_cgroup_kmem_active(struct mem_cgroup *memcg);
+int memcg_kmem_newpage_charge(gfp_t gfp, struct mem_cgroup **memcgp,
+			      int order);
+void memcg_kmem_commit_charge(struct page *page, struct mem_cgroup *memcg,
+			      int order);
+void memcg_kmem_uncharge_pages(struct page *page, int order);
 #else
 static inline void sock_update_memcg(struct sock *sk)
 {
@@ -447,6 +479,68 @@ static inline void sock_update_memcg(struct sock *sk)
 static inline void sock_release_memcg(struct sock *sk)
 {
 }
+
+static inline bool mem_cgroup_kmem_active(struct mem_cgroup *memcg)
+{
+	return false;
+}
+
+static inline int memcg_kmem_newpage_charge(gfp_t gfp,
+					    struct mem_cgroup **memcgp,
+					    int order)
+{
+	*memcgp = NULL;
+	return 0;
+}
+
+static inline void memcg_kmem_commit_charge(struct page *page,
+					    struct mem_cgroup *memcg,
+					    int order)
+{
+}
+
+static inline void memcg_kmem_uncharge_pages(struct page *page, int order)
+{
+}
 #endif /* CONFIG_CGROUP_MEM_RES_CTLR_KMEM */
+
+#ifdef CONFIG_CGROUP_MEM_RES_CTLR_KMEM_SLAB
+#include <linux/jump_label.h>
+
+extern struct static_key memcg_kmem_enabled_key;
+
+/* Is kmem accounting active in any memory cgroup? */
+static inline bool memcg_kmem_enabled(void)
+{
+	return static_key_false(&memcg_kmem_enabled_key);
+}
+
+struct kmem_cache *__memcg_kmem_get_cache(struct kmem_cache *cachep,
+					  gfp_t gfp);
+void __memcg_kmem_put_cache(struct kmem_cache *cachep);
+int memcg_charge_slab(struct kmem_cache *cachep, gfp_t gfp, int order);
+void memcg_uncharge_slab(struct kmem_cache *cachep, int order);
+void memcg_register_cache(struct kmem_cache *cachep);
+void memcg_destroy_cache_clones(struct kmem_cache *cachep);
+void memcg_release_cache(struct kmem_cache *cachep);
+bool mem_cgroup_kmem_match(struct mem_cgroup *memcg, void *obj);
+#else
+static inline void memcg_register_cache(struct kmem_cache *cachep)
+{
+}
+
+static inline void memcg_destroy_cache_clones(struct kmem_cache *cachep)
+{
+}
+
+static inline void memcg_release_cache(struct kmem_cache *cachep)
+{
+}
+
+static inline bool mem_cgroup_kmem_match(struct mem_cgroup *memcg, void *obj)
+{
+	return true;
+}
+#endif /* CONFIG_CGROUP_MEM_RES_CTLR_KMEM_SLAB */
 #endif /* _LINUX_MEMCONTROL_H */
 
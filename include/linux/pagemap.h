@@ -24,6 +24,7 @@ enum mapping_flags {
 	AS_ENOSPC	= __GFP_BITS_SHIFT + 1,	/* ENOSPC on async write */
 	AS_MM_ALL_LOCKS	= __GFP_BITS_SHIFT + 2,	/* under mm_take_all_locks() */
 	AS_UNEVICTABLE	= __GFP_BITS_SHIFT + 3,	/* e.g., ramdisk, SHM_LOCK */
+	AS_LARGE_UNITS	= __GFP_BITS_SHIFT + 4,	/* fs allows multi-page units */
 };
 
 static inline void mapping_set_error(struct address_space *mapping, int error)
@@ -53,6 +54,25 @@ static inline int mapping_unevictable(struct address_space *mapping)
 	return !!mapping;
 }
 
+/*
+ * A filesystem sets this on mappings whose page cache may be filled in
+ * units of up to 1 << PAGE_CACHE_UNIT_ORDER physically contiguous pages.
+ * The units are split into ordinary pages before they are inserted, so
+ * this only needs the filesystem's ->readpages to cope with being handed
+ * contiguous pages, which every implementation does.
+ */
+#define PAGE_CACHE_UNIT_ORDER	PAGE_ALLOC_COSTLY_ORDER
+
+static inline void mapping_set_large_units(struct address_space *mapping)
+{
+	set_bit(AS_LARGE_UNITS, &mapping->flags);
+}
+
+static inline int mapping_large_units(struct address_space *mapping)
+{
+	return test_bit(AS_LARGE_UNITS, &mapping->flags);
+}
+
 static inline gfp_t mapping_gfp_mask(struct address_space * mapping)
 {
 	return (__force gfp_t)mapping->flags & __GFP_BITS_MASK;
@@ -201,14 +221,20 @@ static inline void page_unfreeze_refs(struct page *page, int count)
 }
 
 #ifdef CONFIG_NUMA
-extern struct page *__page_cache_alloc(gfp_t gfp);
+extern struct page *__page_cache_alloc_order(gfp_t gfp, unsigned int order);
 #else
-static inline struct page *__page_cache_alloc(gfp_t gfp)
+static inline struct page *__page_cache_alloc_order(gfp_t gfp,
+						    unsigned int order)
 {
-	return alloc_pages(gfp, 0);
+	return alloc_pages(gfp, order);
 }
 #endif
 
+static inline struct page *__page_cache_alloc(gfp_t gfp)
+{
+	return __page_cache_alloc_order(gfp, 0);
+}
+
 static inline struct page *page_cache_alloc(struct address_space *x)
 {
 	return __page_cache_alloc(mapping_gfp_mask(x));
@@ -456,9 +482,16 @@ int add_to_page_cache_locked(struct page *page, struct address_space *mapping,
 				pgoff_t index, gfp_t gfp_mask);
 int add_to_page_cache_lru(struct page *page, struct address_space *mapping,
 				pgoff_t index, gfp_t gfp_mask);
+
+/* Most pages add_to_page_cache_lru_batch() takes, one radix tree preload */
+#define PAGE_CACHE_ADD_BATCH	32
+
+unsigned add_to_page_cache_lru_batch(struct address_space *mapping,
+				struct page **pages, unsigned nr, gfp_t gfp_mask);
 extern void delete_from_page_cache(struct page *page);
 extern void __delete_from_page_cache(struct page *page);
 int replace_page_cache_page(struct page *old, struct page *new, gfp_t gfp_mask);
+int page_cache_take_anon_page(struct page *page);
 
 /*
  * Like add_to_page_cache_locked, but used to add newly allocated pages:
@@ -17,6 +17,7 @@
 #include <linux/atomic.h>
 
 struct rw_semaphore;
+struct mcs_spinlock;
 
 #ifdef CONFIG_RWSEM_GENERIC_SPINLOCK
 #include <linux/rwsem-spinlock.h> /* use a generic implementation */
@@ -26,6 +27,14 @@ struct rw_semaphore {
 	long			count;
 	raw_spinlock_t		wait_lock;
 	struct list_head	wait_list;
+#ifdef CONFIG_RWSEM_SPIN_ON_OWNER
+	/*
+	 * Write owner, used by optimistic spinning writers.  Readers
+	 * don't set it, so a NULL owner doesn't mean the rwsem is free.
+	 */
+	struct task_struct	*owner;
+	struct mcs_spinlock	*mcs_lock;	/* Spinner MCS lock */
+#endif
 #ifdef CONFIG_DEBUG_LOCK_ALLOC
 	struct lockdep_map	dep_map;
 #endif
@@ -1,6 +1,8 @@
 #ifndef _LINUX_SHRINKER_H
 #define _LINUX_SHRINKER_H
 
+#include <linux/nodemask.h>
+
 /*
  * This struct is used to pass information from page reclaim to the shrinkers.
  * We consolidate the values for easier extention later.
@@ -10,6 +12,21 @@ struct shrink_control {
 
 	/* How many slab objects shrinker() should scan and try to reclaim */
 	unsigned long nr_to_scan;
+
+	/*
+	 * When set, only objects charged to this memcg (or its children)
+	 * should be reclaimed, and only SHRINKER_MEMCG_AWARE shrinkers
+	 * are called.
+	 */
+	struct mem_cgroup *memcg;
+
+	/*
+	 * The nodes reclaim is applying pressure to.  SHRINKER_NUMA_AWARE
+	 * shrinkers are called once for each of them, with @nid set to the
+	 * node they should count and scan objects from.
+	 */
+	nodemask_t nodes_to_scan;
+	int nid;
 };
 
 /*
@@ -27,17 +44,28 @@ struct shrink_control {
  *
  * Note that 'shrink' will be passed nr_to_scan == 0 when the VM is
  * querying the cache size, so a fastpath for that case is appropriate.
+ *
+ * Shrinkers flagged SHRINKER_NUMA_AWARE keep their objects per node and
+ * are only asked about the node in sc->nid, so reclaim on one node does
+ * not empty the caches of the others.
  */
 struct shrinker {
 	int (*shrink)(struct shrinker *, struct shrink_control *sc);
 	int seeks;	/* seeks to recreate an obj */
 	long batch;	/* reclaim batch size, 0 = default */
+	unsigned long flags;
 
 	/* These are for internal use */
 	struct list_head list;
 	atomic_long_t nr_in_batch; /* objs pending delete */
+	atomic_long_t *nr_deferred; /* per node, for SHRINKER_NUMA_AWARE */
 };
 #define DEFAULT_SEEKS 2 /* A good number if you don't know better. */
+
+/* Flags */
+#define SHRINKER_MEMCG_AWARE	(1 << 0)
+#define SHRINKER_NUMA_AWARE	(1 << 1)
+
 extern void register_shrinker(struct shrinker *);
 extern void unregister_shrinker(struct shrinker *);
 #endif
@@ -75,6 +75,12 @@
 #else
 # define SLAB_FAILSLAB		0x00000000UL
 #endif
+/* Charge the objects to the memory cgroup of the allocating task */
+#ifdef CONFIG_CGROUP_MEM_RES_CTLR_KMEM_SLAB
+# define SLAB_ACCOUNT		0x04000000UL
+#else
+# define SLAB_ACCOUNT		0x00000000UL
+#endif
 
 /* The following flags affect the page allocator grouping pages by mobility */
 #define SLAB_RECLAIM_ACCOUNT	0x00020000UL		/* Objects are reclaimable */
@@ -106,6 +112,49 @@ int kmem_cache_shrink(struct kmem_cache *);
 void kmem_cache_free(struct kmem_cache *, void *);
 unsigned int kmem_cache_size(struct kmem_cache *);
 
+#ifdef CONFIG_CGROUP_MEM_RES_CTLR_KMEM_SLAB
+struct mem_cgroup;
+struct memcg_cache_array;
+
+/*
+ * A SLAB_ACCOUNT cache is cloned for every memory cgroup with kmem
+ * accounting active that allocates from it, and the slabs of a clone
+ * are charged to its cgroup.  Root caches and clones both carry these
+ * params, the memory controller owns them.
+ *
+ * @is_root_cache: the cache was created by kmem_cache_create()
+ * @memcg_caches: root: its clones, indexed by memcg css id, RCU protected
+ * @children: root: all its clones, live or retired
+ * @memcg: clone: the cgroup its slabs are charged to
+ * @root_cache: clone: the cache it was cloned from
+ * @cachep: clone: the clone itself
+ * @list: clone: entry on the cgroup's, or on the retired, clone list
+ * @siblings: clone: entry on the root cache's children list
+ * @nr_slabs: clone: slabs allocated, biased by one until retired
+ */
+struct memcg_cache_params {
+	bool is_root_cache;
+	union {
+		struct {
+			struct memcg_cache_array __rcu *memcg_caches;
+			struct list_head children;
+		};
+		struct {
+			struct mem_cgroup *memcg;
+			struct kmem_cache *root_cache;
+			struct kmem_cache *cachep;
+			struct list_head list;
+			struct list_head siblings;
+			atomic_t nr_slabs;
+		};
+	};
+};
+
+struct kmem_cache *kmem_cache_create_memcg(struct kmem_cache *, char *,
+			struct memcg_cache_params *);
+void kmem_cache_retire(struct kmem_cache *);
+#endif
+
 /*
  * Please use this macro to create slab caches. Simply specify the
  * name of the structure and maybe some flags that are listed above.
@@ -0,0 +1,35 @@
+/*
+ *  include/linux/stat_attr.h
+ *
+ *  Inode attributes as returned by the batched lookup and directory
+ *  calls.  Unlike struct stat, the layout is the same for 32-bit and
+ *  64-bit callers and every field is wide enough for any inode.
+ */
+
+#ifndef _LINUX_STAT_ATTR_H
+#define _LINUX_STAT_ATTR_H
+
+#include <linux/types.h>
+
+struct stat_attr {
+	__u64	sa_dev;		/* new_encode_dev() format */
+	__u64	sa_ino;
+	__u32	sa_mode;
+	__u32	sa_nlink;
+	__u32	sa_uid;
+	__u32	sa_gid;
+	__u64	sa_rdev;	/* new_encode_dev() format */
+	__s64	sa_size;
+	__u64	sa_blocks;	/* in 512-byte units */
+	__u32	sa_blksize;
+	__u32	__reserved;
+	__s64	sa_atime;
+	__s64	sa_mtime;
+	__s64	sa_ctime;
+	__u32	sa_atime_nsec;
+	__u32	sa_mtime_nsec;
+	__u32	sa_ctime_nsec;
+	__u32	__reserved2;
+};
+
+#endif /* _LINUX_STAT_ATTR_H */
@@ -0,0 +1,172 @@
+/*
+ * Context tracking: Probe on high level context boundaries such as kernel
+ * and userspace. This includes syscalls and exceptions entry/exit.
+ *
+ * This is used by RCU to remove its dependency on the timer tick while a CPU
+ * runs in userspace, and by the cputime accounting of full dynticks CPUs,
+ * which accounts user and system time on these boundaries instead of
+ * sampling them from a tick that may be stopped.
+ *
+ * Only the CPUs set active with context_tracking_cpu_set() pay for the
+ * probes: the tasks running there have TIF_NOHZ set, which sends their
+ * syscalls through the slow path.
+ */
+
+#include <linux/context_tracking.h>
+#include <linux/kernel_stat.h>
+#include <linux/rcupdate.h>
+#include <linux/sched.h>
+#include <linux/hardirq.h>
+#include <linux/export.h>
+
+DEFINE_PER_CPU(struct context_tracking, context_tracking);
+
+void context_tracking_cpu_set(int cpu)
+{
+	per_cpu(context_tracking.active, cpu) = true;
+}
+
+/*
+ * The cputime elapsed since @tsk was last accounted.  This runs on
+ * jiffies, which a housekeeping CPU keeps updating while our tick is
+ * stopped.
+ */
+static cputime_t vtime_delta(struct task_struct *tsk)
+{
+	unsigned long now = ACCESS_ONCE(jiffies);
+	unsigned long delta = now - tsk->vtime_snap;
+
+	tsk->vtime_snap = now;
+
+	return jiffies_to_cputime(delta);
+}
+
+static void vtime_account_system(struct task_struct *tsk)
+{
+	cputime_t delta = vtime_delta(tsk);
+
+	if (delta)
+		account_system_time(tsk, 0, delta, cputime_to_scaled(delta));
+}
+
+static void vtime_account_user(struct task_struct *tsk)
+{
+	cputime_t delta = vtime_delta(tsk);
+
+	if (delta)
+		account_user_time(tsk, delta, cputime_to_scaled(delta));
+}
+
+/**
+ * user_enter - Inform the context tracking that the CPU is going to
+ *              enter userspace mode.
+ *
+ * This function must be called right before we switch from
+ * the kernel to userspace, when it's guaranteed the remaining kernel
+ * instructions to execute won't use any RCU read side critical section
+ * because this function sets RCU in extended quiescent state.
+ */
+void user_enter(void)
+{
+	unsigned long flags;
+
+	/*
+	 * Some contexts may involve an exception occuring in an irq,
+	 * leading to that nesting:
+	 * rcu_irq_enter() rcu_user_exit() rcu_user_exit() rcu_irq_exit()
+	 * This would mess up the dyntick_nesting count though. And rcu_irq_*()
+	 * helpers are enough to protect RCU uses inside the exception. So
+	 * just return immediately if we detect we are in an IRQ.
+	 */
+	if (in_interrupt())
+		return;
+
+	/* Kernel threads aren't supposed to go to userspace */
+	WARN_ON_ONCE(!current->mm);
+
+	local_irq_save(flags);
+	if (__this_cpu_read(context_tracking.active) &&
+	    __this_cpu_read(context_tracking.state) != IN_USER) {
+		/*
+		 * Account the time spent in the kernel while RCU is still
+		 * watching: the accounting itself may use it.
+		 */
+		vtime_account_system(current);
+		rcu_user_enter();
+		__this_cpu_write(context_tracking.state, IN_USER);
+	}
+	local_irq_restore(flags);
+}
+
+/**
+ * user_exit - Inform the context tracking that the CPU is
+ *             exiting userspace mode and entering the kernel.
+ *
+ * This function must be called after we entered the kernel from userspace
+ * before any use of RCU read side critical section. This potentially
+ * include any high level kernel code like syscalls, exceptions, signal
+ * handling, etc...
+ */
+void user_exit(void)
+{
+	unsigned long flags;
+
+	if (in_interrupt())
+		return;
+
+	local_irq_save(flags);
+	if (__this_cpu_read(context_tracking.state) == IN_USER) {
+		rcu_user_exit();
+		vtime_account_user(current);
+		__this_cpu_write(context_tracking.state, IN_KERNEL);
+	}
+	local_irq_restore(flags);
+}
+
+/**
+ * context_tracking_task_switch - context switch the syscall callbacks
+ * @prev: the task that is being switched out
+ * @next: the task that is being switched in
+ *
+ * The context tracking uses the syscall slow path to implement its user-kernel
+ * boundaries probes on syscalls. This way it doesn't impact the syscall fast
+ * path on CPUs that don't do context tracking.
+ *
+ * But we need to clear the flag on the previous task because it may later
+ * migrate to some CPU that doesn't do the context tracking. As such the TIF
+ * flag may not be desired there.
+ */
+void context_tracking_task_switch(struct task_struct *prev,
+				  struct task_struct *next)
+{
+	if (__this_cpu_read(context_tracking.active)) {
+		clear_tsk_thread_flag(prev, TIF_NOHZ);
+		set_tsk_thread_flag(next, TIF_NOHZ);
+	}
+}
+
+/**
+ * vtime_task_switch - account the cputime of the task switched out
+ * @prev: the task that has just been switched out
+ *
+ * Context switches happen in the kernel: the time @prev ran since its
+ * last boundary is system time, or idle time for the idle task.  The
+ * new current task starts its account from now on.
+ */
+void vtime_task_switch(struct task_struct *prev)
+{
+	cputime_t delta;
+
+	if (!context_tracking_active())
+		return;
+
+	delta = vtime_delta(prev);
+	if (delta) {
+		if (is_idle_task(prev))
+			account_idle_time(delta);
+		else
+			account_system_time(prev, 0, delta,
+					    cputime_to_scaled(delta));
+	}
+	current->vtime_snap = prev->vtime_snap;
+}
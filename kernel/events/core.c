@@ -36,6 +36,7 @@
 #include <linux/perf_event.h>
 #include <linux/ftrace_event.h>
 #include <linux/hw_breakpoint.h>
+#include <linux/tick.h>
 
 #include "internal.h"
 
@@ -648,9 +649,22 @@ static void perf_pmu_rotate_start(struct pmu *pmu)
 
 	WARN_ON(!irqs_disabled());
 
-	if (list_empty(&cpuctx->rotation_list))
+	if (list_empty(&cpuctx->rotation_list)) {
+		bool was_empty = list_empty(head);
+
 		list_add(&cpuctx->rotation_list, head);
+		/* The rotation is driven by the tick */
+		if (was_empty)
+			tick_nohz_full_kick();
+	}
+}
+
+#ifdef CONFIG_NO_HZ_FULL
+bool perf_event_can_stop_tick(void)
+{
+	return list_empty(&__get_cpu_var(rotation_list));
 }
+#endif
 
 static void get_ctx(struct perf_event_context *ctx)
 {
@@ -45,6 +45,8 @@
  *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
  */
 #include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/log2.h>
 #include <linux/poll.h>
 #include <linux/fs.h>
 #include <linux/file.h>
@@ -67,7 +69,13 @@
 
 int __read_mostly futex_cmpxchg_enabled;
 
-#define FUTEX_HASHBITS (CONFIG_BASE_SMALL ? 4 : 8)
+/*
+ * Minimum number of buckets of the hash slice of a node, and of the
+ * private hash of a process:
+ */
+#define FUTEX_HASH_MIN		(CONFIG_BASE_SMALL ? 16 : 256)
+#define FUTEX_PRIVATE_HASH_MIN	16
+#define FUTEX_PRIVATE_HASH_MAX	256
 
 /*
  * Futex flags used to encode options to functions and preserve them across
@@ -146,9 +154,32 @@ static const struct futex_q futex_q_init = {
 struct futex_hash_bucket {
 	spinlock_t lock;
 	struct plist_head chain;
+} ____cacheline_aligned_in_smp;
+
+/*
+ * The global hash is sized to the number of CPUs and split into one
+ * slice per node, each allocated on its node.  A key picks its slice
+ * from the bits of its hash above the bucket index, so all the
+ * processes sharing a futex agree on its bucket.
+ */
+static unsigned long __read_mostly futex_hashsize;
+static unsigned int __read_mostly futex_hashshift;
+static struct futex_hash_bucket *futex_queues[MAX_NUMNODES] __read_mostly;
+
+/*
+ * PROCESS_PRIVATE futexes of a multi-threaded process are hashed in a
+ * table of its own, so its threads never contend on a bucket lock with
+ * unrelated processes.
+ */
+struct futex_private_hash {
+	unsigned long mask;
+	struct futex_hash_bucket queues[0];
 };
 
-static struct futex_hash_bucket futex_queues[1<<FUTEX_HASHBITS];
+static inline int futex_key_is_private(union futex_key *key)
+{
+	return !(key->both.offset & (FUT_OFF_INODE|FUT_OFF_MMSHARED));
+}
 
 /*
  * We hash on the keys returned from get_futex_key (see below).
@@ -158,7 +189,78 @@ static struct futex_hash_bucket *hash_futex(union futex_key *key)
 	u32 hash = jhash2((u32*)&key->both.word,
 			  (sizeof(key->both.word)+sizeof(key->both.ptr))/4,
 			  key->both.offset);
-	return &futex_queues[hash & ((1 << FUTEX_HASHBITS)-1)];
+	int node = 0;
+
+	if (futex_key_is_private(key)) {
+		struct futex_private_hash *fph = key->private.mm->futex_hash;
+
+		if (fph)
+			return &fph->queues[hash & fph->mask];
+	}
+
+	if (nr_node_ids > 1)
+		node = (hash >> futex_hashshift) % nr_node_ids;
+	return &futex_queues[node][hash & (futex_hashsize - 1)];
+}
+
+static void futex_hash_bucket_init(struct futex_hash_bucket *hb)
+{
+	plist_head_init(&hb->chain);
+	spin_lock_init(&hb->lock);
+}
+
+/**
+ * futex_mm_hash_alloc() - Give @mm a private futex hash
+ * @mm:		the mm which is about to get a second user
+ *
+ * Called when a task is cloned with CLONE_VM.  The first time, @mm has
+ * a single user, the task doing the clone, which cannot be waiting on a
+ * futex nor racing with another clone: the private futexes can move from
+ * the global hash to the private one without any waiter being left
+ * behind.  Once installed, the private hash stays until the last user
+ * of @mm is gone.  If it cannot be allocated, @mm keeps using the global
+ * hash for good, since later clones no longer have a single user.
+ */
+void futex_mm_hash_alloc(struct mm_struct *mm)
+{
+	struct futex_private_hash *fph;
+	unsigned long i, size, bytes;
+
+	if (mm->futex_hash || test_bit(MMF_FUTEX_GLOBAL, &mm->flags))
+		return;
+
+	size = roundup_pow_of_two(4 * num_online_cpus());
+	size = clamp_t(unsigned long, size, FUTEX_PRIVATE_HASH_MIN,
+		       FUTEX_PRIVATE_HASH_MAX);
+	bytes = sizeof(*fph) + size * sizeof(fph->queues[0]);
+
+	/* Large hashes are high order, don't fail on fragmentation alone */
+	fph = kmalloc(bytes, GFP_KERNEL | __GFP_NOWARN);
+	if (!fph)
+		fph = vmalloc(bytes);
+	if (!fph) {
+		set_bit(MMF_FUTEX_GLOBAL, &mm->flags);
+		return;
+	}
+
+	fph->mask = size - 1;
+	for (i = 0; i < size; i++)
+		futex_hash_bucket_init(&fph->queues[i]);
+
+	mm->futex_hash = fph;
+}
+
+/**
+ * futex_mm_hash_free() - Release the private futex hash of @mm
+ * @mm:		the mm whose last user is gone
+ */
+void futex_mm_hash_free(struct mm_struct *mm)
+{
+	if (is_vmalloc_addr(mm->futex_hash))
+		vfree(mm->futex_hash);
+	else
+		kfree(mm->futex_hash);
+	mm->futex_hash = NULL;
 }
 
 /*
@@ -2709,8 +2811,9 @@ SYSCALL_DEFINE6(futex, u32 __user *, uaddr, int, op, u32, val,
 
 static int __init futex_init(void)
 {
+	unsigned long i, size;
 	u32 curval;
-	int i;
+	int node;
 
 	/*
 	 * This will fail and we want it. Some arch implementations do
@@ -2725,9 +2828,22 @@ static int __init futex_init(void)
 	if (cmpxchg_futex_value_locked(&curval, NULL, 0, 0) == -EFAULT)
 		futex_cmpxchg_enabled = 1;
 
-	for (i = 0; i < ARRAY_SIZE(futex_queues); i++) {
-		plist_head_init(&futex_queues[i].chain);
-		spin_lock_init(&futex_queues[i].lock);
+	/* 256 buckets per CPU, spread over the nodes */
+	size = roundup_pow_of_two(256 * num_possible_cpus()) / nr_node_ids;
+	futex_hashsize = max_t(unsigned long, FUTEX_HASH_MIN,
+			       rounddown_pow_of_two(size));
+	futex_hashshift = ilog2(futex_hashsize);
+	size = futex_hashsize * sizeof(struct futex_hash_bucket);
+
+	for (node = 0; node < nr_node_ids; node++) {
+		int nid = node_online(node) ? node : NUMA_NO_NODE;
+
+		futex_queues[node] = vzalloc_node(size, nid);
+		if (!futex_queues[node])
+			panic("futex: cannot allocate the futex hash\n");
+
+		for (i = 0; i < futex_hashsize; i++)
+			futex_hash_bucket_init(&futex_queues[node][i]);
 	}
 
 	return 0;
@@ -9,6 +9,8 @@
 #include <asm/uaccess.h>
 #include <linux/kernel_stat.h>
 #include <trace/events/timer.h>
+#include <linux/workqueue.h>
+#include <linux/tick.h>
 
 /*
  * Called after updating RLIMIT_CPU to run cpu timer and update
@@ -525,6 +527,28 @@ static inline int expires_gt(cputime_t expires, cputime_t new_exp)
 	return expires == 0 || expires > new_exp;
 }
 
+#ifdef CONFIG_NO_HZ_FULL
+static void nohz_kick_work_fn(struct work_struct *work)
+{
+	tick_nohz_full_kick_all();
+}
+
+static DECLARE_WORK(nohz_kick_work, nohz_kick_work_fn);
+
+/*
+ * A full dynticks CPU running the timer's task may have stopped its
+ * tick and must be told to restart it.  The timers are armed with
+ * interrupts disabled, so send the IPIs from process context.
+ */
+static void posix_cpu_timer_kick_nohz(void)
+{
+	if (tick_nohz_full_enabled())
+		schedule_work(&nohz_kick_work);
+}
+#else
+static inline void posix_cpu_timer_kick_nohz(void) { }
+#endif
+
 /*
  * Insert the timer on the appropriate list before any timers that
  * expire later.  This must be called with the tasklist_lock held
@@ -796,6 +820,9 @@ static int posix_cpu_timer_set(struct k_itimer *timer, int flags,
 		cpu_timer_fire(timer);
 	}
 
+	if (new_expires.sched != 0)
+		posix_cpu_timer_kick_nohz();
+
 	ret = 0;
  out:
 	if (old) {
@@ -1031,6 +1058,23 @@ static inline int task_cputime_zero(const struct task_cputime *cputime)
 	return 0;
 }
 
+#ifdef CONFIG_NO_HZ_FULL
+/*
+ * The CPU timers of @tsk and of its thread group are checked from the
+ * tick: keep it running as long as one of them is armed.
+ */
+bool posix_cpu_timers_can_stop_tick(struct task_struct *tsk)
+{
+	if (!task_cputime_zero(&tsk->cputime_expires))
+		return false;
+
+	if (tsk->signal->cputimer.running)
+		return false;
+
+	return true;
+}
+#endif
+
 /*
  * Check for any per-thread CPU timers that have fired and move them
  * off the tsk->*_timers list onto the firing list.  Per-thread timers
@@ -1201,6 +1245,7 @@ void posix_cpu_timer_schedule(struct k_itimer *timer)
 	BUG_ON(!irqs_disabled());
 	arm_timer(timer);
 	spin_unlock(&p->sighand->siglock);
+	posix_cpu_timer_kick_nohz();
 
 out_unlock:
 	read_unlock(&tasklist_lock);
@@ -1389,6 +1434,8 @@ void set_process_cpu_timer(struct task_struct *tsk, unsigned int clock_idx,
 			tsk->signal->cputime_expires.virt_exp = *newval;
 		break;
 	}
+
+	posix_cpu_timer_kick_nohz();
 }
 
 static int do_cpu_nanosleep(const clockid_t which_clock, int flags,
@@ -700,7 +700,7 @@ static void rcu_preempt_do_callbacks(void)
  */
 void call_rcu(struct rcu_head *head, void (*func)(struct rcu_head *rcu))
 {
-	__call_rcu(head, func, &rcu_preempt_state, 0);
+	__call_rcu(head, func, &rcu_preempt_state, 0, true);
 }
 EXPORT_SYMBOL_GPL(call_rcu);
 
@@ -714,7 +714,7 @@ EXPORT_SYMBOL_GPL(call_rcu);
 void kfree_call_rcu(struct rcu_head *head,
 		    void (*func)(struct rcu_head *rcu))
 {
-	__call_rcu(head, func, &rcu_preempt_state, 1);
+	__call_rcu(head, func, &rcu_preempt_state, 1, true);
 }
 EXPORT_SYMBOL_GPL(kfree_call_rcu);
 
@@ -1132,7 +1132,7 @@ static void rcu_preempt_process_callbacks(void)
 void kfree_call_rcu(struct rcu_head *head,
 		    void (*func)(struct rcu_head *rcu))
 {
-	__call_rcu(head, func, &rcu_sched_state, 1);
+	__call_rcu(head, func, &rcu_sched_state, 1, true);
 }
 EXPORT_SYMBOL_GPL(kfree_call_rcu);
 
@@ -2299,3 +2299,298 @@ static void increment_cpu_stall_ticks(void)
 }
 
 #endif /* #else #ifdef CONFIG_RCU_CPU_STALL_INFO */
+
+#ifdef CONFIG_RCU_NOCB_CPU
+
+/*
+ * Offload callback processing from the boot-time-specified set of CPUs
+ * specified by rcu_nocb_mask.  For each such CPU and each RCU flavor,
+ * a kthread ("rcuo") takes the CPU's callbacks, waits for a grace period
+ * and then invokes them.  These kthreads are not bound, so they can be
+ * affined to the housekeeping CPUs, leaving the no-CBs CPUs free of
+ * RCU_SOFTIRQ callback invocation.
+ *
+ * The callbacks are queued on a lockless list, so that __call_rcu()
+ * stays cheap and so that rcu_barrier() can queue its callbacks on
+ * behalf of CPUs that are offline.
+ */
+
+static cpumask_var_t rcu_nocb_mask; /* CPUs to have callbacks offloaded. */
+static bool have_rcu_nocb_mask;	    /* Was rcu_nocb_mask allocated? */
+static char __initdata nocb_buf[NR_CPUS * 5];
+
+/* Parse the boot-time rcu_nocbs CPU list from the kernel parameters. */
+static int __init rcu_nocb_setup(char *str)
+{
+	alloc_bootmem_cpumask_var(&rcu_nocb_mask);
+	have_rcu_nocb_mask = true;
+	cpulist_parse(str, rcu_nocb_mask);
+	return 1;
+}
+__setup("rcu_nocbs=", rcu_nocb_setup);
+
+/* Is the specified CPU a no-CBs CPU? */
+static bool is_nocb_cpu(int cpu)
+{
+	if (have_rcu_nocb_mask)
+		return cpumask_test_cpu(cpu, rcu_nocb_mask);
+	return false;
+}
+
+/*
+ * Fold the full dynticks CPUs into the no-CBs set, drop CPUs that can
+ * never exist and the boot CPU, whose callbacks may be needed before
+ * the kthreads are spawned.
+ * Called from rcu_init(), so before any callback could be queued on
+ * the wrong list.
+ */
+static void __init rcu_init_nocb(void)
+{
+	int cpu = smp_processor_id();
+
+#ifdef CONFIG_NO_HZ_FULL
+	if (tick_nohz_full_running) {
+		if (!have_rcu_nocb_mask) {
+			alloc_bootmem_cpumask_var(&rcu_nocb_mask);
+			have_rcu_nocb_mask = true;
+		}
+		cpumask_or(rcu_nocb_mask, rcu_nocb_mask, tick_nohz_full_mask);
+	}
+#endif /* #ifdef CONFIG_NO_HZ_FULL */
+	if (!have_rcu_nocb_mask)
+		return;
+	if (!cpumask_subset(rcu_nocb_mask, cpu_possible_mask)) {
+		printk(KERN_WARNING
+		       "\tNote: rcu_nocbs= contains nonexistent CPUs.\n");
+		cpumask_and(rcu_nocb_mask, rcu_nocb_mask, cpu_possible_mask);
+	}
+	if (cpumask_test_cpu(cpu, rcu_nocb_mask)) {
+		printk(KERN_INFO "\tBoot CPU %d cannot be a no-CBs CPU.\n",
+		       cpu);
+		cpumask_clear_cpu(cpu, rcu_nocb_mask);
+	}
+	if (cpumask_empty(rcu_nocb_mask))
+		return;
+	cpulist_scnprintf(nocb_buf, sizeof(nocb_buf), rcu_nocb_mask);
+	printk(KERN_INFO "\tOffload RCU callbacks from CPUs: %s.\n", nocb_buf);
+}
+
+static void rcu_nocb_wake_work_func(struct irq_work *work)
+{
+	struct rcu_data *rdp = container_of(work, struct rcu_data,
+					    nocb_wake_work);
+
+	wake_up(&rdp->nocb_wq);
+}
+
+/*
+ * Enqueue the specified callback onto the specified no-CBs CPU's list,
+ * waking its kthread if the list was empty.  This may be called from
+ * any CPU.  With interrupts disabled the caller might hold a scheduler
+ * lock, so the wakeup is then left to an irq_work.
+ */
+static void __call_rcu_nocb_enqueue(struct rcu_data *rdp,
+				    struct rcu_head *rhp, bool irqs_off)
+{
+	struct rcu_head **old_rhpp;
+
+	old_rhpp = xchg(&rdp->nocb_tail, &rhp->next);
+	ACCESS_ONCE(*old_rhpp) = rhp;
+
+	/* If the list was empty and there is a kthread, awaken it. */
+	if (old_rhpp != &rdp->nocb_head || !rdp->nocb_kthread)
+		return;
+	if (irqs_off)
+		irq_work_queue(&rdp->nocb_wake_work);
+	else
+		wake_up(&rdp->nocb_wq);
+}
+
+/*
+ * This is a helper for __call_rcu(), which invokes this when the normal
+ * callback queue is inoperable because the current CPU is a no-CBs CPU.
+ * Returns true if the callback was handed to the rcuo kthread, false
+ * if the callback is to be queued normally.
+ */
+static bool __call_rcu_nocb(struct rcu_data *rdp, struct rcu_head *rhp,
+			    bool irqs_off)
+{
+	if (!is_nocb_cpu(rdp->cpu))
+		return false;
+	__call_rcu_nocb_enqueue(rdp, rhp, irqs_off);
+	if (__is_kfree_rcu_offset((unsigned long)rhp->func))
+		trace_rcu_kfree_callback(rdp->rsp->name, rhp,
+					 (unsigned long)rhp->func, 0, 0);
+	else
+		trace_rcu_callback(rdp->rsp->name, rhp, 0, 0);
+	return true;
+}
+
+/*
+ * Queue rcu_barrier()'s callback on each no-CBs CPU, online or not:
+ * the lists are lockless and drained by the kthreads in order.
+ */
+static void rcu_nocb_barrier(struct rcu_state *rsp)
+{
+	struct rcu_head *head;
+	int cpu;
+
+	if (!have_rcu_nocb_mask)
+		return;
+	for_each_cpu(cpu, rcu_nocb_mask) {
+		head = &per_cpu(rcu_barrier_head, cpu);
+		atomic_inc(&rcu_barrier_cpu_count);
+		debug_rcu_head_queue(head);
+		head->func = rcu_barrier_callback;
+		head->next = NULL;
+		__call_rcu_nocb_enqueue(per_cpu_ptr(rsp->rda, cpu), head,
+					false);
+	}
+}
+
+struct rcu_nocb_gp {
+	struct rcu_head head;
+	struct completion done;
+};
+
+static void rcu_nocb_gp_done(struct rcu_head *head)
+{
+	struct rcu_nocb_gp *gp = container_of(head, struct rcu_nocb_gp, head);
+
+	complete(&gp->done);
+}
+
+/*
+ * Wait for a grace period of the kthread's flavor.  The callback used
+ * for this is queued normally, on the CPU the kthread runs on: handing
+ * it to an rcuo kthread could have two kthreads wait on each other.
+ */
+static void rcu_nocb_wait_gp(struct rcu_data *rdp)
+{
+	struct rcu_nocb_gp gp;
+
+	init_rcu_head_on_stack(&gp.head);
+	init_completion(&gp.done);
+	__call_rcu(&gp.head, rcu_nocb_gp_done, rdp->rsp, 0, false);
+	wait_for_completion(&gp.done);
+	destroy_rcu_head_on_stack(&gp.head);
+}
+
+/*
+ * Per-rcu_data kthread, but only for no-CBs CPUs.  Each kthread invokes
+ * callbacks queued by the corresponding no-CBs CPU.
+ */
+static int rcu_nocb_kthread(void *arg)
+{
+	int c;
+	struct rcu_head *list;
+	struct rcu_head *next;
+	struct rcu_head **tail;
+	struct rcu_data *rdp = arg;
+
+	/* Each pass through this loop invokes one batch of callbacks */
+	for (;;) {
+		wait_event_interruptible(rdp->nocb_wq,
+					 ACCESS_ONCE(rdp->nocb_head));
+		list = ACCESS_ONCE(rdp->nocb_head);
+		if (!list)
+			continue;
+
+		/*
+		 * Extract queued callbacks and wait for a grace period
+		 * to elapse.
+		 */
+		ACCESS_ONCE(rdp->nocb_head) = NULL;
+		tail = xchg(&rdp->nocb_tail, &rdp->nocb_head);
+		rcu_nocb_wait_gp(rdp);
+
+		/* Each pass through the following loop invokes a callback. */
+		trace_rcu_batch_start(rdp->rsp->name, 0, 0, -1);
+		c = 0;
+		while (list) {
+			next = list->next;
+			/* Wait for enqueuing to complete, if needed. */
+			while (next == NULL && &list->next != tail) {
+				schedule_timeout_interruptible(1);
+				next = list->next;
+			}
+			debug_rcu_head_unqueue(list);
+			local_bh_disable();
+			__rcu_reclaim(rdp->rsp->name, list);
+			c++;
+			local_bh_enable();
+			list = next;
+		}
+		trace_rcu_batch_end(rdp->rsp->name, c, false, false, false,
+				    true);
+		cond_resched();
+	}
+	return 0;
+}
+
+/* Initialize per-rcu_data variables for no-CBs CPUs. */
+static void __init rcu_boot_init_nocb_percpu_data(struct rcu_data *rdp)
+{
+	rdp->nocb_tail = &rdp->nocb_head;
+	init_waitqueue_head(&rdp->nocb_wq);
+	init_irq_work(&rdp->nocb_wake_work, rcu_nocb_wake_work_func);
+}
+
+/* Create a kthread for each RCU flavor for each no-CBs CPU. */
+static void __init rcu_spawn_nocb_kthreads(struct rcu_state *rsp)
+{
+	int cpu;
+	struct rcu_data *rdp;
+	struct task_struct *t;
+
+	for_each_cpu(cpu, rcu_nocb_mask) {
+		rdp = per_cpu_ptr(rsp->rda, cpu);
+		t = kthread_run(rcu_nocb_kthread, rdp, "rcuo%c/%d",
+				rsp->name[4], cpu);
+		BUG_ON(IS_ERR(t));
+		ACCESS_ONCE(rdp->nocb_kthread) = t;
+		/* Callbacks queued before the kthread existed. */
+		if (ACCESS_ONCE(rdp->nocb_head))
+			wake_up(&rdp->nocb_wq);
+	}
+}
+
+static int __init rcu_spawn_all_nocb_kthreads(void)
+{
+	if (!have_rcu_nocb_mask)
+		return 0;
+	rcu_spawn_nocb_kthreads(&rcu_sched_state);
+	rcu_spawn_nocb_kthreads(&rcu_bh_state);
+#ifdef CONFIG_TREE_PREEMPT_RCU
+	rcu_spawn_nocb_kthreads(&rcu_preempt_state);
+#endif /* #ifdef CONFIG_TREE_PREEMPT_RCU */
+	return 0;
+}
+early_initcall(rcu_spawn_all_nocb_kthreads);
+
+#else /* #ifdef CONFIG_RCU_NOCB_CPU */
+
+static bool is_nocb_cpu(int cpu)
+{
+	return false;
+}
+
+static bool __call_rcu_nocb(struct rcu_data *rdp, struct rcu_head *rhp,
+			    bool irqs_off)
+{
+	return false;
+}
+
+static void rcu_nocb_barrier(struct rcu_state *rsp)
+{
+}
+
+static void __init rcu_boot_init_nocb_percpu_data(struct rcu_data *rdp)
+{
+}
+
+static void __init rcu_init_nocb(void)
+{
+}
+
+#endif /* #else #ifdef CONFIG_RCU_NOCB_CPU */
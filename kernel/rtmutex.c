@@ -98,11 +98,18 @@ static inline void mark_rt_mutex_waiters(struct rt_mutex *lock)
  */
 int rt_mutex_getprio(struct task_struct *task)
 {
+	int prio;
+
 	if (likely(!task_has_pi_waiters(task)))
 		return task->normal_prio;
 
-	return min(task_top_pi_waiter(task)->pi_list_entry.prio,
-		   task->normal_prio);
+	/*
+	 * A -deadline waiter boosts the owner to the top RT priority
+	 * only: there are no runtime/deadline parameters to lend.
+	 */
+	prio = max(task_top_pi_waiter(task)->pi_list_entry.prio, MAX_DL_PRIO);
+
+	return min(prio, task->normal_prio);
 }
 
 /*
@@ -16,9 +16,10 @@
  *
  * This is the generic async execution mechanism.  Work items as are
  * executed in process context.  The worker pool is shared and
- * automatically managed.  There is one worker pool for each CPU and
- * one extra for works which are better served by workers which are
- * not bound to any specific CPU.
+ * automatically managed.  There is one worker pool for each CPU.
+ * Works which are better served by workers which are not bound to any
+ * specific CPU go to unbound pools, which are keyed by their worker
+ * attributes and created for each NUMA node on demand.
  *
  * Please read Documentation/workqueue.txt for details.
  */
@@ -41,6 +42,8 @@
 #include <linux/debug_locks.h>
 #include <linux/lockdep.h>
 #include <linux/idr.h>
+#include <linux/rculist.h>
+#include <linux/device.h>
 
 #include "workqueue_sched.h"
 
@@ -72,6 +75,9 @@ enum {
 	TRUSTEE_RELEASE		= 3,		/* release workers */
 	TRUSTEE_DONE		= 4,		/* trustee is done */
 
+	/* IDs of unbound gcwqs, above the cpu numbers and WORK_CPU_NONE */
+	UNBOUND_GCWQ_ID_BASE	= WORK_CPU_NONE + 1,
+
 	BUSY_WORKER_HASH_ORDER	= 6,		/* 64 pointers */
 	BUSY_WORKER_HASH_SIZE	= 1 << BUSY_WORKER_HASH_ORDER,
 	BUSY_WORKER_HASH_MASK	= BUSY_WORKER_HASH_SIZE - 1,
@@ -112,6 +118,13 @@ enum {
  * F: wq->flush_mutex protected.
  *
  * W: workqueue_lock protected.
+ *
+ * PF: Added with wq->flush_mutex and workqueue_lock held and never
+ *     removed while the workqueue is alive.  Readers may walk locklessly.
+ *
+ * PW: wq_pool_mutex protected for writes.  Readers may peek locklessly.
+ *
+ * M: wq_mayday_lock protected.
  */
 
 struct global_cwq;
@@ -148,6 +161,8 @@ struct global_cwq {
 	spinlock_t		lock;		/* the gcwq lock */
 	struct list_head	worklist;	/* L: list of pending works */
 	unsigned int		cpu;		/* I: the associated cpu */
+	int			id;		/* I: gcwq ID */
+	int			node;		/* I: the associated node ID */
 	unsigned int		flags;		/* L: GCWQ_* flags */
 
 	int			nr_workers;	/* L: total number of workers */
@@ -167,6 +182,10 @@ struct global_cwq {
 	unsigned int		trustee_state;	/* L: trustee state */
 	wait_queue_head_t	trustee_wait;	/* trustee wait */
 	struct worker		*first_idle;	/* L: first idle worker */
+
+	/* unbound gcwqs only */
+	struct workqueue_attrs	*attrs;		/* I: worker attributes */
+	struct list_head	unbound_node;	/* PW: on unbound_gcwqs */
 } ____cacheline_aligned_in_smp;
 
 /*
@@ -184,7 +203,9 @@ struct cpu_workqueue_struct {
 	int			nr_active;	/* L: nr of active works */
 	int			max_active;	/* L: max active works */
 	struct list_head	delayed_works;	/* L: delayed works */
-};
+	struct list_head	cwqs_node;	/* PF: node on wq->cwqs */
+	struct list_head	mayday_node;	/* M: node on wq->maydays */
+} __aligned(1 << WORK_STRUCT_FLAG_BITS);
 
 /*
  * Structure used to wait for workqueue flush.
@@ -195,38 +216,20 @@ struct wq_flusher {
 	struct completion	done;		/* flush completion */
 };
 
-/*
- * All cpumasks are assumed to be always set on UP and thus can't be
- * used to determine whether there's something to be done.
- */
-#ifdef CONFIG_SMP
-typedef cpumask_var_t mayday_mask_t;
-#define mayday_test_and_set_cpu(cpu, mask)	\
-	cpumask_test_and_set_cpu((cpu), (mask))
-#define mayday_clear_cpu(cpu, mask)		cpumask_clear_cpu((cpu), (mask))
-#define for_each_mayday_cpu(cpu, mask)		for_each_cpu((cpu), (mask))
-#define alloc_mayday_mask(maskp, gfp)		zalloc_cpumask_var((maskp), (gfp))
-#define free_mayday_mask(mask)			free_cpumask_var((mask))
-#else
-typedef unsigned long mayday_mask_t;
-#define mayday_test_and_set_cpu(cpu, mask)	test_and_set_bit(0, &(mask))
-#define mayday_clear_cpu(cpu, mask)		clear_bit(0, &(mask))
-#define for_each_mayday_cpu(cpu, mask)		if ((cpu) = 0, (mask))
-#define alloc_mayday_mask(maskp, gfp)		true
-#define free_mayday_mask(mask)			do { } while (0)
-#endif
+struct wq_device;
 
 /*
  * The externally visible workqueue abstraction is an array of
- * per-CPU workqueues:
+ * per-CPU workqueues for bound workqueues and of per-node workqueues
+ * for unbound ones:
  */
 struct workqueue_struct {
 	unsigned int		flags;		/* W: WQ_* flags */
 	union {
-		struct cpu_workqueue_struct __percpu	*pcpu;
-		struct cpu_workqueue_struct		*single;
-		unsigned long				v;
-	} cpu_wq;				/* I: cwq's */
+		struct cpu_workqueue_struct __percpu	*pcpu;	/* I */
+		struct cpu_workqueue_struct		**node;	/* PW */
+	} cpu_wq;				/* cwq's */
+	struct list_head	cwqs;		/* PF: all cwqs of this wq */
 	struct list_head	list;		/* W: list of all workqueues */
 
 	struct mutex		flush_mutex;	/* protects wq flushing */
@@ -237,11 +240,16 @@ struct workqueue_struct {
 	struct list_head	flusher_queue;	/* F: flush waiters */
 	struct list_head	flusher_overflow; /* F: flush overflow list */
 
-	mayday_mask_t		mayday_mask;	/* cpus requesting rescue */
+	struct list_head	maydays;	/* M: cwqs requesting rescue */
 	struct worker		*rescuer;	/* I: rescue worker */
 
 	int			nr_drainers;	/* W: drain in progress */
 	int			saved_max_active; /* W: saved cwq max_active */
+
+	struct workqueue_attrs	*unbound_attrs;	/* PW: only for unbound wqs */
+#ifdef CONFIG_SYSFS
+	struct wq_device	*wq_dev;	/* I: for sysfs interface */
+#endif
 #ifdef CONFIG_LOCKDEP
 	struct lockdep_map	lockdep_map;
 #endif
@@ -268,54 +276,23 @@ EXPORT_SYMBOL_GPL(system_nrt_freezable_wq);
 	for (i = 0; i < BUSY_WORKER_HASH_SIZE; i++)			\
 		hlist_for_each_entry(worker, pos, &gcwq->busy_hash[i], hentry)
 
-static inline int __next_gcwq_cpu(int cpu, const struct cpumask *mask,
-				  unsigned int sw)
-{
-	if (cpu < nr_cpu_ids) {
-		if (sw & 1) {
-			cpu = cpumask_next(cpu, mask);
-			if (cpu < nr_cpu_ids)
-				return cpu;
-		}
-		if (sw & 2)
-			return WORK_CPU_UNBOUND;
-	}
-	return WORK_CPU_NONE;
-}
-
-static inline int __next_wq_cpu(int cpu, const struct cpumask *mask,
-				struct workqueue_struct *wq)
-{
-	return __next_gcwq_cpu(cpu, mask, !(wq->flags & WQ_UNBOUND) ? 1 : 2);
-}
-
 /*
- * CPU iterators
+ * gcwq and cwq iterators
  *
- * An extra gcwq is defined for an invalid cpu number
- * (WORK_CPU_UNBOUND) to host workqueues which are not bound to any
- * specific CPU.  The following iterators are similar to
- * for_each_*_cpu() iterators but also considers the unbound gcwq.
+ * Per-cpu gcwqs are walked with the for_each_*_cpu() iterators.
+ * Unbound gcwqs are created on demand and live on unbound_gcwqs.
+ * Neither unbound gcwqs nor the cwqs of a live workqueue are ever
+ * removed, so the following can be used without holding the locks
+ * which protect additions.
  *
- * for_each_gcwq_cpu()		: possible CPUs + WORK_CPU_UNBOUND
- * for_each_online_gcwq_cpu()	: online CPUs + WORK_CPU_UNBOUND
- * for_each_cwq_cpu()		: possible CPUs for bound workqueues,
- *				  WORK_CPU_UNBOUND for unbound workqueues
+ * for_each_unbound_gcwq()	: all unbound gcwqs
+ * for_each_cwq()		: all cwqs of a workqueue
  */
-#define for_each_gcwq_cpu(cpu)						\
-	for ((cpu) = __next_gcwq_cpu(-1, cpu_possible_mask, 3);		\
-	     (cpu) < WORK_CPU_NONE;					\
-	     (cpu) = __next_gcwq_cpu((cpu), cpu_possible_mask, 3))
+#define for_each_unbound_gcwq(gcwq)					\
+	list_for_each_entry_rcu((gcwq), &unbound_gcwqs, unbound_node)
 
-#define for_each_online_gcwq_cpu(cpu)					\
-	for ((cpu) = __next_gcwq_cpu(-1, cpu_online_mask, 3);		\
-	     (cpu) < WORK_CPU_NONE;					\
-	     (cpu) = __next_gcwq_cpu((cpu), cpu_online_mask, 3))
-
-#define for_each_cwq_cpu(cpu, wq)					\
-	for ((cpu) = __next_wq_cpu(-1, cpu_possible_mask, (wq));	\
-	     (cpu) < WORK_CPU_NONE;					\
-	     (cpu) = __next_wq_cpu((cpu), cpu_possible_mask, (wq)))
+#define for_each_cwq(cwq, wq)						\
+	list_for_each_entry_rcu((cwq), &(wq)->cwqs, cwqs_node)
 
 #ifdef CONFIG_DEBUG_OBJECTS_WORK
 
@@ -438,6 +415,20 @@ static DEFINE_SPINLOCK(workqueue_lock);
 static LIST_HEAD(workqueues);
 static bool workqueue_freezing;		/* W: have wqs started freezing? */
 
+/* Serializes creation of unbound gcwqs and changes to wq attributes. */
+static DEFINE_MUTEX(wq_pool_mutex);
+static LIST_HEAD(unbound_gcwqs);	/* PW: all unbound gcwqs */
+static DEFINE_IDR(unbound_gcwq_idr);	/* PW: unbound gcwq ID allocator */
+
+/* protects wq->maydays and cwq->mayday_node, nests inside gcwq->lock */
+static DEFINE_SPINLOCK(wq_mayday_lock);
+
+static struct kmem_cache *cwq_cache;	/* for unbound cwqs */
+
+/* possible CPUs of each node, valid only if wq_numa_enabled */
+static cpumask_var_t *wq_numa_possible_cpumask;
+static bool wq_numa_enabled;		/* unbound NUMA affinity enabled */
+
 /*
  * The almighty global cpu workqueues.  nr_running is the only field
  * which is expected to be used frequently by other cpus via
@@ -447,21 +438,17 @@ static DEFINE_PER_CPU(struct global_cwq, global_cwq);
 static DEFINE_PER_CPU_SHARED_ALIGNED(atomic_t, gcwq_nr_running);
 
 /*
- * Global cpu workqueue and nr_running counter for unbound gcwq.  The
- * gcwq is always online, has GCWQ_DISASSOCIATED set, and all its
- * workers have WORKER_UNBOUND set.
+ * nr_running counter shared by the unbound gcwqs.  Unbound gcwqs are
+ * always online, have GCWQ_DISASSOCIATED set, and all their workers
+ * have WORKER_UNBOUND set.
  */
-static struct global_cwq unbound_global_cwq;
 static atomic_t unbound_gcwq_nr_running = ATOMIC_INIT(0);	/* always 0 */
 
 static int worker_thread(void *__worker);
 
 static struct global_cwq *get_gcwq(unsigned int cpu)
 {
-	if (cpu != WORK_CPU_UNBOUND)
-		return &per_cpu(global_cwq, cpu);
-	else
-		return &unbound_global_cwq;
+	return &per_cpu(global_cwq, cpu);
 }
 
 static atomic_t *get_gcwq_nr_running(unsigned int cpu)
@@ -472,14 +459,37 @@ static atomic_t *get_gcwq_nr_running(unsigned int cpu)
 		return &unbound_gcwq_nr_running;
 }
 
+/**
+ * unbound_cwq_by_node - return the unbound cwq serving @node
+ * @wq: the target unbound workqueue
+ * @node: the node ID
+ *
+ * The node table is updated by apply_workqueue_attrs() but the cwqs it
+ * points to stay around until @wq is destroyed, so a stale pointer is
+ * still valid to queue on.
+ */
+static struct cpu_workqueue_struct *
+unbound_cwq_by_node(struct workqueue_struct *wq, int node)
+{
+	if (!wq_numa_enabled)
+		node = 0;
+	return rcu_dereference_raw(wq->cpu_wq.node[node]);
+}
+
+/*
+ * Return the cwq which serves @cpu.  For unbound workqueues, this is
+ * the cwq of @cpu's node, or of the local node for WORK_CPU_UNBOUND.
+ */
 static struct cpu_workqueue_struct *get_cwq(unsigned int cpu,
 					    struct workqueue_struct *wq)
 {
 	if (!(wq->flags & WQ_UNBOUND)) {
 		if (likely(cpu < nr_cpu_ids))
 			return per_cpu_ptr(wq->cpu_wq.pcpu, cpu);
-	} else if (likely(cpu == WORK_CPU_UNBOUND))
-		return wq->cpu_wq.single;
+	} else if (cpu == WORK_CPU_UNBOUND)
+		return unbound_cwq_by_node(wq, numa_node_id());
+	else if (likely(cpu < nr_cpu_ids))
+		return unbound_cwq_by_node(wq, cpu_to_node(cpu));
 	return NULL;
 }
 
@@ -502,11 +512,12 @@ static int work_next_color(int color)
 /*
  * A work's data points to the cwq with WORK_STRUCT_CWQ set while the
  * work is on queue.  Once execution starts, WORK_STRUCT_CWQ is
- * cleared and the work data contains the cpu number it was last on.
+ * cleared and the work data contains the ID of the gcwq it was last
+ * on, which is the cpu number for per-cpu gcwqs.
  *
- * set_work_{cwq|cpu}() and clear_work_data() can be used to set the
- * cwq, cpu or clear work->data.  These functions should only be
- * called while the work is owned - ie. while the PENDING bit is set.
+ * set_work_{cwq|gcwq_id}() and clear_work_data() can be used to set
+ * the cwq, gcwq ID or clear work->data.  These functions should only
+ * be called while the work is owned - ie. while the PENDING bit is set.
  *
  * get_work_[g]cwq() can be used to obtain the gcwq or cwq
  * corresponding to a work.  gcwq is available once the work has been
@@ -528,9 +539,10 @@ static void set_work_cwq(struct work_struct *work,
 		      WORK_STRUCT_PENDING | WORK_STRUCT_CWQ | extra_flags);
 }
 
-static void set_work_cpu(struct work_struct *work, unsigned int cpu)
+static void set_work_gcwq_id(struct work_struct *work, unsigned int id)
 {
-	set_work_data(work, cpu << WORK_STRUCT_FLAG_BITS, WORK_STRUCT_PENDING);
+	set_work_data(work, (unsigned long)id << WORK_STRUCT_FLAG_BITS,
+		      WORK_STRUCT_PENDING);
 }
 
 static void clear_work_data(struct work_struct *work)
@@ -551,18 +563,23 @@ static struct cpu_workqueue_struct *get_work_cwq(struct work_struct *work)
 static struct global_cwq *get_work_gcwq(struct work_struct *work)
 {
 	unsigned long data = atomic_long_read(&work->data);
-	unsigned int cpu;
+	unsigned int id;
 
 	if (data & WORK_STRUCT_CWQ)
 		return ((struct cpu_workqueue_struct *)
 			(data & WORK_STRUCT_WQ_DATA_MASK))->gcwq;
 
-	cpu = data >> WORK_STRUCT_FLAG_BITS;
-	if (cpu == WORK_CPU_NONE)
+	id = data >> WORK_STRUCT_FLAG_BITS;
+	if (id == WORK_CPU_NONE)
 		return NULL;
 
-	BUG_ON(cpu >= nr_cpu_ids && cpu != WORK_CPU_UNBOUND);
-	return get_gcwq(cpu);
+	if (id < UNBOUND_GCWQ_ID_BASE) {
+		BUG_ON(id >= nr_cpu_ids);
+		return get_gcwq(id);
+	}
+
+	/* unbound gcwqs are never destroyed, lockless lookup is fine */
+	return idr_find(&unbound_gcwq_idr, id);
 }
 
 /*
@@ -944,6 +961,28 @@ static void insert_work(struct cpu_workqueue_struct *cwq,
 		wake_up_worker(gcwq);
 }
 
+/*
+ * Find the busy worker of @gcwq which is %current.  Returns %NULL if
+ * %current isn't executing a work on @gcwq.
+ */
+static struct worker *find_current_busy_worker(struct global_cwq *gcwq)
+{
+	struct worker *worker, *ret = NULL;
+	struct hlist_node *pos;
+	unsigned long flags;
+	int i;
+
+	spin_lock_irqsave(&gcwq->lock, flags);
+	for_each_busy_worker(worker, i, pos, gcwq) {
+		if (worker->task == current) {
+			ret = worker;
+			break;
+		}
+	}
+	spin_unlock_irqrestore(&gcwq->lock, flags);
+	return ret;
+}
+
 /*
  * Test whether @work is being queued from another work executing on the
  * same workqueue.  This is rather expensive and should only be used from
@@ -951,35 +990,33 @@ static void insert_work(struct cpu_workqueue_struct *cwq,
  */
 static bool is_chained_work(struct workqueue_struct *wq)
 {
-	unsigned long flags;
+	struct global_cwq *gcwq;
+	struct worker *worker = NULL;
 	unsigned int cpu;
 
-	for_each_gcwq_cpu(cpu) {
-		struct global_cwq *gcwq = get_gcwq(cpu);
-		struct worker *worker;
-		struct hlist_node *pos;
-		int i;
-
-		spin_lock_irqsave(&gcwq->lock, flags);
-		for_each_busy_worker(worker, i, pos, gcwq) {
-			if (worker->task != current)
-				continue;
-			spin_unlock_irqrestore(&gcwq->lock, flags);
-			/*
-			 * I'm @worker, no locking necessary.  See if @work
-			 * is headed to the same workqueue.
-			 */
-			return worker->current_cwq->wq == wq;
-		}
-		spin_unlock_irqrestore(&gcwq->lock, flags);
+	for_each_possible_cpu(cpu) {
+		worker = find_current_busy_worker(get_gcwq(cpu));
+		if (worker)
+			goto found;
+	}
+	for_each_unbound_gcwq(gcwq) {
+		worker = find_current_busy_worker(gcwq);
+		if (worker)
+			goto found;
 	}
 	return false;
+found:
+	/*
+	 * I'm @worker, no locking necessary.  See if @work is headed to
+	 * the same workqueue.
+	 */
+	return worker->current_cwq->wq == wq;
 }
 
 static void __queue_work(unsigned int cpu, struct workqueue_struct *wq,
 			 struct work_struct *work)
 {
-	struct global_cwq *gcwq;
+	struct global_cwq *gcwq, *last_gcwq;
 	struct cpu_workqueue_struct *cwq;
 	struct list_head *worklist;
 	unsigned int work_flags;
@@ -992,44 +1029,43 @@ static void __queue_work(unsigned int cpu, struct workqueue_struct *wq,
 	    WARN_ON_ONCE(!is_chained_work(wq)))
 		return;
 
-	/* determine gcwq to use */
-	if (!(wq->flags & WQ_UNBOUND)) {
-		struct global_cwq *last_gcwq;
+	if (unlikely(cpu == WORK_CPU_UNBOUND))
+		cpu = raw_smp_processor_id();
 
-		if (unlikely(cpu == WORK_CPU_UNBOUND))
-			cpu = raw_smp_processor_id();
+	/*
+	 * Determine cwq to use.  Bound workqueues use the cwq of @cpu,
+	 * unbound ones the cwq of @cpu's node.
+	 */
+	cwq = get_cwq(cpu, wq);
+	gcwq = cwq->gcwq;
 
-		/*
-		 * It's multi cpu.  If @wq is non-reentrant and @work
-		 * was previously on a different cpu, it might still
-		 * be running there, in which case the work needs to
-		 * be queued on that cpu to guarantee non-reentrance.
-		 */
-		gcwq = get_gcwq(cpu);
-		if (wq->flags & WQ_NON_REENTRANT &&
-		    (last_gcwq = get_work_gcwq(work)) && last_gcwq != gcwq) {
-			struct worker *worker;
+	/*
+	 * If @wq is non-reentrant and @work was previously on a
+	 * different gcwq, it might still be running there, in which case
+	 * the work needs to be queued on that gcwq to guarantee
+	 * non-reentrance.  Unbound workqueues have a gcwq per node and
+	 * are always non-reentrant.
+	 */
+	if (wq->flags & (WQ_NON_REENTRANT | WQ_UNBOUND) &&
+	    (last_gcwq = get_work_gcwq(work)) && last_gcwq != gcwq) {
+		struct worker *worker;
 
-			spin_lock_irqsave(&last_gcwq->lock, flags);
+		spin_lock_irqsave(&last_gcwq->lock, flags);
 
-			worker = find_worker_executing_work(last_gcwq, work);
+		worker = find_worker_executing_work(last_gcwq, work);
 
-			if (worker && worker->current_cwq->wq == wq)
-				gcwq = last_gcwq;
-			else {
-				/* meh... not running there, queue here */
-				spin_unlock_irqrestore(&last_gcwq->lock, flags);
-				spin_lock_irqsave(&gcwq->lock, flags);
-			}
-		} else
+		if (worker && worker->current_cwq->wq == wq) {
+			cwq = worker->current_cwq;
+			gcwq = last_gcwq;
+		} else {
+			/* meh... not running there, queue here */
+			spin_unlock_irqrestore(&last_gcwq->lock, flags);
 			spin_lock_irqsave(&gcwq->lock, flags);
-	} else {
-		gcwq = get_gcwq(WORK_CPU_UNBOUND);
+		}
+	} else
 		spin_lock_irqsave(&gcwq->lock, flags);
-	}
 
-	/* gcwq determined, get cwq and queue */
-	cwq = get_cwq(gcwq->cpu, wq);
+	/* cwq determined, queue */
 	trace_workqueue_queue_work(cpu, cwq, work);
 
 	BUG_ON(!list_empty(&work->entry));
@@ -1371,15 +1407,27 @@ static struct worker *create_worker(struct global_cwq *gcwq, bool bind)
 
 	if (!on_unbound_cpu)
 		worker->task = kthread_create_on_node(worker_thread,
-						      worker,
-						      cpu_to_node(gcwq->cpu),
+						      worker, gcwq->node,
 						      "kworker/%u:%d", gcwq->cpu, id);
 	else
-		worker->task = kthread_create(worker_thread, worker,
-					      "kworker/u:%d", id);
+		worker->task = kthread_create_on_node(worker_thread,
+						      worker, gcwq->node,
+						      "kworker/u%d:%d",
+						      gcwq->id - UNBOUND_GCWQ_ID_BASE,
+						      id);
 	if (IS_ERR(worker->task))
 		goto fail;
 
+	/*
+	 * Unbound workers take the attributes of their gcwq.  This has
+	 * to happen before PF_THREAD_BOUND is set below.  If none of the
+	 * allowed CPUs is online, the worker stays free to run anywhere.
+	 */
+	if (on_unbound_cpu) {
+		set_user_nice(worker->task, gcwq->attrs->nice);
+		set_cpus_allowed_ptr(worker->task, gcwq->attrs->cpumask);
+	}
+
 	/*
 	 * A rogue worker will become a regular one if CPU comes
 	 * online later on.  Make sure every worker has
@@ -1486,18 +1534,17 @@ static bool send_mayday(struct work_struct *work)
 {
 	struct cpu_workqueue_struct *cwq = get_work_cwq(work);
 	struct workqueue_struct *wq = cwq->wq;
-	unsigned int cpu;
 
 	if (!(wq->flags & WQ_RESCUER))
 		return false;
 
 	/* mayday mayday mayday */
-	cpu = cwq->gcwq->cpu;
-	/* WORK_CPU_UNBOUND can't be set in cpumask, use cpu 0 instead */
-	if (cpu == WORK_CPU_UNBOUND)
-		cpu = 0;
-	if (!mayday_test_and_set_cpu(cpu, wq->mayday_mask))
+	spin_lock(&wq_mayday_lock);
+	if (list_empty(&cwq->mayday_node)) {
+		list_add_tail(&cwq->mayday_node, &wq->maydays);
 		wake_up_process(wq->rescuer->task);
+	}
+	spin_unlock(&wq_mayday_lock);
 	return true;
 }
 
@@ -1831,8 +1878,8 @@ __acquires(&gcwq->lock)
 	worker->current_cwq = cwq;
 	work_color = get_work_color(work);
 
-	/* record the current cpu number in the work data and dequeue */
-	set_work_cpu(work, gcwq->cpu);
+	/* record the current gcwq ID in the work data and dequeue */
+	set_work_gcwq_id(work, gcwq->id);
 	list_del_init(&work->entry);
 
 	/*
@@ -1921,10 +1968,10 @@ static void process_scheduled_works(struct worker *worker)
  * @__worker: self
  *
  * The gcwq worker thread function.  There's a single dynamic pool of
- * these per each cpu.  These workers process all works regardless of
- * their specific target workqueue.  The only exception is works which
- * belong to workqueues with a rescuer which will be explained in
- * rescuer_thread().
+ * these per each cpu and per each unbound gcwq.  These workers
+ * process all works regardless of their specific target workqueue.
+ * The only exception is works which belong to workqueues with a
+ * rescuer which will be explained in rescuer_thread().
  */
 static int worker_thread(void *__worker)
 {
@@ -2026,8 +2073,6 @@ static int rescuer_thread(void *__wq)
 	struct workqueue_struct *wq = __wq;
 	struct worker *rescuer = wq->rescuer;
 	struct list_head *scheduled = &rescuer->scheduled;
-	bool is_unbound = wq->flags & WQ_UNBOUND;
-	unsigned int cpu;
 
 	set_user_nice(current, RESCUER_NICE_LEVEL);
 repeat:
@@ -2036,18 +2081,19 @@ repeat:
 	if (kthread_should_stop())
 		return 0;
 
-	/*
-	 * See whether any cpu is asking for help.  Unbounded
-	 * workqueues use cpu 0 in mayday_mask for CPU_UNBOUND.
-	 */
-	for_each_mayday_cpu(cpu, wq->mayday_mask) {
-		unsigned int tcpu = is_unbound ? WORK_CPU_UNBOUND : cpu;
-		struct cpu_workqueue_struct *cwq = get_cwq(tcpu, wq);
+	/* see whether any cwq is asking for help */
+	spin_lock_irq(&wq_mayday_lock);
+
+	while (!list_empty(&wq->maydays)) {
+		struct cpu_workqueue_struct *cwq = list_first_entry(&wq->maydays,
+					struct cpu_workqueue_struct, mayday_node);
 		struct global_cwq *gcwq = cwq->gcwq;
 		struct work_struct *work, *n;
 
 		__set_current_state(TASK_RUNNING);
-		mayday_clear_cpu(cpu, wq->mayday_mask);
+		list_del_init(&cwq->mayday_node);
+
+		spin_unlock_irq(&wq_mayday_lock);
 
 		/* migrate to the target cpu if possible */
 		rescuer->gcwq = gcwq;
@@ -2073,8 +2119,11 @@ repeat:
 			wake_up_worker(gcwq);
 
 		spin_unlock_irq(&gcwq->lock);
+		spin_lock_irq(&wq_mayday_lock);
 	}
 
+	spin_unlock_irq(&wq_mayday_lock);
+
 	schedule();
 	goto repeat;
 }
@@ -2185,16 +2234,15 @@ static void insert_wq_barrier(struct cpu_workqueue_struct *cwq,
 static bool flush_workqueue_prep_cwqs(struct workqueue_struct *wq,
 				      int flush_color, int work_color)
 {
+	struct cpu_workqueue_struct *cwq;
 	bool wait = false;
-	unsigned int cpu;
 
 	if (flush_color >= 0) {
 		BUG_ON(atomic_read(&wq->nr_cwqs_to_flush));
 		atomic_set(&wq->nr_cwqs_to_flush, 1);
 	}
 
-	for_each_cwq_cpu(cpu, wq) {
-		struct cpu_workqueue_struct *cwq = get_cwq(cpu, wq);
+	for_each_cwq(cwq, wq) {
 		struct global_cwq *gcwq = cwq->gcwq;
 
 		spin_lock_irq(&gcwq->lock);
@@ -2392,8 +2440,8 @@ EXPORT_SYMBOL_GPL(flush_workqueue);
  */
 void drain_workqueue(struct workqueue_struct *wq)
 {
+	struct cpu_workqueue_struct *cwq;
 	unsigned int flush_cnt = 0;
-	unsigned int cpu;
 
 	/*
 	 * __queue_work() needs to test whether there are drainers, is much
@@ -2407,8 +2455,7 @@ void drain_workqueue(struct workqueue_struct *wq)
 reflush:
 	flush_workqueue(wq);
 
-	for_each_cwq_cpu(cpu, wq) {
-		struct cpu_workqueue_struct *cwq = get_cwq(cpu, wq);
+	for_each_cwq(cwq, wq) {
 		bool drained;
 
 		spin_lock_irq(&cwq->gcwq->lock);
@@ -2538,6 +2585,7 @@ static bool wait_on_cpu_work(struct global_cwq *gcwq, struct work_struct *work)
 
 static bool wait_on_work(struct work_struct *work)
 {
+	struct global_cwq *gcwq;
 	bool ret = false;
 	int cpu;
 
@@ -2546,8 +2594,10 @@ static bool wait_on_work(struct work_struct *work)
 	lock_map_acquire(&work->lockdep_map);
 	lock_map_release(&work->lockdep_map);
 
-	for_each_gcwq_cpu(cpu)
+	for_each_possible_cpu(cpu)
 		ret |= wait_on_cpu_work(get_gcwq(cpu), work);
+	for_each_unbound_gcwq(gcwq)
+		ret |= wait_on_cpu_work(gcwq, work);
 	return ret;
 }
 
@@ -2884,47 +2934,369 @@ int keventd_up(void)
 	return system_wq != NULL;
 }
 
-static int alloc_cwqs(struct workqueue_struct *wq)
+/**
+ * free_workqueue_attrs - free a workqueue_attrs
+ * @attrs: workqueue_attrs to free
+ *
+ * Undo alloc_workqueue_attrs().
+ */
+void free_workqueue_attrs(struct workqueue_attrs *attrs)
+{
+	if (attrs) {
+		free_cpumask_var(attrs->cpumask);
+		kfree(attrs);
+	}
+}
+EXPORT_SYMBOL_GPL(free_workqueue_attrs);
+
+/**
+ * alloc_workqueue_attrs - allocate a workqueue_attrs
+ * @gfp_mask: allocation mask to use
+ *
+ * Allocate a new workqueue_attrs and initialize it with the default
+ * settings, nice 0 and all possible CPUs allowed.
+ *
+ * RETURNS:
+ * Pointer to the new workqueue_attrs on success, %NULL on failure.
+ */
+struct workqueue_attrs *alloc_workqueue_attrs(gfp_t gfp_mask)
+{
+	struct workqueue_attrs *attrs;
+
+	attrs = kzalloc(sizeof(*attrs), gfp_mask);
+	if (!attrs)
+		goto fail;
+	if (!alloc_cpumask_var(&attrs->cpumask, gfp_mask))
+		goto fail;
+
+	cpumask_copy(attrs->cpumask, cpu_possible_mask);
+	return attrs;
+fail:
+	free_workqueue_attrs(attrs);
+	return NULL;
+}
+EXPORT_SYMBOL_GPL(alloc_workqueue_attrs);
+
+static void copy_workqueue_attrs(struct workqueue_attrs *to,
+				 const struct workqueue_attrs *from)
+{
+	to->nice = from->nice;
+	cpumask_copy(to->cpumask, from->cpumask);
+}
+
+static bool wqattrs_equal(const struct workqueue_attrs *a,
+			  const struct workqueue_attrs *b)
+{
+	return a->nice == b->nice && cpumask_equal(a->cpumask, b->cpumask);
+}
+
+static void init_gcwq(struct global_cwq *gcwq)
 {
+	int i;
+
+	spin_lock_init(&gcwq->lock);
+	INIT_LIST_HEAD(&gcwq->worklist);
+	gcwq->flags |= GCWQ_DISASSOCIATED;
+
+	INIT_LIST_HEAD(&gcwq->idle_list);
+	for (i = 0; i < BUSY_WORKER_HASH_SIZE; i++)
+		INIT_HLIST_HEAD(&gcwq->busy_hash[i]);
+
+	init_timer_deferrable(&gcwq->idle_timer);
+	gcwq->idle_timer.function = idle_worker_timeout;
+	gcwq->idle_timer.data = (unsigned long)gcwq;
+
+	setup_timer(&gcwq->mayday_timer, gcwq_mayday_timeout,
+		    (unsigned long)gcwq);
+
+	ida_init(&gcwq->worker_ida);
+
+	gcwq->trustee_state = TRUSTEE_DONE;
+	init_waitqueue_head(&gcwq->trustee_wait);
+}
+
+/**
+ * get_unbound_gcwq - get an unbound gcwq with the specified attributes
+ * @attrs: the attributes of the gcwq to get
+ *
+ * Find the unbound gcwq whose attributes match @attrs or create a new
+ * one along with its first worker.  Unbound gcwqs are shared by all
+ * workqueues with identical attributes.  They are never destroyed;
+ * idle workers are reaped as usual, so an unused gcwq costs little.
+ *
+ * CONTEXT:
+ * mutex_lock(wq_pool_mutex).  Does GFP_KERNEL allocations.
+ *
+ * RETURNS:
+ * Pointer to the gcwq on success, %NULL on failure.
+ */
+static struct global_cwq *get_unbound_gcwq(const struct workqueue_attrs *attrs)
+{
+	struct global_cwq *gcwq;
+	struct worker *worker;
+	int node, ret;
+
+	lockdep_assert_held(&wq_pool_mutex);
+
+	for_each_unbound_gcwq(gcwq)
+		if (wqattrs_equal(gcwq->attrs, attrs))
+			return gcwq;
+
+	gcwq = kzalloc(sizeof(*gcwq), GFP_KERNEL);
+	if (!gcwq)
+		return NULL;
+
+	init_gcwq(gcwq);
+	gcwq->cpu = WORK_CPU_UNBOUND;
+
+	gcwq->attrs = alloc_workqueue_attrs(GFP_KERNEL);
+	if (!gcwq->attrs)
+		goto fail;
+	copy_workqueue_attrs(gcwq->attrs, attrs);
+
+	/* if the cpumask is contained inside a node, we belong to it */
+	gcwq->node = -1;
+	if (wq_numa_enabled) {
+		for (node = 0; node < nr_node_ids; node++) {
+			if (cpumask_subset(attrs->cpumask,
+					   wq_numa_possible_cpumask[node])) {
+				gcwq->node = node;
+				break;
+			}
+		}
+	}
+
+	do {
+		if (!idr_pre_get(&unbound_gcwq_idr, GFP_KERNEL))
+			goto fail;
+		ret = idr_get_new_above(&unbound_gcwq_idr, gcwq,
+					UNBOUND_GCWQ_ID_BASE, &gcwq->id);
+	} while (ret == -EAGAIN);
+	if (ret)
+		goto fail;
+
+	worker = create_worker(gcwq, true);
+	if (!worker)
+		goto fail_remove_id;
+
+	spin_lock_irq(&gcwq->lock);
+	start_worker(worker);
+	spin_unlock_irq(&gcwq->lock);
+
+	list_add_tail_rcu(&gcwq->unbound_node, &unbound_gcwqs);
+	return gcwq;
+
+fail_remove_id:
+	idr_remove(&unbound_gcwq_idr, gcwq->id);
+fail:
+	ida_destroy(&gcwq->worker_ida);
+	free_workqueue_attrs(gcwq->attrs);
+	kfree(gcwq);
+	return NULL;
+}
+
+/* initialize @cwq which links @wq to @gcwq */
+static void init_cwq(struct cpu_workqueue_struct *cwq,
+		     struct workqueue_struct *wq, struct global_cwq *gcwq)
+{
+	BUG_ON((unsigned long)cwq & WORK_STRUCT_FLAG_MASK);
+
+	cwq->gcwq = gcwq;
+	cwq->wq = wq;
+	cwq->flush_color = -1;
+	INIT_LIST_HEAD(&cwq->delayed_works);
+	INIT_LIST_HEAD(&cwq->mayday_node);
+}
+
+/* make @cwq visible to flushers, the freezer and max_active updates */
+static void link_cwq(struct cpu_workqueue_struct *cwq)
+{
+	struct workqueue_struct *wq = cwq->wq;
+
+	mutex_lock(&wq->flush_mutex);
+
+	/* start at the current color so that ongoing flushes stay intact */
+	cwq->work_color = wq->work_color;
+
+	spin_lock(&workqueue_lock);
+	if (workqueue_freezing && wq->flags & WQ_FREEZABLE)
+		cwq->max_active = 0;
+	else
+		cwq->max_active = wq->saved_max_active;
+	list_add_tail_rcu(&cwq->cwqs_node, &wq->cwqs);
+	spin_unlock(&workqueue_lock);
+
+	mutex_unlock(&wq->flush_mutex);
+}
+
+/**
+ * get_unbound_cwq - get the cwq linking @wq to an unbound gcwq
+ * @wq: the target unbound workqueue
+ * @attrs: the attributes of the gcwq
+ *
+ * Return the cwq of @wq for the unbound gcwq matching @attrs, creating
+ * the gcwq and the cwq as necessary.  Retired cwqs stay on @wq->cwqs
+ * until @wq is destroyed and are reused if @wq goes back to their gcwq.
+ *
+ * CONTEXT:
+ * mutex_lock(wq_pool_mutex).  Does GFP_KERNEL allocations.
+ *
+ * RETURNS:
+ * Pointer to the cwq on success, %NULL on failure.
+ */
+static struct cpu_workqueue_struct *
+get_unbound_cwq(struct workqueue_struct *wq,
+		const struct workqueue_attrs *attrs)
+{
+	struct cpu_workqueue_struct *cwq;
+	struct global_cwq *gcwq;
+
+	gcwq = get_unbound_gcwq(attrs);
+	if (!gcwq)
+		return NULL;
+
+	for_each_cwq(cwq, wq)
+		if (cwq->gcwq == gcwq)
+			return cwq;
+
+	cwq = kmem_cache_zalloc(cwq_cache, GFP_KERNEL);
+	if (!cwq)
+		return NULL;
+
+	init_cwq(cwq, wq, gcwq);
+	link_cwq(cwq);
+	return cwq;
+}
+
+/**
+ * apply_workqueue_attrs - apply new workqueue_attrs to an unbound workqueue
+ * @wq: the target workqueue
+ * @attrs: the workqueue_attrs to apply, allocated with alloc_workqueue_attrs()
+ *
+ * Apply @attrs to an unbound workqueue @wq.  Unless @wq is ordered,
+ * each NUMA node whose CPUs intersect @attrs->cpumask gets its own
+ * cwq on a gcwq restricted to those CPUs, and work items are executed
+ * on the node they were queued from.  Work items queued before the
+ * change finish on their old gcwqs.
+ *
+ * RETURNS:
+ * 0 on success and -errno on failure.
+ */
+int apply_workqueue_attrs(struct workqueue_struct *wq,
+			  const struct workqueue_attrs *attrs)
+{
+	struct workqueue_attrs *new_attrs, *tmp_attrs;
+	struct cpu_workqueue_struct *dfl_cwq, **tbl;
+	int node, ret;
+
+	/* only unbound workqueues can change attributes */
+	if (WARN_ON(!(wq->flags & WQ_UNBOUND)))
+		return -EINVAL;
+
+	new_attrs = alloc_workqueue_attrs(GFP_KERNEL);
+	tmp_attrs = alloc_workqueue_attrs(GFP_KERNEL);
+	tbl = kcalloc(nr_node_ids, sizeof(tbl[0]), GFP_KERNEL);
+	ret = -ENOMEM;
+	if (!new_attrs || !tmp_attrs || !tbl)
+		goto out_free;
+
+	/* make a copy of @attrs and sanitize it */
+	copy_workqueue_attrs(new_attrs, attrs);
+	cpumask_and(new_attrs->cpumask, new_attrs->cpumask, cpu_possible_mask);
+	ret = -EINVAL;
+	if (cpumask_empty(new_attrs->cpumask))
+		goto out_free;
+
+	mutex_lock(&wq_pool_mutex);
+
+	ret = -ENOMEM;
+	dfl_cwq = get_unbound_cwq(wq, new_attrs);
+	if (!dfl_cwq)
+		goto out_unlock;
+
 	/*
-	 * cwqs are forced aligned according to WORK_STRUCT_FLAG_BITS.
-	 * Make sure that the alignment isn't lower than that of
-	 * unsigned long long.
+	 * Ordered workqueues must stick to a single cwq.  Others get a
+	 * cwq per node, nodes outside @attrs->cpumask use the default one.
 	 */
-	const size_t size = sizeof(struct cpu_workqueue_struct);
-	const size_t align = max_t(size_t, 1 << WORK_STRUCT_FLAG_BITS,
-				   __alignof__(unsigned long long));
+	for (node = 0; node < nr_node_ids; node++) {
+		tbl[node] = dfl_cwq;
+		if (!wq_numa_enabled || wq->flags & WQ_ORDERED)
+			continue;
 
-	if (!(wq->flags & WQ_UNBOUND))
-		wq->cpu_wq.pcpu = __alloc_percpu(size, align);
-	else {
-		void *ptr;
+		copy_workqueue_attrs(tmp_attrs, new_attrs);
+		cpumask_and(tmp_attrs->cpumask, tmp_attrs->cpumask,
+			    wq_numa_possible_cpumask[node]);
+		if (cpumask_empty(tmp_attrs->cpumask))
+			continue;
 
-		/*
-		 * Allocate enough room to align cwq and put an extra
-		 * pointer at the end pointing back to the originally
-		 * allocated pointer which will be used for free.
-		 */
-		ptr = kzalloc(size + align + sizeof(void *), GFP_KERNEL);
-		if (ptr) {
-			wq->cpu_wq.single = PTR_ALIGN(ptr, align);
-			*(void **)(wq->cpu_wq.single + 1) = ptr;
+		tbl[node] = get_unbound_cwq(wq, tmp_attrs);
+		if (!tbl[node])
+			goto out_unlock;
+	}
+
+	/* all cwqs are ready, switch over */
+	for (node = 0; node < nr_node_ids; node++)
+		rcu_assign_pointer(wq->cpu_wq.node[node], tbl[node]);
+	copy_workqueue_attrs(wq->unbound_attrs, new_attrs);
+	ret = 0;
+
+out_unlock:
+	mutex_unlock(&wq_pool_mutex);
+out_free:
+	kfree(tbl);
+	free_workqueue_attrs(tmp_attrs);
+	free_workqueue_attrs(new_attrs);
+	return ret;
+}
+EXPORT_SYMBOL_GPL(apply_workqueue_attrs);
+
+static int alloc_cwqs(struct workqueue_struct *wq)
+{
+	struct workqueue_attrs *attrs;
+	unsigned int cpu;
+	int ret;
+
+	if (!(wq->flags & WQ_UNBOUND)) {
+		wq->cpu_wq.pcpu = alloc_percpu(struct cpu_workqueue_struct);
+		if (!wq->cpu_wq.pcpu)
+			return -ENOMEM;
+
+		for_each_possible_cpu(cpu) {
+			struct cpu_workqueue_struct *cwq = get_cwq(cpu, wq);
+
+			init_cwq(cwq, wq, get_gcwq(cpu));
+			link_cwq(cwq);
 		}
+		return 0;
 	}
 
-	/* just in case, make sure it's actually aligned */
-	BUG_ON(!IS_ALIGNED(wq->cpu_wq.v, align));
-	return wq->cpu_wq.v ? 0 : -ENOMEM;
+	/* unbound workqueues start with the default attributes */
+	wq->cpu_wq.node = kcalloc(nr_node_ids, sizeof(wq->cpu_wq.node[0]),
+				  GFP_KERNEL);
+	wq->unbound_attrs = alloc_workqueue_attrs(GFP_KERNEL);
+	attrs = alloc_workqueue_attrs(GFP_KERNEL);
+
+	ret = -ENOMEM;
+	if (wq->cpu_wq.node && wq->unbound_attrs && attrs)
+		ret = apply_workqueue_attrs(wq, attrs);
+
+	free_workqueue_attrs(attrs);
+	return ret;
 }
 
 static void free_cwqs(struct workqueue_struct *wq)
 {
-	if (!(wq->flags & WQ_UNBOUND))
+	struct cpu_workqueue_struct *cwq, *n;
+
+	if (!(wq->flags & WQ_UNBOUND)) {
 		free_percpu(wq->cpu_wq.pcpu);
-	else if (wq->cpu_wq.single) {
-		/* the pointer to free is stored right after the cwq */
-		kfree(*(void **)(wq->cpu_wq.single + 1));
+		return;
 	}
+
+	list_for_each_entry_safe(cwq, n, &wq->cwqs, cwqs_node)
+		kmem_cache_free(cwq_cache, cwq);
+	kfree(wq->cpu_wq.node);
+	free_workqueue_attrs(wq->unbound_attrs);
 }
 
 static int wq_clamp_max_active(int max_active, unsigned int flags,
@@ -2940,6 +3312,259 @@ static int wq_clamp_max_active(int max_active, unsigned int flags,
 	return clamp_val(max_active, 1, lim);
 }
 
+#ifdef CONFIG_SYSFS
+/*
+ * Workqueues with WQ_SYSFS flag set are visible to userland via
+ * /sys/bus/workqueue/devices/WQ_NAME.  All visible workqueues have the
+ * following attributes.
+ *
+ *  per_cpu	RO bool	: whether the workqueue is per-cpu or unbound
+ *  max_active	RW int	: maximum number of in-flight work items
+ *
+ * Unbound workqueues have the following extra attributes.
+ *
+ *  nice	RW int	: nice value of the workers
+ *  cpumask	RW mask	: bitmask of allowed CPUs for the workers
+ */
+struct wq_device {
+	struct workqueue_struct		*wq;
+	struct device			dev;
+};
+
+static struct workqueue_struct *dev_to_wq(struct device *dev)
+{
+	struct wq_device *wq_dev = container_of(dev, struct wq_device, dev);
+
+	return wq_dev->wq;
+}
+
+static ssize_t wq_per_cpu_show(struct device *dev,
+			       struct device_attribute *attr, char *buf)
+{
+	struct workqueue_struct *wq = dev_to_wq(dev);
+
+	return scnprintf(buf, PAGE_SIZE, "%d\n", !(wq->flags & WQ_UNBOUND));
+}
+
+static ssize_t wq_max_active_show(struct device *dev,
+				  struct device_attribute *attr, char *buf)
+{
+	struct workqueue_struct *wq = dev_to_wq(dev);
+
+	return scnprintf(buf, PAGE_SIZE, "%d\n", wq->saved_max_active);
+}
+
+static ssize_t wq_max_active_store(struct device *dev,
+				   struct device_attribute *attr,
+				   const char *buf, size_t count)
+{
+	struct workqueue_struct *wq = dev_to_wq(dev);
+	int val;
+
+	if (sscanf(buf, "%d", &val) != 1 || val <= 0)
+		return -EINVAL;
+
+	workqueue_set_max_active(wq, val);
+	return count;
+}
+
+static struct device_attribute wq_sysfs_attrs[] = {
+	__ATTR(per_cpu, 0444, wq_per_cpu_show, NULL),
+	__ATTR(max_active, 0644, wq_max_active_show, wq_max_active_store),
+	__ATTR_NULL,
+};
+
+/* prepare a copy of @wq's attributes for a sysfs store */
+static struct workqueue_attrs *wq_sysfs_prep_attrs(struct workqueue_struct *wq)
+{
+	struct workqueue_attrs *attrs;
+
+	attrs = alloc_workqueue_attrs(GFP_KERNEL);
+	if (!attrs)
+		return NULL;
+
+	mutex_lock(&wq_pool_mutex);
+	copy_workqueue_attrs(attrs, wq->unbound_attrs);
+	mutex_unlock(&wq_pool_mutex);
+	return attrs;
+}
+
+static ssize_t wq_nice_show(struct device *dev, struct device_attribute *attr,
+			    char *buf)
+{
+	struct workqueue_struct *wq = dev_to_wq(dev);
+	int written;
+
+	mutex_lock(&wq_pool_mutex);
+	written = scnprintf(buf, PAGE_SIZE, "%d\n", wq->unbound_attrs->nice);
+	mutex_unlock(&wq_pool_mutex);
+
+	return written;
+}
+
+static ssize_t wq_nice_store(struct device *dev, struct device_attribute *attr,
+			     const char *buf, size_t count)
+{
+	struct workqueue_struct *wq = dev_to_wq(dev);
+	struct workqueue_attrs *attrs;
+	int ret;
+
+	attrs = wq_sysfs_prep_attrs(wq);
+	if (!attrs)
+		return -ENOMEM;
+
+	if (sscanf(buf, "%d", &attrs->nice) == 1 &&
+	    attrs->nice >= -20 && attrs->nice <= 19)
+		ret = apply_workqueue_attrs(wq, attrs);
+	else
+		ret = -EINVAL;
+
+	free_workqueue_attrs(attrs);
+	return ret ?: count;
+}
+
+static ssize_t wq_cpumask_show(struct device *dev,
+			       struct device_attribute *attr, char *buf)
+{
+	struct workqueue_struct *wq = dev_to_wq(dev);
+	int written;
+
+	mutex_lock(&wq_pool_mutex);
+	written = cpumask_scnprintf(buf, PAGE_SIZE, wq->unbound_attrs->cpumask);
+	mutex_unlock(&wq_pool_mutex);
+
+	written += scnprintf(buf + written, PAGE_SIZE - written, "\n");
+	return written;
+}
+
+static ssize_t wq_cpumask_store(struct device *dev,
+				struct device_attribute *attr,
+				const char *buf, size_t count)
+{
+	struct workqueue_struct *wq = dev_to_wq(dev);
+	struct workqueue_attrs *attrs;
+	int ret;
+
+	attrs = wq_sysfs_prep_attrs(wq);
+	if (!attrs)
+		return -ENOMEM;
+
+	ret = bitmap_parse(buf, count, cpumask_bits(attrs->cpumask),
+			   nr_cpumask_bits);
+	if (!ret)
+		ret = apply_workqueue_attrs(wq, attrs);
+
+	free_workqueue_attrs(attrs);
+	return ret ?: count;
+}
+
+static struct device_attribute wq_sysfs_unbound_attrs[] = {
+	__ATTR(nice, 0644, wq_nice_show, wq_nice_store),
+	__ATTR(cpumask, 0644, wq_cpumask_show, wq_cpumask_store),
+	__ATTR_NULL,
+};
+
+static struct bus_type wq_subsys = {
+	.name				= "workqueue",
+	.dev_attrs			= wq_sysfs_attrs,
+};
+
+static void wq_device_release(struct device *dev)
+{
+	struct wq_device *wq_dev = container_of(dev, struct wq_device, dev);
+
+	kfree(wq_dev);
+}
+
+/**
+ * workqueue_sysfs_register - make a workqueue visible in sysfs
+ * @wq: the workqueue to register
+ *
+ * Expose @wq in sysfs under /sys/bus/workqueue/devices.  This is done
+ * for workqueues created with WQ_SYSFS after core_initcall.  Ordered
+ * workqueues can't be exposed as changing their attributes or
+ * max_active would break the ordering guarantee.
+ *
+ * RETURNS:
+ * 0 on success, -errno on failure.
+ */
+static int workqueue_sysfs_register(struct workqueue_struct *wq)
+{
+	struct wq_device *wq_dev;
+	int ret;
+
+	if (WARN_ON(wq->flags & WQ_ORDERED))
+		return -EINVAL;
+
+	wq->wq_dev = wq_dev = kzalloc(sizeof(*wq_dev), GFP_KERNEL);
+	if (!wq_dev)
+		return -ENOMEM;
+
+	wq_dev->wq = wq;
+	wq_dev->dev.bus = &wq_subsys;
+	wq_dev->dev.init_name = wq->name;
+	wq_dev->dev.release = wq_device_release;
+
+	/* announce only after all the attributes are in place */
+	dev_set_uevent_suppress(&wq_dev->dev, true);
+
+	ret = device_register(&wq_dev->dev);
+	if (ret) {
+		put_device(&wq_dev->dev);
+		wq->wq_dev = NULL;
+		return ret;
+	}
+
+	if (wq->flags & WQ_UNBOUND) {
+		struct device_attribute *attr;
+
+		for (attr = wq_sysfs_unbound_attrs; attr->attr.name; attr++) {
+			ret = device_create_file(&wq_dev->dev, attr);
+			if (ret) {
+				device_unregister(&wq_dev->dev);
+				wq->wq_dev = NULL;
+				return ret;
+			}
+		}
+	}
+
+	dev_set_uevent_suppress(&wq_dev->dev, false);
+	kobject_uevent(&wq_dev->dev.kobj, KOBJ_ADD);
+	return 0;
+}
+
+static void workqueue_sysfs_unregister(struct workqueue_struct *wq)
+{
+	struct wq_device *wq_dev = wq->wq_dev;
+
+	if (!wq_dev)
+		return;
+
+	wq->wq_dev = NULL;
+	device_unregister(&wq_dev->dev);
+}
+
+static int __init wq_sysfs_init(void)
+{
+	int ret;
+
+	ret = subsys_system_register(&wq_subsys, NULL);
+	if (ret)
+		return ret;
+
+	/*
+	 * system_unbound_wq is created before the subsystem exists.
+	 * Expose it here so that the placement of unbound work items
+	 * which don't have a workqueue of their own can be tuned.
+	 */
+	return workqueue_sysfs_register(system_unbound_wq);
+}
+core_initcall(wq_sysfs_init);
+#else	/* CONFIG_SYSFS */
+static int workqueue_sysfs_register(struct workqueue_struct *wq)	{ return 0; }
+static void workqueue_sysfs_unregister(struct workqueue_struct *wq)	{ }
+#endif	/* CONFIG_SYSFS */
+
 struct workqueue_struct *__alloc_workqueue_key(const char *fmt,
 					       unsigned int flags,
 					       int max_active,
@@ -2948,7 +3573,7 @@ struct workqueue_struct *__alloc_workqueue_key(const char *fmt,
 {
 	va_list args, args1;
 	struct workqueue_struct *wq;
-	unsigned int cpu;
+	struct cpu_workqueue_struct *cwq;
 	size_t namelen;
 
 	/* determine namelen, allocate wq and format name */
@@ -2981,13 +3606,22 @@ struct workqueue_struct *__alloc_workqueue_key(const char *fmt,
 	max_active = max_active ?: WQ_DFL_ACTIVE;
 	max_active = wq_clamp_max_active(max_active, flags, wq->name);
 
+	/*
+	 * Unbound workqueues with @max_active of 1 are relied upon for
+	 * strict ordering and can't be spread over per-node cwqs.
+	 */
+	if (flags & WQ_UNBOUND && max_active == 1)
+		flags |= WQ_ORDERED;
+
 	/* init wq */
 	wq->flags = flags;
 	wq->saved_max_active = max_active;
 	mutex_init(&wq->flush_mutex);
 	atomic_set(&wq->nr_cwqs_to_flush, 0);
+	INIT_LIST_HEAD(&wq->cwqs);
 	INIT_LIST_HEAD(&wq->flusher_queue);
 	INIT_LIST_HEAD(&wq->flusher_overflow);
+	INIT_LIST_HEAD(&wq->maydays);
 
 	lockdep_init_map(&wq->lockdep_map, lock_name, key, 0);
 	INIT_LIST_HEAD(&wq->list);
@@ -2995,24 +3629,9 @@ struct workqueue_struct *__alloc_workqueue_key(const char *fmt,
 	if (alloc_cwqs(wq) < 0)
 		goto err;
 
-	for_each_cwq_cpu(cpu, wq) {
-		struct cpu_workqueue_struct *cwq = get_cwq(cpu, wq);
-		struct global_cwq *gcwq = get_gcwq(cpu);
-
-		BUG_ON((unsigned long)cwq & WORK_STRUCT_FLAG_MASK);
-		cwq->gcwq = gcwq;
-		cwq->wq = wq;
-		cwq->flush_color = -1;
-		cwq->max_active = max_active;
-		INIT_LIST_HEAD(&cwq->delayed_works);
-	}
-
 	if (flags & WQ_RESCUER) {
 		struct worker *rescuer;
 
-		if (!alloc_mayday_mask(&wq->mayday_mask, GFP_KERNEL))
-			goto err;
-
 		wq->rescuer = rescuer = alloc_worker();
 		if (!rescuer)
 			goto err;
@@ -3034,22 +3653,27 @@ struct workqueue_struct *__alloc_workqueue_key(const char *fmt,
 	spin_lock(&workqueue_lock);
 
 	if (workqueue_freezing && wq->flags & WQ_FREEZABLE)
-		for_each_cwq_cpu(cpu, wq)
-			get_cwq(cpu, wq)->max_active = 0;
+		for_each_cwq(cwq, wq)
+			cwq->max_active = 0;
 
 	list_add(&wq->list, &workqueues);
 
 	spin_unlock(&workqueue_lock);
 
+	if (wq->flags & WQ_SYSFS && workqueue_sysfs_register(wq))
+		goto err_destroy;
+
 	return wq;
 err:
 	if (wq) {
 		free_cwqs(wq);
-		free_mayday_mask(wq->mayday_mask);
 		kfree(wq->rescuer);
 		kfree(wq);
 	}
 	return NULL;
+err_destroy:
+	destroy_workqueue(wq);
+	return NULL;
 }
 EXPORT_SYMBOL_GPL(__alloc_workqueue_key);
 
@@ -3061,7 +3685,10 @@ EXPORT_SYMBOL_GPL(__alloc_workqueue_key);
  */
 void destroy_workqueue(struct workqueue_struct *wq)
 {
-	unsigned int cpu;
+	struct cpu_workqueue_struct *cwq;
+
+	/* nobody should be able to change the attributes from now on */
+	workqueue_sysfs_unregister(wq);
 
 	/* drain it before proceeding with destruction */
 	drain_workqueue(wq);
@@ -3075,8 +3702,7 @@ void destroy_workqueue(struct workqueue_struct *wq)
 	spin_unlock(&workqueue_lock);
 
 	/* sanity check */
-	for_each_cwq_cpu(cpu, wq) {
-		struct cpu_workqueue_struct *cwq = get_cwq(cpu, wq);
+	for_each_cwq(cwq, wq) {
 		int i;
 
 		for (i = 0; i < WORK_NR_COLORS; i++)
@@ -3087,7 +3713,6 @@ void destroy_workqueue(struct workqueue_struct *wq)
 
 	if (wq->flags & WQ_RESCUER) {
 		kthread_stop(wq->rescuer->task);
-		free_mayday_mask(wq->mayday_mask);
 		kfree(wq->rescuer);
 	}
 
@@ -3108,7 +3733,7 @@ EXPORT_SYMBOL_GPL(destroy_workqueue);
  */
 void workqueue_set_max_active(struct workqueue_struct *wq, int max_active)
 {
-	unsigned int cpu;
+	struct cpu_workqueue_struct *cwq;
 
 	max_active = wq_clamp_max_active(max_active, wq->flags, wq->name);
 
@@ -3116,14 +3741,13 @@ void workqueue_set_max_active(struct workqueue_struct *wq, int max_active)
 
 	wq->saved_max_active = max_active;
 
-	for_each_cwq_cpu(cpu, wq) {
-		struct global_cwq *gcwq = get_gcwq(cpu);
+	for_each_cwq(cwq, wq) {
+		struct global_cwq *gcwq = cwq->gcwq;
 
 		spin_lock_irq(&gcwq->lock);
 
-		if (!(wq->flags & WQ_FREEZABLE) ||
-		    !(gcwq->flags & GCWQ_FREEZING))
-			get_cwq(gcwq->cpu, wq)->max_active = max_active;
+		if (!(wq->flags & WQ_FREEZABLE) || !workqueue_freezing)
+			cwq->max_active = max_active;
 
 		spin_unlock_irq(&gcwq->lock);
 	}
@@ -3638,6 +4262,7 @@ EXPORT_SYMBOL_GPL(work_on_cpu);
  */
 void freeze_workqueues_begin(void)
 {
+	struct workqueue_struct *wq;
 	unsigned int cpu;
 
 	spin_lock(&workqueue_lock);
@@ -3645,23 +4270,26 @@ void freeze_workqueues_begin(void)
 	BUG_ON(workqueue_freezing);
 	workqueue_freezing = true;
 
-	for_each_gcwq_cpu(cpu) {
+	for_each_possible_cpu(cpu) {
 		struct global_cwq *gcwq = get_gcwq(cpu);
-		struct workqueue_struct *wq;
 
 		spin_lock_irq(&gcwq->lock);
-
 		BUG_ON(gcwq->flags & GCWQ_FREEZING);
 		gcwq->flags |= GCWQ_FREEZING;
+		spin_unlock_irq(&gcwq->lock);
+	}
 
-		list_for_each_entry(wq, &workqueues, list) {
-			struct cpu_workqueue_struct *cwq = get_cwq(cpu, wq);
+	list_for_each_entry(wq, &workqueues, list) {
+		struct cpu_workqueue_struct *cwq;
 
-			if (cwq && wq->flags & WQ_FREEZABLE)
-				cwq->max_active = 0;
-		}
+		if (!(wq->flags & WQ_FREEZABLE))
+			continue;
 
-		spin_unlock_irq(&gcwq->lock);
+		for_each_cwq(cwq, wq) {
+			spin_lock_irq(&cwq->gcwq->lock);
+			cwq->max_active = 0;
+			spin_unlock_irq(&cwq->gcwq->lock);
+		}
 	}
 
 	spin_unlock(&workqueue_lock);
@@ -3682,25 +4310,23 @@ void freeze_workqueues_begin(void)
  */
 bool freeze_workqueues_busy(void)
 {
-	unsigned int cpu;
+	struct workqueue_struct *wq;
 	bool busy = false;
 
 	spin_lock(&workqueue_lock);
 
 	BUG_ON(!workqueue_freezing);
 
-	for_each_gcwq_cpu(cpu) {
-		struct workqueue_struct *wq;
+	list_for_each_entry(wq, &workqueues, list) {
+		struct cpu_workqueue_struct *cwq;
+
+		if (!(wq->flags & WQ_FREEZABLE))
+			continue;
 		/*
 		 * nr_active is monotonically decreasing.  It's safe
 		 * to peek without lock.
 		 */
-		list_for_each_entry(wq, &workqueues, list) {
-			struct cpu_workqueue_struct *cwq = get_cwq(cpu, wq);
-
-			if (!cwq || !(wq->flags & WQ_FREEZABLE))
-				continue;
-
+		for_each_cwq(cwq, wq) {
 			BUG_ON(cwq->nr_active < 0);
 			if (cwq->nr_active) {
 				busy = true;
@@ -3724,6 +4350,7 @@ out_unlock:
  */
 void thaw_workqueues(void)
 {
+	struct workqueue_struct *wq;
 	unsigned int cpu;
 
 	spin_lock(&workqueue_lock);
@@ -3731,20 +4358,25 @@ void thaw_workqueues(void)
 	if (!workqueue_freezing)
 		goto out_unlock;
 
-	for_each_gcwq_cpu(cpu) {
+	for_each_possible_cpu(cpu) {
 		struct global_cwq *gcwq = get_gcwq(cpu);
-		struct workqueue_struct *wq;
 
 		spin_lock_irq(&gcwq->lock);
-
 		BUG_ON(!(gcwq->flags & GCWQ_FREEZING));
 		gcwq->flags &= ~GCWQ_FREEZING;
+		spin_unlock_irq(&gcwq->lock);
+	}
 
-		list_for_each_entry(wq, &workqueues, list) {
-			struct cpu_workqueue_struct *cwq = get_cwq(cpu, wq);
+	list_for_each_entry(wq, &workqueues, list) {
+		struct cpu_workqueue_struct *cwq;
 
-			if (!cwq || !(wq->flags & WQ_FREEZABLE))
-				continue;
+		if (!(wq->flags & WQ_FREEZABLE))
+			continue;
+
+		for_each_cwq(cwq, wq) {
+			struct global_cwq *gcwq = cwq->gcwq;
+
+			spin_lock_irq(&gcwq->lock);
 
 			/* restore max_active and repopulate worklist */
 			cwq->max_active = wq->saved_max_active;
@@ -3752,11 +4384,11 @@ void thaw_workqueues(void)
 			while (!list_empty(&cwq->delayed_works) &&
 			       cwq->nr_active < cwq->max_active)
 				cwq_activate_first_delayed(cwq);
-		}
 
-		wake_up_worker(gcwq);
+			wake_up_worker(gcwq);
 
-		spin_unlock_irq(&gcwq->lock);
+			spin_unlock_irq(&gcwq->lock);
+		}
 	}
 
 	workqueue_freezing = false;
@@ -3765,46 +4397,66 @@ out_unlock:
 }
 #endif /* CONFIG_FREEZER */
 
+/*
+ * Build the possible cpumask of each node so that unbound workqueues
+ * can have a gcwq per node.  NUMA affinity is left disabled on
+ * machines with a single node.
+ */
+static void __init wq_numa_init(void)
+{
+	cpumask_var_t *tbl;
+	int node, cpu;
+
+	if (num_possible_nodes() <= 1)
+		return;
+
+	tbl = kzalloc(nr_node_ids * sizeof(tbl[0]), GFP_KERNEL);
+	BUG_ON(!tbl);
+
+	for (node = 0; node < nr_node_ids; node++)
+		BUG_ON(!zalloc_cpumask_var(&tbl[node], GFP_KERNEL));
+
+	for_each_possible_cpu(cpu) {
+		node = cpu_to_node(cpu);
+		if (WARN_ON(node < 0)) {
+			pr_warning("workqueue: NUMA node mapping not available for cpu%d, disabling NUMA support\n",
+				   cpu);
+			/* happens iff arch is bonkers, let's just proceed */
+			return;
+		}
+		cpumask_set_cpu(cpu, tbl[node]);
+	}
+
+	wq_numa_possible_cpumask = tbl;
+	wq_numa_enabled = true;
+}
+
 static int __init init_workqueues(void)
 {
 	unsigned int cpu;
-	int i;
 
 	cpu_notifier(workqueue_cpu_callback, CPU_PRI_WORKQUEUE);
 
+	cwq_cache = KMEM_CACHE(cpu_workqueue_struct, SLAB_PANIC);
+
+	wq_numa_init();
+
 	/* initialize gcwqs */
-	for_each_gcwq_cpu(cpu) {
+	for_each_possible_cpu(cpu) {
 		struct global_cwq *gcwq = get_gcwq(cpu);
 
-		spin_lock_init(&gcwq->lock);
-		INIT_LIST_HEAD(&gcwq->worklist);
+		init_gcwq(gcwq);
 		gcwq->cpu = cpu;
-		gcwq->flags |= GCWQ_DISASSOCIATED;
-
-		INIT_LIST_HEAD(&gcwq->idle_list);
-		for (i = 0; i < BUSY_WORKER_HASH_SIZE; i++)
-			INIT_HLIST_HEAD(&gcwq->busy_hash[i]);
-
-		init_timer_deferrable(&gcwq->idle_timer);
-		gcwq->idle_timer.function = idle_worker_timeout;
-		gcwq->idle_timer.data = (unsigned long)gcwq;
-
-		setup_timer(&gcwq->mayday_timer, gcwq_mayday_timeout,
-			    (unsigned long)gcwq);
-
-		ida_init(&gcwq->worker_ida);
-
-		gcwq->trustee_state = TRUSTEE_DONE;
-		init_waitqueue_head(&gcwq->trustee_wait);
+		gcwq->id = cpu;
+		gcwq->node = cpu_to_node(cpu);
 	}
 
 	/* create the initial worker */
-	for_each_online_gcwq_cpu(cpu) {
+	for_each_online_cpu(cpu) {
 		struct global_cwq *gcwq = get_gcwq(cpu);
 		struct worker *worker;
 
-		if (cpu != WORK_CPU_UNBOUND)
-			gcwq->flags &= ~GCWQ_DISASSOCIATED;
+		gcwq->flags &= ~GCWQ_DISASSOCIATED;
 		worker = create_worker(gcwq, true);
 		BUG_ON(!worker);
 		spin_lock_irq(&gcwq->lock);
@@ -7,6 +7,7 @@
 #include <linux/sched.h>
 #include <linux/init.h>
 #include <linux/export.h>
+#include <linux/mcs_spinlock.h>
 
 /*
  * Initialize an rwsem:
@@ -24,6 +25,10 @@ void __init_rwsem(struct rw_semaphore *sem, const char *name,
 	sem->count = RWSEM_UNLOCKED_VALUE;
 	raw_spin_lock_init(&sem->wait_lock);
 	INIT_LIST_HEAD(&sem->wait_list);
+#ifdef CONFIG_RWSEM_SPIN_ON_OWNER
+	sem->owner = NULL;
+	sem->mcs_lock = NULL;
+#endif
 }
 
 EXPORT_SYMBOL(__init_rwsem);
@@ -176,6 +181,7 @@ rwsem_down_failed_common(struct rw_semaphore *sem,
 	struct rwsem_waiter waiter;
 	struct task_struct *tsk = current;
 	signed long count;
+	bool waiting = true;
 
 	set_task_state(tsk, TASK_UNINTERRUPTIBLE);
 
@@ -185,8 +191,10 @@ rwsem_down_failed_common(struct rw_semaphore *sem,
 	waiter.flags = flags;
 	get_task_struct(tsk);
 
-	if (list_empty(&sem->wait_list))
+	if (list_empty(&sem->wait_list)) {
 		adjustment += RWSEM_WAITING_BIAS;
+		waiting = false;
+	}
 	list_add_tail(&waiter.list, &sem->wait_list);
 
 	/* we're now waiting on the lock, but no longer actively locking */
@@ -200,8 +208,8 @@ rwsem_down_failed_common(struct rw_semaphore *sem,
 	 * locks that were queued ahead of us. */
 	if (count == RWSEM_WAITING_BIAS)
 		sem = __rwsem_do_wake(sem, RWSEM_WAKE_NO_ACTIVE);
-	else if (count > RWSEM_WAITING_BIAS &&
-		 adjustment == -RWSEM_ACTIVE_WRITE_BIAS)
+	else if (count > RWSEM_WAITING_BIAS && waiting &&
+		 (flags & RWSEM_WAITING_FOR_WRITE))
 		sem = __rwsem_do_wake(sem, RWSEM_WAKE_READ_OWNED);
 
 	raw_spin_unlock_irq(&sem->wait_lock);
@@ -228,6 +236,156 @@ struct rw_semaphore __sched *rwsem_down_read_failed(struct rw_semaphore *sem)
 					-RWSEM_ACTIVE_READ_BIAS);
 }
 
+#ifdef CONFIG_RWSEM_SPIN_ON_OWNER
+/*
+ * Try to acquire the write lock without queueing: this can only succeed
+ * while nobody holds the rwsem, whether or not there are sleepers.
+ */
+static inline bool rwsem_try_write_lock_unqueued(struct rw_semaphore *sem)
+{
+	long old, count = ACCESS_ONCE(sem->count);
+
+	while (count == 0 || count == RWSEM_WAITING_BIAS) {
+		old = cmpxchg(&sem->count, count,
+			      count + RWSEM_ACTIVE_WRITE_BIAS);
+		if (old == count)
+			return true;
+
+		count = old;
+	}
+	return false;
+}
+
+/*
+ * Only start spinning if a writer owns the rwsem and is running.  A
+ * NULL owner may mean that readers hold it, and there's no telling when
+ * they will be done.
+ */
+static inline bool rwsem_can_spin_on_owner(struct rw_semaphore *sem)
+{
+	struct task_struct *owner;
+	bool on_cpu = false;
+
+	if (need_resched())
+		return false;
+
+	rcu_read_lock();
+	owner = ACCESS_ONCE(sem->owner);
+	if (owner)
+		on_cpu = owner->on_cpu;
+	rcu_read_unlock();
+
+	return on_cpu;
+}
+
+static inline bool owner_running(struct rw_semaphore *sem,
+				 struct task_struct *owner)
+{
+	if (sem->owner != owner)
+		return false;
+
+	/*
+	 * Ensure we emit the owner->on_cpu, dereference _after_ checking
+	 * sem->owner still matches owner, if that fails, owner might
+	 * point to free()d memory, if it still matches, the rcu_read_lock()
+	 * ensures the memory stays valid.
+	 */
+	barrier();
+
+	return owner->on_cpu;
+}
+
+static noinline
+bool rwsem_spin_on_owner(struct rw_semaphore *sem, struct task_struct *owner)
+{
+	rcu_read_lock();
+	while (owner_running(sem, owner)) {
+		if (need_resched())
+			break;
+
+		arch_mutex_cpu_relax();
+	}
+	rcu_read_unlock();
+
+	/*
+	 * We break out the loop above on need_resched() or when the
+	 * owner changed, which is a sign for heavy contention. Return
+	 * success only when sem->owner is NULL.
+	 */
+	return sem->owner == NULL;
+}
+
+/*
+ * Optimistic spinning for writers, as done for mutexes: while the
+ * owning writer is running, it is likely to release the rwsem soon, so
+ * spin instead of paying for a sleep and a wakeup.  The spinners are
+ * queued on an MCS lock so that only one of them polls the rwsem.
+ */
+static bool rwsem_optimistic_spin(struct rw_semaphore *sem)
+{
+	struct task_struct *owner;
+	bool taken = false;
+
+	preempt_disable();
+
+	if (!rwsem_can_spin_on_owner(sem))
+		goto done;
+
+	for (;;) {
+		struct mcs_spinlock node;
+
+		mcs_spin_lock(&sem->mcs_lock, &node);
+		owner = ACCESS_ONCE(sem->owner);
+		if (owner && !rwsem_spin_on_owner(sem, owner)) {
+			mcs_spin_unlock(&sem->mcs_lock, &node);
+			break;
+		}
+
+		taken = rwsem_try_write_lock_unqueued(sem);
+		mcs_spin_unlock(&sem->mcs_lock, &node);
+		if (taken)
+			break;
+
+		/*
+		 * When there's no owner, we might have preempted between the
+		 * owner acquiring the lock and setting the owner field, or
+		 * readers may hold the rwsem.  If we're an RT task that will
+		 * live-lock because we won't let the owner complete.
+		 */
+		if (!owner && (need_resched() || rt_task(current)))
+			break;
+
+		/*
+		 * The cpu_relax() call is a compiler barrier which forces
+		 * everything in this loop to be re-loaded. We don't need
+		 * memory barriers as we'll eventually observe the right
+		 * values at the cost of a few extra spins.
+		 */
+		arch_mutex_cpu_relax();
+	}
+
+done:
+	preempt_enable();
+	return taken;
+}
+
+/*
+ * wait for the write lock to be granted
+ */
+struct rw_semaphore __sched *rwsem_down_write_failed(struct rw_semaphore *sem)
+{
+	/*
+	 * The fastpath added our active write bias, undo it while we spin
+	 * so that the rwsem can be released and taken over by us.
+	 */
+	rwsem_atomic_update(-RWSEM_ACTIVE_WRITE_BIAS, sem);
+
+	if (rwsem_optimistic_spin(sem))
+		return sem;
+
+	return rwsem_down_failed_common(sem, RWSEM_WAITING_FOR_WRITE, 0);
+}
+#else
 /*
  * wait for the write lock to be granted
  */
@@ -236,6 +394,7 @@ struct rw_semaphore __sched *rwsem_down_write_failed(struct rw_semaphore *sem)
 	return rwsem_down_failed_common(sem, RWSEM_WAITING_FOR_WRITE,
 					-RWSEM_ACTIVE_WRITE_BIAS);
 }
+#endif
 
 /*
  * handle waking up a waiter on the semaphore
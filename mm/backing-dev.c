@@ -10,6 +10,7 @@
 #include <linux/module.h>
 #include <linux/writeback.h>
 #include <linux/device.h>
+#include <linux/slab.h>
 #include <trace/events/writeback.h>
 
 static atomic_long_t bdi_seq = ATOMIC_LONG_INIT(0);
@@ -70,22 +71,27 @@ static void bdi_debug_init(void)
 static int bdi_debug_stats_show(struct seq_file *m, void *v)
 {
 	struct backing_dev_info *bdi = m->private;
-	struct bdi_writeback *wb = &bdi->wb;
+	struct bdi_writeback *wb;
 	unsigned long background_thresh;
 	unsigned long dirty_thresh;
 	unsigned long bdi_thresh;
-	unsigned long nr_dirty, nr_io, nr_more_io;
+	unsigned long nr_dirty, nr_io, nr_more_io, nr_threads;
 	struct inode *inode;
-
-	nr_dirty = nr_io = nr_more_io = 0;
-	spin_lock(&wb->list_lock);
-	list_for_each_entry(inode, &wb->b_dirty, i_wb_list)
-		nr_dirty++;
-	list_for_each_entry(inode, &wb->b_io, i_wb_list)
-		nr_io++;
-	list_for_each_entry(inode, &wb->b_more_io, i_wb_list)
-		nr_more_io++;
-	spin_unlock(&wb->list_lock);
+	unsigned int i;
+
+	nr_dirty = nr_io = nr_more_io = nr_threads = 0;
+	bdi_for_each_wb(wb, bdi, i) {
+		spin_lock(&wb->list_lock);
+		list_for_each_entry(inode, &wb->b_dirty, i_wb_list)
+			nr_dirty++;
+		list_for_each_entry(inode, &wb->b_io, i_wb_list)
+			nr_io++;
+		list_for_each_entry(inode, &wb->b_more_io, i_wb_list)
+			nr_more_io++;
+		spin_unlock(&wb->list_lock);
+		if (wb->task)
+			nr_threads++;
+	}
 
 	global_dirty_limits(&background_thresh, &dirty_thresh);
 	bdi_thresh = bdi_dirty_limit(bdi, dirty_thresh);
@@ -103,6 +109,8 @@ static int bdi_debug_stats_show(struct seq_file *m, void *v)
 		   "b_dirty:            %10lu\n"
 		   "b_io:               %10lu\n"
 		   "b_more_io:          %10lu\n"
+		   "flushers:           %10u\n"
+		   "flusher_threads:    %10lu\n"
 		   "bdi_list:           %10u\n"
 		   "state:              %10lx\n",
 		   (unsigned long) K(bdi_stat(bdi, BDI_WRITEBACK)),
@@ -116,6 +124,8 @@ static int bdi_debug_stats_show(struct seq_file *m, void *v)
 		   nr_dirty,
 		   nr_io,
 		   nr_more_io,
+		   bdi->nr_flushers,
+		   nr_threads,
 		   !list_empty(&bdi->bdi_list), bdi->state);
 #undef K
 
@@ -225,12 +235,31 @@ static ssize_t max_ratio_store(struct device *dev,
 }
 BDI_SHOW(max_ratio, bdi->max_ratio)
 
+static ssize_t flushers_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t count)
+{
+	struct backing_dev_info *bdi = dev_get_drvdata(dev);
+	char *end;
+	unsigned int nr;
+	ssize_t ret = -EINVAL;
+
+	nr = simple_strtoul(buf, &end, 10);
+	if (*buf && (end[0] == '\0' || (end[0] == '\n' && end[1] == '\0'))) {
+		ret = bdi_set_flushers(bdi, nr);
+		if (!ret)
+			ret = count;
+	}
+	return ret;
+}
+BDI_SHOW(flushers, bdi->nr_flushers)
+
 #define __ATTR_RW(attr) __ATTR(attr, 0644, attr##_show, attr##_store)
 
 static struct device_attribute bdi_dev_attrs[] = {
 	__ATTR_RW(read_ahead_kb),
 	__ATTR_RW(min_ratio),
 	__ATTR_RW(max_ratio),
+	__ATTR_RW(flushers),
 	__ATTR_NULL,
 };
 
@@ -267,7 +296,14 @@ subsys_initcall(default_bdi_init);
 
 int bdi_has_dirty_io(struct backing_dev_info *bdi)
 {
-	return wb_has_dirty_io(&bdi->wb);
+	struct bdi_writeback *wb;
+	unsigned int i;
+
+	bdi_for_each_wb(wb, bdi, i) {
+		if (wb_has_dirty_io(wb))
+			return 1;
+	}
+	return 0;
 }
 
 /*
@@ -312,12 +348,13 @@ static void sync_supers_timer_fn(unsigned long unused)
 
 static void wakeup_timer_fn(unsigned long data)
 {
-	struct backing_dev_info *bdi = (struct backing_dev_info *)data;
+	struct bdi_writeback *wb = (struct bdi_writeback *)data;
+	struct backing_dev_info *bdi = wb->bdi;
 
 	spin_lock_bh(&bdi->wb_lock);
-	if (bdi->wb.task) {
+	if (wb->task) {
 		trace_writeback_wake_thread(bdi);
-		wake_up_process(bdi->wb.task);
+		wake_up_process(wb->task);
 	} else if (bdi->dev) {
 		/*
 		 * When bdi tasks are inactive for long time, they are killed.
@@ -331,8 +368,8 @@ static void wakeup_timer_fn(unsigned long data)
 }
 
 /*
- * This function is used when the first inode for this bdi is marked dirty. It
- * wakes-up the corresponding bdi thread which should then take care of the
+ * This function is used when the first inode for this flusher is marked dirty.
+ * It wakes-up the corresponding bdi thread which should then take care of the
  * periodic background write-out of dirty inodes. Since the write-out would
  * starts only 'dirty_writeback_interval' centisecs from now anyway, we just
  * set up a timer which wakes the bdi thread up later.
@@ -341,12 +378,12 @@ static void wakeup_timer_fn(unsigned long data)
  * fast-path (used by '__mark_inode_dirty()'), so we save few context switches
  * by delaying the wake-up.
  */
-void bdi_wakeup_thread_delayed(struct backing_dev_info *bdi)
+void wb_wakeup_delayed(struct bdi_writeback *wb)
 {
 	unsigned long timeout;
 
 	timeout = msecs_to_jiffies(dirty_writeback_interval * 10);
-	mod_timer(&bdi->wb.wakeup_timer, jiffies + timeout);
+	mod_timer(&wb->wakeup_timer, jiffies + timeout);
 }
 
 /*
@@ -387,6 +424,8 @@ static int bdi_forker_thread(void *ptr)
 	for (;;) {
 		struct task_struct *task = NULL;
 		struct backing_dev_info *bdi;
+		struct bdi_writeback *wb;
+		unsigned int i;
 		enum {
 			NO_ACTION,   /* Nothing to do */
 			FORK_THREAD, /* Fork bdi thread */
@@ -397,7 +436,7 @@ static int bdi_forker_thread(void *ptr)
 		 * Temporary measure, we want to make sure we don't see
 		 * dirty data on the default backing_dev_info
 		 */
-		if (wb_has_dirty_io(me) || !list_empty(&me->bdi->work_list)) {
+		if (wb_has_dirty_io(me) || wb_has_work(me)) {
 			del_timer(&me->wakeup_timer);
 			wb_do_writeback(me, 0);
 		}
@@ -412,8 +451,6 @@ static int bdi_forker_thread(void *ptr)
 		set_current_state(TASK_INTERRUPTIBLE);
 
 		list_for_each_entry(bdi, &bdi_list, bdi_list) {
-			bool have_dirty_io;
-
 			if (!bdi_cap_writeback_dirty(bdi) ||
 			     bdi_cap_flush_forker(bdi))
 				continue;
@@ -421,61 +458,75 @@ static int bdi_forker_thread(void *ptr)
 			WARN(!test_bit(BDI_registered, &bdi->state),
 			     "bdi %p/%s is not registered!\n", bdi, bdi->name);
 
-			have_dirty_io = !list_empty(&bdi->work_list) ||
-					wb_has_dirty_io(&bdi->wb);
+			bdi_for_each_wb(wb, bdi, i) {
+				bool have_dirty_io;
+
+				have_dirty_io = wb_has_work(wb) ||
+						wb_has_dirty_io(wb);
 
-			/*
-			 * If the bdi has work to do, but the thread does not
-			 * exist - create it.
-			 */
-			if (!bdi->wb.task && have_dirty_io) {
 				/*
-				 * Set the pending bit - if someone will try to
-				 * unregister this bdi - it'll wait on this bit.
+				 * If the flusher has work to do, but the
+				 * thread does not exist - create it.
 				 */
-				set_bit(BDI_pending, &bdi->state);
-				action = FORK_THREAD;
-				break;
-			}
+				if (!wb->task && have_dirty_io) {
+					/*
+					 * Set the pending bit - if someone will
+					 * try to unregister this bdi - it'll
+					 * wait on this bit.
+					 */
+					set_bit(BDI_pending, &bdi->state);
+					action = FORK_THREAD;
+					break;
+				}
+
+				spin_lock(&bdi->wb_lock);
 
-			spin_lock(&bdi->wb_lock);
-
-			/*
-			 * If there is no work to do and the bdi thread was
-			 * inactive long enough - kill it. The wb_lock is taken
-			 * to make sure no-one adds more work to this bdi and
-			 * wakes the bdi thread up.
-			 */
-			if (bdi->wb.task && !have_dirty_io &&
-			    time_after(jiffies, bdi->wb.last_active +
-						bdi_longest_inactive())) {
-				task = bdi->wb.task;
-				bdi->wb.task = NULL;
+				/*
+				 * If there is no work to do and the flusher
+				 * thread was inactive long enough - kill it.
+				 * The wb_lock is taken to make sure no-one
+				 * adds more work to this bdi and wakes the
+				 * thread up.
+				 */
+				if (wb->task && !have_dirty_io &&
+				    time_after(jiffies, wb->last_active +
+							bdi_longest_inactive())) {
+					task = wb->task;
+					wb->task = NULL;
+					spin_unlock(&bdi->wb_lock);
+					set_bit(BDI_pending, &bdi->state);
+					action = KILL_THREAD;
+					break;
+				}
 				spin_unlock(&bdi->wb_lock);
-				set_bit(BDI_pending, &bdi->state);
-				action = KILL_THREAD;
-				break;
 			}
-			spin_unlock(&bdi->wb_lock);
+			if (action != NO_ACTION)
+				break;
 		}
 		spin_unlock_bh(&bdi_lock);
 
 		/* Keep working if default bdi still has things to do */
-		if (!list_empty(&me->bdi->work_list))
+		if (wb_has_work(me))
 			__set_current_state(TASK_RUNNING);
 
 		switch (action) {
 		case FORK_THREAD:
 			__set_current_state(TASK_RUNNING);
-			task = kthread_create(bdi_writeback_thread, &bdi->wb,
-					      "flush-%s", dev_name(bdi->dev));
+			if (wb->nr)
+				task = kthread_create(bdi_writeback_thread, wb,
+						      "flush-%s-%u",
+						      dev_name(bdi->dev), wb->nr);
+			else
+				task = kthread_create(bdi_writeback_thread, wb,
+						      "flush-%s",
+						      dev_name(bdi->dev));
 			if (IS_ERR(task)) {
 				/*
 				 * If thread creation fails, force writeout of
 				 * the bdi from the thread. Hopefully 1024 is
 				 * large enough for efficient IO.
 				 */
-				writeback_inodes_wb(&bdi->wb, 1024,
+				writeback_inodes_wb(wb, 1024,
 						    WB_REASON_FORKER_THREAD);
 			} else {
 				/*
@@ -485,7 +536,7 @@ static int bdi_forker_thread(void *ptr)
 				 * can start it.
 				 */
 				spin_lock_bh(&bdi->wb_lock);
-				bdi->wb.task = task;
+				wb->task = task;
 				spin_unlock_bh(&bdi->wb_lock);
 				wake_up_process(task);
 			}
@@ -584,7 +635,8 @@ EXPORT_SYMBOL(bdi_register_dev);
  */
 static void bdi_wb_shutdown(struct backing_dev_info *bdi)
 {
-	struct task_struct *task;
+	struct bdi_writeback *wb;
+	unsigned int i;
 
 	if (!bdi_cap_writeback_dirty(bdi))
 		return;
@@ -601,16 +653,20 @@ static void bdi_wb_shutdown(struct backing_dev_info *bdi)
 			TASK_UNINTERRUPTIBLE);
 
 	/*
-	 * Finally, kill the kernel thread. We don't need to be RCU
+	 * Finally, kill the kernel threads. We don't need to be RCU
 	 * safe anymore, since the bdi is gone from visibility.
 	 */
-	spin_lock_bh(&bdi->wb_lock);
-	task = bdi->wb.task;
-	bdi->wb.task = NULL;
-	spin_unlock_bh(&bdi->wb_lock);
+	bdi_for_each_wb(wb, bdi, i) {
+		struct task_struct *task;
+
+		spin_lock_bh(&bdi->wb_lock);
+		task = wb->task;
+		wb->task = NULL;
+		spin_unlock_bh(&bdi->wb_lock);
 
-	if (task)
-		kthread_stop(task);
+		if (task)
+			kthread_stop(task);
+	}
 }
 
 /*
@@ -631,12 +687,15 @@ static void bdi_prune_sb(struct backing_dev_info *bdi)
 void bdi_unregister(struct backing_dev_info *bdi)
 {
 	struct device *dev = bdi->dev;
+	struct bdi_writeback *wb;
+	unsigned int i;
 
 	if (dev) {
 		bdi_set_min_ratio(bdi, 0);
 		trace_writeback_bdi_unregister(bdi);
 		bdi_prune_sb(bdi);
-		del_timer_sync(&bdi->wb.wakeup_timer);
+		bdi_for_each_wb(wb, bdi, i)
+			del_timer_sync(&wb->wakeup_timer);
 
 		if (!bdi_cap_flush_forker(bdi))
 			bdi_wb_shutdown(bdi);
@@ -651,19 +710,62 @@ void bdi_unregister(struct backing_dev_info *bdi)
 }
 EXPORT_SYMBOL(bdi_unregister);
 
-static void bdi_wb_init(struct bdi_writeback *wb, struct backing_dev_info *bdi)
+static void bdi_wb_init(struct bdi_writeback *wb, struct backing_dev_info *bdi,
+			unsigned int nr)
 {
 	memset(wb, 0, sizeof(*wb));
 
 	wb->bdi = bdi;
+	wb->nr = nr;
 	wb->last_old_flush = jiffies;
 	INIT_LIST_HEAD(&wb->b_dirty);
 	INIT_LIST_HEAD(&wb->b_io);
 	INIT_LIST_HEAD(&wb->b_more_io);
 	spin_lock_init(&wb->list_lock);
-	setup_timer(&wb->wakeup_timer, wakeup_timer_fn, (unsigned long)bdi);
+	setup_timer(&wb->wakeup_timer, wakeup_timer_fn, (unsigned long)wb);
 }
 
+/*
+ * Set the number of flushers newly dirtied inodes of @bdi are spread over.
+ * The extra flushers are allocated on first use and kept until the bdi is
+ * destroyed; inodes already queued stay with the flusher they are on, and
+ * each flusher's thread is forked and reaped on demand like the default one.
+ */
+int bdi_set_flushers(struct backing_dev_info *bdi, unsigned int nr)
+{
+	struct bdi_writeback *extra;
+	unsigned int i;
+
+	if (nr < 1 || nr > BDI_MAX_FLUSHERS)
+		return -EINVAL;
+	if (!bdi_cap_writeback_dirty(bdi) || bdi_cap_flush_forker(bdi))
+		return -EINVAL;
+
+	if (nr > 1 && !bdi->extra_wb) {
+		extra = kcalloc(BDI_MAX_FLUSHERS - 1, sizeof(*extra),
+				GFP_KERNEL);
+		if (!extra)
+			return -ENOMEM;
+		for (i = 1; i < BDI_MAX_FLUSHERS; i++)
+			bdi_wb_init(&extra[i - 1], bdi, i);
+
+		spin_lock_bh(&bdi->wb_lock);
+		if (!bdi->extra_wb) {
+			smp_wmb();
+			bdi->extra_wb = extra;
+			extra = NULL;
+		}
+		spin_unlock_bh(&bdi->wb_lock);
+		kfree(extra);
+	}
+
+	/* make extra_wb visible before anyone hashes inodes onto it */
+	smp_wmb();
+	bdi->nr_flushers = nr;
+	return 0;
+}
+EXPORT_SYMBOL(bdi_set_flushers);
+
 /*
  * Initial write bandwidth: 100 MB/s
  */
@@ -682,7 +784,10 @@ int bdi_init(struct backing_dev_info *bdi)
 	INIT_LIST_HEAD(&bdi->bdi_list);
 	INIT_LIST_HEAD(&bdi->work_list);
 
-	bdi_wb_init(&bdi->wb, bdi);
+	bdi_wb_init(&bdi->wb, bdi, 0);
+	bdi->extra_wb = NULL;
+	bdi->nr_flushers = 1;
+	atomic_set(&bdi->nr_writeback_running, 0);
 
 	for (i = 0; i < NR_BDI_STAT_ITEMS; i++) {
 		err = percpu_counter_init(&bdi->bdi_stat[i], 0);
@@ -712,23 +817,40 @@ err:
 }
 EXPORT_SYMBOL(bdi_init);
 
+/*
+ * Move all inodes of @wb onto @dst's lists, pointing them at @dst.
+ */
+static void bdi_wb_splice(struct bdi_writeback *wb, struct bdi_writeback *dst)
+{
+	struct inode *inode;
+
+	bdi_lock_two(wb, dst);
+	list_for_each_entry(inode, &wb->b_dirty, i_wb_list)
+		inode->i_wb = dst;
+	list_for_each_entry(inode, &wb->b_io, i_wb_list)
+		inode->i_wb = dst;
+	list_for_each_entry(inode, &wb->b_more_io, i_wb_list)
+		inode->i_wb = dst;
+	list_splice_init(&wb->b_dirty, &dst->b_dirty);
+	list_splice_init(&wb->b_io, &dst->b_io);
+	list_splice_init(&wb->b_more_io, &dst->b_more_io);
+	spin_unlock(&wb->list_lock);
+	spin_unlock(&dst->list_lock);
+}
+
 void bdi_destroy(struct backing_dev_info *bdi)
 {
+	struct bdi_writeback *wb;
+	unsigned int nr;
 	int i;
 
 	/*
 	 * Splice our entries to the default_backing_dev_info, if this
 	 * bdi disappears
 	 */
-	if (bdi_has_dirty_io(bdi)) {
-		struct bdi_writeback *dst = &default_backing_dev_info.wb;
-
-		bdi_lock_two(&bdi->wb, dst);
-		list_splice(&bdi->wb.b_dirty, &dst->b_dirty);
-		list_splice(&bdi->wb.b_io, &dst->b_io);
-		list_splice(&bdi->wb.b_more_io, &dst->b_more_io);
-		spin_unlock(&bdi->wb.list_lock);
-		spin_unlock(&dst->list_lock);
+	bdi_for_each_wb(wb, bdi, nr) {
+		if (wb_has_dirty_io(wb))
+			bdi_wb_splice(wb, &default_backing_dev_info.wb);
 	}
 
 	bdi_unregister(bdi);
@@ -736,10 +858,13 @@ void bdi_destroy(struct backing_dev_info *bdi)
 	/*
 	 * If bdi_unregister() had already been called earlier, the
 	 * wakeup_timer could still be armed because bdi_prune_sb()
-	 * can race with the bdi_wakeup_thread_delayed() calls from
+	 * can race with the wb_wakeup_delayed() calls from
 	 * __mark_inode_dirty().
 	 */
-	del_timer_sync(&bdi->wb.wakeup_timer);
+	bdi_for_each_wb(wb, bdi, nr)
+		del_timer_sync(&wb->wakeup_timer);
+	kfree(bdi->extra_wb);
+	bdi->extra_wb = NULL;
 
 	for (i = 0; i < NR_BDI_STAT_ITEMS; i++)
 		percpu_counter_destroy(&bdi->bdi_stat[i]);
@@ -34,6 +34,7 @@
 #include <linux/hardirq.h> /* for BUG_ON(!in_atomic()) only */
 #include <linux/memcontrol.h>
 #include <linux/cleancache.h>
+#include <linux/ksm.h>
 #include "internal.h"
 
 /*
@@ -66,6 +67,10 @@
  *  ->i_mutex
  *    ->i_mmap_mutex		(truncate->unmap_mapping_range)
  *
+ *  ->private_lock		(__set_page_dirty_buffers)
+ *    ->memcg->move_lock	(mem_cgroup_begin_update_page_stat)
+ *      ->mapping->tree_lock	(set_page_dirty, delete_from_page_cache)
+ *
  *  ->mmap_sem
  *    ->i_mmap_mutex
  *      ->page_table_lock or pte_lock	(various, mainly in memory.c)
@@ -77,7 +82,7 @@
  *  ->i_mutex			(generic_file_buffered_write)
  *    ->mmap_sem		(fault_in_pages_readable->do_page_fault)
  *
- *  bdi->wb.list_lock
+ *  wb->list_lock
  *    sb_lock			(fs/fs-writeback.c)
  *    ->mapping->tree_lock	(__sync_single_inode)
  *
@@ -108,7 +113,8 @@
 /*
  * Delete a page from the page cache and free it. Caller has to make
  * sure the page is locked and that nobody else uses it - or that usage
- * is safe.  The caller must hold the mapping's tree_lock.
+ * is safe.  The caller must hold the mapping's tree_lock, taken inside
+ * mem_cgroup_begin_update_page_stat() on the page.
  */
 void __delete_from_page_cache(struct page *page)
 {
@@ -141,6 +147,7 @@ void __delete_from_page_cache(struct page *page)
 	 * having removed the page entirely.
 	 */
 	if (PageDirty(page) && mapping_cap_account_dirty(mapping)) {
+		mem_cgroup_dec_page_stat(page, MEMCG_NR_FILE_DIRTY);
 		dec_zone_page_state(page, NR_FILE_DIRTY);
 		dec_bdi_stat(mapping->backing_dev_info, BDI_RECLAIMABLE);
 	}
@@ -158,13 +165,17 @@ void delete_from_page_cache(struct page *page)
 {
 	struct address_space *mapping = page->mapping;
 	void (*freepage)(struct page *);
+	unsigned long flags, memcg_flags;
+	bool locked;
 
 	BUG_ON(!PageLocked(page));
 
 	freepage = mapping->a_ops->freepage;
-	spin_lock_irq(&mapping->tree_lock);
+	mem_cgroup_begin_update_page_stat(page, &locked, &memcg_flags);
+	spin_lock_irqsave(&mapping->tree_lock, flags);
 	__delete_from_page_cache(page);
-	spin_unlock_irq(&mapping->tree_lock);
+	spin_unlock_irqrestore(&mapping->tree_lock, flags);
+	mem_cgroup_end_update_page_stat(page, &locked, &memcg_flags);
 	mem_cgroup_uncharge_cache_page(page);
 
 	if (freepage)
@@ -401,6 +412,8 @@ int replace_page_cache_page(struct page *old, struct page *new, gfp_t gfp_mask)
 	if (!error) {
 		struct address_space *mapping = old->mapping;
 		void (*freepage)(struct page *);
+		unsigned long flags, memcg_flags;
+		bool locked;
 
 		pgoff_t offset = old->index;
 		freepage = mapping->a_ops->freepage;
@@ -409,7 +422,8 @@ int replace_page_cache_page(struct page *old, struct page *new, gfp_t gfp_mask)
 		new->mapping = mapping;
 		new->index = offset;
 
-		spin_lock_irq(&mapping->tree_lock);
+		mem_cgroup_begin_update_page_stat(old, &locked, &memcg_flags);
+		spin_lock_irqsave(&mapping->tree_lock, flags);
 		__delete_from_page_cache(old);
 		error = radix_tree_insert(&mapping->page_tree, offset, new);
 		BUG_ON(error);
@@ -417,7 +431,8 @@ int replace_page_cache_page(struct page *old, struct page *new, gfp_t gfp_mask)
 		__inc_zone_page_state(new, NR_FILE_PAGES);
 		if (PageSwapBacked(new))
 			__inc_zone_page_state(new, NR_SHMEM);
-		spin_unlock_irq(&mapping->tree_lock);
+		spin_unlock_irqrestore(&mapping->tree_lock, flags);
+		mem_cgroup_end_update_page_stat(old, &locked, &memcg_flags);
 		/* mem_cgroup codes must not be called under tree_lock */
 		mem_cgroup_replace_page_cache(old, new);
 		radix_tree_preload_end();
@@ -430,6 +445,42 @@ int replace_page_cache_page(struct page *old, struct page *new, gfp_t gfp_mask)
 }
 EXPORT_SYMBOL_GPL(replace_page_cache_page);
 
+/**
+ * page_cache_take_anon_page - turn an unmapped anon page into a file page
+ * @page: locked anonymous page, referenced only by the caller
+ *
+ * Detaches @page from its anon_vma and memcg charge and takes it off the
+ * LRU, so that it can be inserted into the page cache with
+ * replace_page_cache_page() and then added to the file LRU by the caller.
+ * Used when splice steals a page that was gifted with vmsplice().  Returns
+ * -EBUSY if the page is still mapped, in the swap cache, shared by KSM or
+ * not on the LRU.
+ */
+int page_cache_take_anon_page(struct page *page)
+{
+	VM_BUG_ON(!PageLocked(page));
+
+	if (!PageAnon(page) || PageKsm(page) || PageSwapCache(page) ||
+	    page_mapped(page))
+		return -EBUSY;
+
+	if (isolate_lru_page(page))
+		return -EBUSY;
+
+	/* replace_page_cache_page() charges it as cache instead */
+	mem_cgroup_uncharge_page(page);
+	page->mapping = NULL;
+	ClearPageSwapBacked(page);
+	/* it starts out on the inactive file list like any new page */
+	ClearPageActive(page);
+	/* not accounted for anon pages, ->write_end() will redirty it */
+	ClearPageDirty(page);
+	/* drop the isolation reference, the caller holds its own */
+	put_page(page);
+	return 0;
+}
+EXPORT_SYMBOL_GPL(page_cache_take_anon_page);
+
 /**
  * add_to_page_cache_locked - add a locked page to the pagecache
  * @page:	page to add
@@ -492,8 +543,100 @@ int add_to_page_cache_lru(struct page *page, struct address_space *mapping,
 }
 EXPORT_SYMBOL_GPL(add_to_page_cache_lru);
 
+/**
+ * add_to_page_cache_lru_batch - add newly allocated pages to the pagecache
+ * @mapping:	the pages' address_space
+ * @pages:	the pages, with ->index set
+ * @nr:		number of pages, at most PAGE_CACHE_ADD_BATCH
+ * @gfp_mask:	page allocation mode
+ *
+ * Like add_to_page_cache_lru() on each of @pages, but the radix tree is
+ * preloaded once and mapping->tree_lock taken once for the whole batch,
+ * which is what readahead wants when many tasks fault in the same file.
+ *
+ * The pages that were added are packed at the start of @pages, locked and
+ * still holding the caller's reference.  The pages that could not be added
+ * (typically because they raced with somebody else's) are released.
+ * Returns the number of pages added.
+ */
+unsigned add_to_page_cache_lru_batch(struct address_space *mapping,
+				struct page **pages, unsigned nr, gfp_t gfp_mask)
+{
+	unsigned i, added = 0;
+	LIST_HEAD(failed);
+	int error;
+
+	VM_BUG_ON(nr > PAGE_CACHE_ADD_BATCH);
+
+	for (i = 0; i < nr; i++) {
+		struct page *page = pages[i];
+
+		VM_BUG_ON(PageSwapBacked(page));
+		if (mem_cgroup_cache_charge(page, current->mm,
+					    gfp_mask & GFP_RECLAIM_MASK)) {
+			page_cache_release(page);
+			continue;
+		}
+		pages[added++] = page;
+	}
+	nr = added;
+	if (!nr)
+		return 0;
+
+	/*
+	 * The batch is a readahead window, so a single preload normally
+	 * covers all the nodes it needs; the radix tree falls back to
+	 * atomic allocations if not, and a page that still can't be
+	 * inserted is simply not read ahead.
+	 */
+	error = radix_tree_preload(gfp_mask & ~__GFP_HIGHMEM);
+	if (error) {
+		for (i = 0; i < nr; i++) {
+			mem_cgroup_uncharge_cache_page(pages[i]);
+			page_cache_release(pages[i]);
+		}
+		return 0;
+	}
+
+	added = 0;
+	spin_lock_irq(&mapping->tree_lock);
+	for (i = 0; i < nr; i++) {
+		struct page *page = pages[i];
+
+		__set_page_locked(page);
+		page->mapping = mapping;
+		error = radix_tree_insert(&mapping->page_tree, page->index,
+					  page);
+		if (unlikely(error)) {
+			page->mapping = NULL;
+			__clear_page_locked(page);
+			/* mem_cgroup codes must not be called under tree_lock */
+			list_add(&page->lru, &failed);
+			continue;
+		}
+		page_cache_get(page);
+		mapping->nrpages++;
+		__inc_zone_page_state(page, NR_FILE_PAGES);
+		pages[added++] = page;
+	}
+	spin_unlock_irq(&mapping->tree_lock);
+	radix_tree_preload_end();
+
+	while (!list_empty(&failed)) {
+		struct page *page = list_first_entry(&failed, struct page, lru);
+
+		list_del(&page->lru);
+		mem_cgroup_uncharge_cache_page(page);
+		page_cache_release(page);
+	}
+	for (i = 0; i < added; i++)
+		lru_cache_add_file(pages[i]);
+	return added;
+}
+EXPORT_SYMBOL_GPL(add_to_page_cache_lru_batch);
+
 #ifdef CONFIG_NUMA
-struct page *__page_cache_alloc(gfp_t gfp)
+struct page *__page_cache_alloc_order(gfp_t gfp, unsigned int order)
 {
 	int n;
 	struct page *page;
@@ -503,14 +646,14 @@ struct page *__page_cache_alloc(gfp_t gfp)
 		do {
 			cpuset_mems_cookie = get_mems_allowed();
 			n = cpuset_mem_spread_node();
-			page = alloc_pages_exact_node(n, gfp, 0);
+			page = alloc_pages_exact_node(n, gfp, order);
 		} while (!put_mems_allowed(cpuset_mems_cookie) && !page);
 
 		return page;
 	}
-	return alloc_pages(gfp, 0);
+	return alloc_pages(gfp, order);
 }
-EXPORT_SYMBOL(__page_cache_alloc);
+EXPORT_SYMBOL(__page_cache_alloc_order);
 #endif
 
 /*
@@ -1066,6 +1209,44 @@ static void shrink_readahead_size_eio(struct file *filp,
 	ra->ra_pages /= 4;
 }
 
+/*
+ * Reads spanning several pages of a mapping with large page cache units
+ * look the pages up a pagevec at a time instead of walking the radix tree
+ * once per page.  @pvec holds references on the pages from
+ * @pvec->pages[*next] on: hand out the one for @index if it is next in
+ * line, otherwise drop the batch and gang-lookup a new one at @index.
+ */
+static struct page *find_get_page_batched(struct address_space *mapping,
+					  pgoff_t index, pgoff_t last_index,
+					  struct pagevec *pvec,
+					  unsigned int *next)
+{
+	struct page *page;
+	unsigned int nr;
+
+	if (*next < pagevec_count(pvec)) {
+		page = pvec->pages[*next];
+		if (page->index == index) {
+			(*next)++;
+			return page;
+		}
+	}
+	while (*next < pagevec_count(pvec))
+		page_cache_release(pvec->pages[(*next)++]);
+	pagevec_reinit(pvec);
+	*next = 0;
+
+	if (!mapping_large_units(mapping) || last_index <= index + 1)
+		return find_get_page(mapping, index);
+
+	nr = min_t(pgoff_t, last_index - index, PAGEVEC_SIZE);
+	pvec->nr = find_get_pages_contig(mapping, index, nr, pvec->pages);
+	if (!pvec->nr)
+		return NULL;
+	*next = 1;
+	return pvec->pages[0];
+}
+
 /**
  * do_generic_file_read - generic file read routine
  * @filp:	the file to read
@@ -1090,8 +1271,11 @@ static void do_generic_file_read(struct file *filp, loff_t *ppos,
 	pgoff_t prev_index;
 	unsigned long offset;      /* offset into pagecache page */
 	unsigned int prev_offset;
+	struct pagevec pvec;
+	unsigned int pvec_next = 0;
 	int error;
 
+	pagevec_init(&pvec, 0);
 	index = *ppos >> PAGE_CACHE_SHIFT;
 	prev_index = ra->prev_pos >> PAGE_CACHE_SHIFT;
 	prev_offset = ra->prev_pos & (PAGE_CACHE_SIZE-1);
@@ -1106,7 +1290,8 @@ static void do_generic_file_read(struct file *filp, loff_t *ppos,
 
 		cond_resched();
 find_page:
-		page = find_get_page(mapping, index);
+		page = find_get_page_batched(mapping, index, last_index,
+					     &pvec, &pvec_next);
 		if (!page) {
 			page_cache_sync_readahead(mapping,
 					ra, filp,
@@ -1288,6 +1473,9 @@ no_cached_page:
 	}
 
 out:
+	while (pvec_next < pagevec_count(&pvec))
+		page_cache_release(pvec.pages[pvec_next++]);
+
 	ra->prev_pos = prev_index;
 	ra->prev_pos <<= PAGE_CACHE_SHIFT;
 	ra->prev_pos |= prev_offset;
@@ -87,6 +87,8 @@ enum mem_cgroup_stat_index {
 	MEM_CGROUP_STAT_CACHE, 	   /* # of pages charged as cache */
 	MEM_CGROUP_STAT_RSS,	   /* # of pages charged as anon rss */
 	MEM_CGROUP_STAT_FILE_MAPPED,  /* # of pages charged as file rss */
+	MEM_CGROUP_STAT_FILE_DIRTY,  /* # of dirty pages in page cache */
+	MEM_CGROUP_STAT_WRITEBACK,  /* # of pages under writeback */
 	MEM_CGROUP_STAT_SWAPOUT, /* # of pages, swapped out */
 	MEM_CGROUP_STAT_DATA, /* end of data requires synchronization */
 	MEM_CGROUP_STAT_NSTATS,
@@ -251,6 +253,11 @@ struct mem_cgroup {
 		struct work_struct work_freeing;
 	};
 
+	/*
+	 * the counter to account for kernel memory usage.
+	 */
+	struct res_counter kmem;
+
 	/*
 	 * Per cgroup active and inactive list, similar to the
 	 * per zone LRU lists.
@@ -316,6 +323,14 @@ struct mem_cgroup {
 #ifdef CONFIG_INET
 	struct tcp_memcontrol tcp_mem;
 #endif
+#ifdef CONFIG_CGROUP_MEM_RES_CTLR_KMEM
+	/* set once kmem.limit_in_bytes has been written */
+	bool kmem_active;
+#endif
+#ifdef CONFIG_CGROUP_MEM_RES_CTLR_KMEM_SLAB
+	/* slab cache clones of this memcg, under memcg_cache_mutex */
+	struct list_head kmem_caches;
+#endif
 };
 
 /* Stuffs for move charges at task migration. */
@@ -377,6 +392,7 @@ enum charge_type {
 #define _MEM			(0)
 #define _MEMSWAP		(1)
 #define _OOM_TYPE		(2)
+#define _KMEM			(3)
 #define MEMFILE_PRIVATE(x, val)	(((x) << 16) | (val))
 #define MEMFILE_TYPE(val)	(((val) >> 16) & 0xffff)
 #define MEMFILE_ATTR(val)	((val) & 0xffff)
@@ -1975,6 +1991,12 @@ void mem_cgroup_update_page_stat(struct page *page,
 	case MEMCG_NR_FILE_MAPPED:
 		idx = MEM_CGROUP_STAT_FILE_MAPPED;
 		break;
+	case MEMCG_NR_FILE_DIRTY:
+		idx = MEM_CGROUP_STAT_FILE_DIRTY;
+		break;
+	case MEMCG_NR_FILE_WRITEBACK:
+		idx = MEM_CGROUP_STAT_WRITEBACK;
+		break;
 	default:
 		BUG();
 	}
@@ -2545,6 +2567,480 @@ static void __mem_cgroup_commit_charge(struct mem_cgroup *memcg,
 	memcg_check_events(memcg, page);
 }
 
+#ifdef CONFIG_CGROUP_MEM_RES_CTLR_KMEM
+bool mem_cgroup_kmem_active(struct mem_cgroup *memcg)
+{
+	return memcg->kmem_active;
+}
+
+#ifdef CONFIG_CGROUP_MEM_RES_CTLR_KMEM_SLAB
+static unsigned long memcg_shrink_kmem(struct mem_cgroup *memcg, gfp_t gfp)
+{
+	u64 usage = res_counter_read_u64(&memcg->kmem, RES_USAGE);
+
+	return try_to_free_mem_cgroup_kmem(memcg, gfp, usage >> PAGE_SHIFT);
+}
+#else
+static unsigned long memcg_shrink_kmem(struct mem_cgroup *memcg, gfp_t gfp)
+{
+	return 0;
+}
+#endif
+
+/*
+ * Kernel memory is charged to memcg->kmem first, whose limit can only be
+ * helped by shrinking the slab objects charged to the cgroup, and then to
+ * memcg->res like user pages, so that it counts against both limits.
+ */
+static int memcg_charge_kmem(struct mem_cgroup *memcg, gfp_t gfp, u64 size)
+{
+	int nr_retries = MEM_CGROUP_RECLAIM_RETRIES;
+	struct res_counter *fail_res;
+	struct mem_cgroup *_memcg;
+	int ret;
+
+	while (res_counter_charge(&memcg->kmem, size, &fail_res)) {
+		if (!(gfp & __GFP_WAIT) || !nr_retries--)
+			return -ENOMEM;
+		if (!memcg_shrink_kmem(mem_cgroup_from_res_counter(fail_res,
+								   kmem), gfp))
+			return -ENOMEM;
+	}
+
+	_memcg = memcg;
+	ret = __mem_cgroup_try_charge(NULL, gfp, size >> PAGE_SHIFT,
+				      &_memcg, false);
+	if (ret == -EINTR) {
+		/*
+		 * The task is dying and __mem_cgroup_try_charge() let it
+		 * bypass the limit.  Do the same for kernel memory, but
+		 * charge res anyway so that the uncharge stays balanced.
+		 */
+		res_counter_charge_nofail(&memcg->res, size, &fail_res);
+		if (do_swap_account)
+			res_counter_charge_nofail(&memcg->memsw, size,
+						  &fail_res);
+		ret = 0;
+	} else if (ret)
+		res_counter_uncharge(&memcg->kmem, size);
+
+	return ret;
+}
+
+static void memcg_uncharge_kmem(struct mem_cgroup *memcg, u64 size)
+{
+	res_counter_uncharge(&memcg->res, size);
+	if (do_swap_account)
+		res_counter_uncharge(&memcg->memsw, size);
+	res_counter_uncharge(&memcg->kmem, size);
+}
+
+/*
+ * Charge pages allocated with alloc_kmem_pages() to the current task's
+ * memcg.  On success *@memcgp is the memcg to pass to
+ * memcg_kmem_commit_charge(), or NULL if nothing was charged.
+ */
+int memcg_kmem_newpage_charge(gfp_t gfp, struct mem_cgroup **memcgp,
+			      int order)
+{
+	struct mem_cgroup *memcg;
+	int ret;
+
+	*memcgp = NULL;
+
+	/* Kernel threads are not accounted, nor is the root cgroup */
+	if (mem_cgroup_disabled() || !current->mm ||
+	    (current->flags & PF_KTHREAD))
+		return 0;
+
+	rcu_read_lock();
+	memcg = mem_cgroup_from_task(current);
+	if (!memcg || !memcg->kmem_active || !css_tryget(&memcg->css)) {
+		rcu_read_unlock();
+		return 0;
+	}
+	rcu_read_unlock();
+
+	ret = memcg_charge_kmem(memcg, gfp, PAGE_SIZE << order);
+	if (!ret) {
+		/* Keep the memcg around until the pages are freed */
+		mem_cgroup_get(memcg);
+		*memcgp = memcg;
+	}
+	css_put(&memcg->css);
+	return ret;
+}
+
+void memcg_kmem_commit_charge(struct page *page, struct mem_cgroup *memcg,
+			      int order)
+{
+	struct page_cgroup *pc;
+
+	if (!memcg)
+		return;
+
+	/* The allocation failed after all */
+	if (!page) {
+		memcg_uncharge_kmem(memcg, PAGE_SIZE << order);
+		mem_cgroup_put(memcg);
+		return;
+	}
+
+	pc = lookup_page_cgroup(page);
+	lock_page_cgroup(pc);
+	pc->mem_cgroup = memcg;
+	SetPageCgroupUsed(pc);
+	unlock_page_cgroup(pc);
+}
+
+void memcg_kmem_uncharge_pages(struct page *page, int order)
+{
+	struct mem_cgroup *memcg;
+	struct page_cgroup *pc;
+
+	if (mem_cgroup_disabled())
+		return;
+
+	pc = lookup_page_cgroup(page);
+	if (!PageCgroupUsed(pc))
+		return;
+
+	lock_page_cgroup(pc);
+	memcg = pc->mem_cgroup;
+	ClearPageCgroupUsed(pc);
+	unlock_page_cgroup(pc);
+
+	memcg_uncharge_kmem(memcg, PAGE_SIZE << order);
+	mem_cgroup_put(memcg);
+}
+#endif /* CONFIG_CGROUP_MEM_RES_CTLR_KMEM */
+
+#ifdef CONFIG_CGROUP_MEM_RES_CTLR_KMEM_SLAB
+/*
+ * Per-memcg clones of SLAB_ACCOUNT caches.
+ *
+ * The first allocation of a task from a root cache queues the creation
+ * of its memcg's clone and is served from the root cache; allocations
+ * find the clone in the root cache's memcg_caches array afterwards.
+ * When the memcg is destroyed its clones are retired: unpublished, made
+ * to free their empty slabs, and moved to memcg_retired_caches, where
+ * they wait for their last slab to be freed before being destroyed.
+ *
+ * A clone's nr_slabs is biased by one until it is retired, so that only
+ * a retired clone can ever see it drop to zero.  Each clone holds a
+ * reference to its memcg.
+ */
+struct memcg_cache_array {
+	struct rcu_head rcu;
+	int size;
+	struct kmem_cache *caches[0];
+};
+
+#define MEMCG_CACHES_MIN_SIZE	64
+
+struct memcg_create_work {
+	struct mem_cgroup *memcg;
+	struct kmem_cache *cachep;
+	struct work_struct work;
+};
+
+struct static_key memcg_kmem_enabled_key;
+
+/* protects memcg_caches, children, and the memcg and retired lists */
+static DEFINE_MUTEX(memcg_cache_mutex);
+static LIST_HEAD(memcg_retired_caches);
+
+static atomic_t memcg_cache_creates = ATOMIC_INIT(0);
+static DECLARE_WAIT_QUEUE_HEAD(memcg_cache_create_wait);
+
+static void memcg_reap_caches(struct work_struct *work);
+static DECLARE_WORK(memcg_reap_work, memcg_reap_caches);
+
+static struct memcg_cache_array *memcg_cache_array(struct kmem_cache *root)
+{
+	return rcu_dereference_protected(root->memcg_params->memcg_caches,
+					 lockdep_is_held(&memcg_cache_mutex));
+}
+
+static int memcg_cache_array_grow(struct kmem_cache *root, int id)
+{
+	struct memcg_cache_array *old, *new;
+	int size;
+
+	old = memcg_cache_array(root);
+	if (old && id < old->size)
+		return 0;
+
+	size = max_t(int, roundup_pow_of_two(id + 1), MEMCG_CACHES_MIN_SIZE);
+	new = kzalloc(sizeof(*new) + size * sizeof(new->caches[0]),
+		      GFP_KERNEL);
+	if (!new)
+		return -ENOMEM;
+	new->size = size;
+	if (old)
+		memcpy(new->caches, old->caches,
+		       old->size * sizeof(old->caches[0]));
+	rcu_assign_pointer(root->memcg_params->memcg_caches, new);
+	if (old)
+		kfree_rcu(old, rcu);
+	return 0;
+}
+
+static void memcg_create_cache(struct mem_cgroup *memcg,
+			       struct kmem_cache *root)
+{
+	struct memcg_cache_params *params;
+	struct kmem_cache *cachep;
+	int id = css_id(&memcg->css);
+	char *name;
+
+	mutex_lock(&memcg_cache_mutex);
+	if (memcg_cache_array_grow(root, id))
+		goto out;
+	/* Raced with an earlier request */
+	if (memcg_cache_array(root)->caches[id])
+		goto out;
+
+	params = kzalloc(sizeof(*params), GFP_KERNEL);
+	name = kasprintf(GFP_KERNEL, "%s(%d)", root->name, id);
+	if (!params || !name)
+		goto out_free;
+
+	params->memcg = memcg;
+	params->root_cache = root;
+	atomic_set(&params->nr_slabs, 1);
+	cachep = kmem_cache_create_memcg(root, name, params);
+	if (!cachep)
+		goto out_free;
+	params->cachep = cachep;
+
+	mem_cgroup_get(memcg);
+	list_add(&params->list, &memcg->kmem_caches);
+	list_add(&params->siblings, &root->memcg_params->children);
+	rcu_assign_pointer(memcg_cache_array(root)->caches[id], cachep);
+	goto out;
+out_free:
+	kfree(name);
+	kfree(params);
+out:
+	mutex_unlock(&memcg_cache_mutex);
+}
+
+static void memcg_create_cache_work_func(struct work_struct *w)
+{
+	struct memcg_create_work *cw;
+
+	cw = container_of(w, struct memcg_create_work, work);
+	memcg_create_cache(cw->memcg, cw->cachep);
+	css_put(&cw->memcg->css);
+	kfree(cw);
+
+	if (atomic_dec_and_test(&memcg_cache_creates))
+		wake_up_all(&memcg_cache_create_wait);
+}
+
+/*
+ * kmem_cache_create() sleeps and takes locks allocations may be nested
+ * in, so clones are created from a work item.  Consumes the caller's
+ * reference to @memcg's css.
+ */
+static void memcg_create_cache_enqueue(struct mem_cgroup *memcg,
+				       struct kmem_cache *cachep)
+{
+	struct memcg_create_work *cw;
+
+	cw = kmalloc(sizeof(*cw), GFP_NOWAIT | __GFP_NOWARN);
+	if (!cw) {
+		css_put(&memcg->css);
+		return;
+	}
+
+	cw->memcg = memcg;
+	cw->cachep = cachep;
+	INIT_WORK(&cw->work, memcg_create_cache_work_func);
+	atomic_inc(&memcg_cache_creates);
+	schedule_work(&cw->work);
+}
+
+/*
+ * Return the clone of SLAB_ACCOUNT cache @cachep to allocate from on
+ * behalf of the current task, with a reference to its memcg's css that
+ * __memcg_kmem_put_cache() drops, or @cachep itself if the allocation
+ * is not accounted.
+ */
+struct kmem_cache *__memcg_kmem_get_cache(struct kmem_cache *cachep,
+					  gfp_t gfp)
+{
+	struct memcg_cache_array *arr;
+	struct kmem_cache *memcg_cachep = NULL;
+	struct mem_cgroup *memcg;
+	int id;
+
+	VM_BUG_ON(!cachep->memcg_params->is_root_cache);
+
+	if (in_interrupt() || !current->mm || (current->flags & PF_KTHREAD))
+		return cachep;
+	/* A __GFP_NOFAIL allocation must not hit the kmem limit */
+	if (gfp & __GFP_NOFAIL)
+		return cachep;
+
+	rcu_read_lock();
+	memcg = mem_cgroup_from_task(current);
+	if (!memcg || !memcg->kmem_active || !css_tryget(&memcg->css)) {
+		rcu_read_unlock();
+		return cachep;
+	}
+	id = css_id(&memcg->css);
+	arr = rcu_dereference(cachep->memcg_params->memcg_caches);
+	if (arr && id < arr->size)
+		memcg_cachep = rcu_dereference(arr->caches[id]);
+	rcu_read_unlock();
+
+	if (likely(memcg_cachep))
+		return memcg_cachep;
+
+	memcg_create_cache_enqueue(memcg, cachep);
+	return cachep;
+}
+
+void __memcg_kmem_put_cache(struct kmem_cache *cachep)
+{
+	css_put(&cachep->memcg_params->memcg->css);
+}
+
+int memcg_charge_slab(struct kmem_cache *cachep, gfp_t gfp, int order)
+{
+	struct memcg_cache_params *params = cachep->memcg_params;
+	int ret;
+
+	ret = memcg_charge_kmem(params->memcg, gfp, PAGE_SIZE << order);
+	if (!ret)
+		atomic_inc(&params->nr_slabs);
+	return ret;
+}
+
+void memcg_uncharge_slab(struct kmem_cache *cachep, int order)
+{
+	struct memcg_cache_params *params = cachep->memcg_params;
+
+	memcg_uncharge_kmem(params->memcg, PAGE_SIZE << order);
+	if (atomic_dec_and_test(&params->nr_slabs))
+		schedule_work(&memcg_reap_work);
+}
+
+/* Called on cache creation: give SLAB_ACCOUNT caches their params */
+void memcg_register_cache(struct kmem_cache *cachep)
+{
+	struct memcg_cache_params *params;
+
+	if (!(cachep->flags & SLAB_ACCOUNT))
+		return;
+
+	/* Without params the cache simply is not accounted */
+	params = kzalloc(sizeof(*params), GFP_KERNEL);
+	if (!params)
+		return;
+	params->is_root_cache = true;
+	INIT_LIST_HEAD(&params->children);
+	cachep->memcg_params = params;
+}
+
+/* Called with memcg_cache_mutex held */
+static void memcg_destroy_cache(struct memcg_cache_params *params)
+{
+	struct mem_cgroup *memcg = params->memcg;
+
+	list_del(&params->list);
+	list_del(&params->siblings);
+	kmem_cache_destroy(params->cachep);
+	mem_cgroup_put(memcg);
+}
+
+static void memcg_reap_caches(struct work_struct *work)
+{
+	struct memcg_cache_params *params, *tmp;
+
+	mutex_lock(&memcg_cache_mutex);
+	list_for_each_entry_safe(params, tmp, &memcg_retired_caches, list)
+		if (!atomic_read(&params->nr_slabs))
+			memcg_destroy_cache(params);
+	mutex_unlock(&memcg_cache_mutex);
+}
+
+/*
+ * Called when a root cache is destroyed, by which time all its objects
+ * have been freed: destroy its clones, live or retired.
+ */
+void memcg_destroy_cache_clones(struct kmem_cache *cachep)
+{
+	struct memcg_cache_params *params, *tmp;
+
+	if (!cachep->memcg_params || !cachep->memcg_params->is_root_cache)
+		return;
+
+	wait_event(memcg_cache_create_wait, !atomic_read(&memcg_cache_creates));
+
+	mutex_lock(&memcg_cache_mutex);
+	list_for_each_entry_safe(params, tmp,
+				 &cachep->memcg_params->children, siblings)
+		memcg_destroy_cache(params);
+	mutex_unlock(&memcg_cache_mutex);
+}
+
+/* Called when the kmem_cache itself is freed */
+void memcg_release_cache(struct kmem_cache *cachep)
+{
+	struct memcg_cache_params *params = cachep->memcg_params;
+
+	if (!params)
+		return;
+	if (params->is_root_cache)
+		kfree(rcu_access_pointer(params->memcg_caches));
+	kfree(params);
+}
+
+static void memcg_retire_caches(struct mem_cgroup *memcg)
+{
+	struct memcg_cache_params *params, *tmp;
+	int id = css_id(&memcg->css);
+
+	mutex_lock(&memcg_cache_mutex);
+	list_for_each_entry_safe(params, tmp, &memcg->kmem_caches, list) {
+		rcu_assign_pointer(memcg_cache_array(params->root_cache)->caches[id],
+				   NULL);
+		kmem_cache_retire(params->cachep);
+		list_move(&params->list, &memcg_retired_caches);
+		atomic_dec(&params->nr_slabs);
+	}
+	mutex_unlock(&memcg_cache_mutex);
+
+	schedule_work(&memcg_reap_work);
+}
+
+/*
+ * Whether the slab object @obj is charged to @memcg, or to one of its
+ * children when use_hierarchy is set.  For memcg aware shrinkers.
+ */
+bool mem_cgroup_kmem_match(struct mem_cgroup *memcg, void *obj)
+{
+	struct page *page = virt_to_head_page(obj);
+	struct memcg_cache_params *params;
+	struct mem_cgroup *iter;
+
+	if (!PageSlab(page))
+		return false;
+
+	params = page->slab->memcg_params;
+	if (!params || params->is_root_cache)
+		return false;
+
+	for (iter = params->memcg; iter; iter = parent_mem_cgroup(iter))
+		if (iter == memcg)
+			return true;
+	return false;
+}
+#endif /* CONFIG_CGROUP_MEM_RES_CTLR_KMEM_SLAB */
+
 #ifdef CONFIG_TRANSPARENT_HUGEPAGE
 
 #define PCGF_NOCOPY_AT_SPLIT ((1 << PCG_LOCK) | (1 << PCG_MIGRATION))
@@ -2627,6 +3123,18 @@ static int mem_cgroup_move_account(struct page *page,
 		__this_cpu_inc(to->stat->count[MEM_CGROUP_STAT_FILE_MAPPED]);
 		preempt_enable();
 	}
+	if (!anon && PageDirty(page)) {
+		preempt_disable();
+		__this_cpu_dec(from->stat->count[MEM_CGROUP_STAT_FILE_DIRTY]);
+		__this_cpu_inc(to->stat->count[MEM_CGROUP_STAT_FILE_DIRTY]);
+		preempt_enable();
+	}
+	if (!anon && PageWriteback(page)) {
+		preempt_disable();
+		__this_cpu_dec(from->stat->count[MEM_CGROUP_STAT_WRITEBACK]);
+		__this_cpu_inc(to->stat->count[MEM_CGROUP_STAT_WRITEBACK]);
+		preempt_enable();
+	}
 	mem_cgroup_charge_statistics(from, anon, -nr_pages);
 	if (uncharge)
 		/* This is not "cancel", but cancel_charge does all we need. */
@@ -3707,6 +4215,18 @@ static int mem_cgroup_force_empty_list(struct mem_cgroup *memcg,
 	return ret;
 }
 
+/*
+ * Kernel memory can neither be moved nor reclaimed by force_empty; it
+ * stays charged until it is freed, which keeps the memcg around.
+ */
+static u64 mem_cgroup_user_usage(struct mem_cgroup *memcg)
+{
+	u64 usage = res_counter_read_u64(&memcg->res, RES_USAGE);
+	u64 kmem = res_counter_read_u64(&memcg->kmem, RES_USAGE);
+
+	return usage > kmem ? usage - kmem : 0;
+}
+
 /*
  * make mem_cgroup's charge to be 0 if there is no task.
  * This enables deleting this mem_cgroup.
@@ -3757,7 +4277,7 @@ move_account:
 			goto try_to_free;
 		cond_resched();
 	/* "ret" should also be checked to ensure all lists are empty. */
-	} while (res_counter_read_u64(&memcg->res, RES_USAGE) > 0 || ret);
+	} while (mem_cgroup_user_usage(memcg) > 0 || ret);
 out:
 	css_put(&memcg->css);
 	return ret;
@@ -3772,7 +4292,7 @@ try_to_free:
 	lru_add_drain_all();
 	/* try to free all pages in this cgroup */
 	shrink = 1;
-	while (nr_retries && res_counter_read_u64(&memcg->res, RES_USAGE) > 0) {
+	while (nr_retries && mem_cgroup_user_usage(memcg) > 0) {
 		int progress;
 
 		if (signal_pending(current)) {
@@ -3873,6 +4393,78 @@ static inline u64 mem_cgroup_usage(struct mem_cgroup *memcg, bool swap)
 	return val << PAGE_SHIFT;
 }
 
+#ifdef CONFIG_CGROUP_MEM_RES_CTLR_KMEM
+static void memcg_kmem_activate(struct mem_cgroup *memcg)
+{
+	memcg->kmem_active = true;
+#ifdef CONFIG_CGROUP_MEM_RES_CTLR_KMEM_SLAB
+	static_key_slow_inc(&memcg_kmem_enabled_key);
+#endif
+}
+
+static void memcg_kmem_deactivate(struct mem_cgroup *memcg)
+{
+#ifdef CONFIG_CGROUP_MEM_RES_CTLR_KMEM_SLAB
+	memcg_retire_caches(memcg);
+	if (memcg->kmem_active)
+		static_key_slow_dec(&memcg_kmem_enabled_key);
+#endif
+	memcg->kmem_active = false;
+}
+
+/*
+ * Kernel memory is accounted from the first time a limit is set on it,
+ * and for the rest of the memcg's life: charges taken before that
+ * could never be uncharged correctly.
+ */
+static int memcg_update_kmem_limit(struct mem_cgroup *memcg, u64 val)
+{
+	int ret;
+
+	mutex_lock(&set_limit_mutex);
+	ret = res_counter_set_limit(&memcg->kmem, val);
+	if (!ret && val != RESOURCE_MAX && !memcg->kmem_active)
+		memcg_kmem_activate(memcg);
+	mutex_unlock(&set_limit_mutex);
+	return ret;
+}
+
+static void memcg_init_kmem(struct mem_cgroup *memcg,
+			    struct mem_cgroup *parent)
+{
+#ifdef CONFIG_CGROUP_MEM_RES_CTLR_KMEM_SLAB
+	INIT_LIST_HEAD(&memcg->kmem_caches);
+#endif
+	/* children of an accounted parent are accounted from birth */
+	mutex_lock(&set_limit_mutex);
+	if (parent && parent->use_hierarchy && parent->kmem_active)
+		memcg_kmem_activate(memcg);
+	mutex_unlock(&set_limit_mutex);
+}
+#else
+static int memcg_update_kmem_limit(struct mem_cgroup *memcg, u64 val)
+{
+	return -EINVAL;
+}
+
+static void memcg_init_kmem(struct mem_cgroup *memcg,
+			    struct mem_cgroup *parent)
+{
+}
+#endif /* CONFIG_CGROUP_MEM_RES_CTLR_KMEM */
+
+static struct res_counter *memcg_counter(struct mem_cgroup *memcg, int type)
+{
+	switch (type) {
+	case _MEMSWAP:
+		return &memcg->memsw;
+	case _KMEM:
+		return &memcg->kmem;
+	default:
+		return &memcg->res;
+	}
+}
+
 static u64 mem_cgroup_read(struct cgroup *cont, struct cftype *cft)
 {
 	struct mem_cgroup *memcg = mem_cgroup_from_cont(cont);
@@ -3894,6 +4486,9 @@ static u64 mem_cgroup_read(struct cgroup *cont, struct cftype *cft)
 		else
 			val = res_counter_read_u64(&memcg->memsw, name);
 		break;
+	case _KMEM:
+		val = res_counter_read_u64(&memcg->kmem, name);
+		break;
 	default:
 		BUG();
 	}
@@ -3925,8 +4520,10 @@ static int mem_cgroup_write(struct cgroup *cont, struct cftype *cft,
 			break;
 		if (type == _MEM)
 			ret = mem_cgroup_resize_limit(memcg, val);
-		else
+		else if (type == _MEMSWAP)
 			ret = mem_cgroup_resize_memsw_limit(memcg, val);
+		else
+			ret = memcg_update_kmem_limit(memcg, val);
 		break;
 	case RES_SOFT_LIMIT:
 		ret = res_counter_memparse_write_strategy(buffer, &val);
@@ -3976,6 +4573,58 @@ out:
 	*memsw_limit = min_memsw_limit;
 }
 
+/**
+ * mem_cgroup_dirty_info - dirty limits and usage of current's memcg
+ * @dirtyable: system-wide dirtyable memory, in pages
+ * @background_thresh: system-wide background writeback threshold
+ * @dirty_thresh: system-wide dirty throttling threshold
+ * @info: filled in on success
+ *
+ * A memcg may keep dirty the same share of the memory it is limited to as
+ * the whole system may of its dirtyable memory, so the global thresholds
+ * are scaled down by the ratio of the two.  Returns false if current is
+ * not in a memcg whose (hierarchical) limit is below @dirtyable, in which
+ * case only the global limits apply.
+ */
+bool mem_cgroup_dirty_info(unsigned long dirtyable,
+			   unsigned long background_thresh,
+			   unsigned long dirty_thresh,
+			   struct mem_cgroup_dirty_info *info)
+{
+	unsigned long long limit, memsw_limit;
+	struct mem_cgroup *memcg;
+	long val;
+	bool ret = false;
+
+	if (mem_cgroup_disabled() || !dirtyable)
+		return false;
+
+	memcg = try_get_mem_cgroup_from_mm(current->mm);
+	if (!memcg)
+		return false;
+	if (mem_cgroup_is_root(memcg))
+		goto out;
+
+	memcg_get_hierarchical_limit(memcg, &limit, &memsw_limit);
+	limit >>= PAGE_SHIFT;
+	if (limit >= dirtyable)
+		goto out;
+
+	info->dirty_thresh = div_u64(dirty_thresh * limit, dirtyable);
+	info->background_thresh = div_u64(background_thresh * limit,
+					  dirtyable);
+	/* the per-cpu counters may transiently sum below zero */
+	val = mem_cgroup_read_stat(memcg, MEM_CGROUP_STAT_FILE_DIRTY);
+	info->nr_file_dirty = max(val, 0L);
+	val = mem_cgroup_read_stat(memcg, MEM_CGROUP_STAT_WRITEBACK);
+	info->nr_writeback = max(val, 0L);
+	info->memcg_id = css_id(&memcg->css);
+	ret = true;
+out:
+	css_put(&memcg->css);
+	return ret;
+}
+
 static int mem_cgroup_reset(struct cgroup *cont, unsigned int event)
 {
 	struct mem_cgroup *memcg;
@@ -3986,16 +4635,10 @@ static int mem_cgroup_reset(struct cgroup *cont, unsigned int event)
 	name = MEMFILE_ATTR(event);
 	switch (name) {
 	case RES_MAX_USAGE:
-		if (type == _MEM)
-			res_counter_reset_max(&memcg->res);
-		else
-			res_counter_reset_max(&memcg->memsw);
+		res_counter_reset_max(memcg_counter(memcg, type));
 		break;
 	case RES_FAILCNT:
-		if (type == _MEM)
-			res_counter_reset_failcnt(&memcg->res);
-		else
-			res_counter_reset_failcnt(&memcg->memsw);
+		res_counter_reset_failcnt(memcg_counter(memcg, type));
 		break;
 	}
 
@@ -4041,6 +4684,8 @@ enum {
 	MCS_CACHE,
 	MCS_RSS,
 	MCS_FILE_MAPPED,
+	MCS_FILE_DIRTY,
+	MCS_WRITEBACK,
 	MCS_PGPGIN,
 	MCS_PGPGOUT,
 	MCS_SWAP,
@@ -4065,6 +4710,8 @@ struct {
 	{"cache", "total_cache"},
 	{"rss", "total_rss"},
 	{"mapped_file", "total_mapped_file"},
+	{"dirty", "total_dirty"},
+	{"writeback", "total_writeback"},
 	{"pgpgin", "total_pgpgin"},
 	{"pgpgout", "total_pgpgout"},
 	{"swap", "total_swap"},
@@ -4090,6 +4737,10 @@ mem_cgroup_get_local_stat(struct mem_cgroup *memcg, struct mcs_total_stat *s)
 	s->stat[MCS_RSS] += val * PAGE_SIZE;
 	val = mem_cgroup_read_stat(memcg, MEM_CGROUP_STAT_FILE_MAPPED);
 	s->stat[MCS_FILE_MAPPED] += val * PAGE_SIZE;
+	val = mem_cgroup_read_stat(memcg, MEM_CGROUP_STAT_FILE_DIRTY);
+	s->stat[MCS_FILE_DIRTY] += val * PAGE_SIZE;
+	val = mem_cgroup_read_stat(memcg, MEM_CGROUP_STAT_WRITEBACK);
+	s->stat[MCS_WRITEBACK] += val * PAGE_SIZE;
 	val = mem_cgroup_read_events(memcg, MEM_CGROUP_EVENTS_PGPGIN);
 	s->stat[MCS_PGPGIN] += val;
 	val = mem_cgroup_read_events(memcg, MEM_CGROUP_EVENTS_PGPGOUT);
@@ -4624,8 +5275,40 @@ static int mem_control_numa_stat_open(struct inode *unused, struct file *file)
 #endif /* CONFIG_NUMA */
 
 #ifdef CONFIG_CGROUP_MEM_RES_CTLR_KMEM
+static struct cftype kmem_cgroup_files[] = {
+	{
+		.name = "kmem.limit_in_bytes",
+		.private = MEMFILE_PRIVATE(_KMEM, RES_LIMIT),
+		.write_string = mem_cgroup_write,
+		.read_u64 = mem_cgroup_read,
+	},
+	{
+		.name = "kmem.usage_in_bytes",
+		.private = MEMFILE_PRIVATE(_KMEM, RES_USAGE),
+		.read_u64 = mem_cgroup_read,
+	},
+	{
+		.name = "kmem.failcnt",
+		.private = MEMFILE_PRIVATE(_KMEM, RES_FAILCNT),
+		.trigger = mem_cgroup_reset,
+		.read_u64 = mem_cgroup_read,
+	},
+	{
+		.name = "kmem.max_usage_in_bytes",
+		.private = MEMFILE_PRIVATE(_KMEM, RES_MAX_USAGE),
+		.trigger = mem_cgroup_reset,
+		.read_u64 = mem_cgroup_read,
+	},
+};
+
 static int register_kmem_files(struct cgroup *cont, struct cgroup_subsys *ss)
 {
+	int ret;
+
+	ret = cgroup_add_files(cont, ss, kmem_cgroup_files,
+			       ARRAY_SIZE(kmem_cgroup_files));
+	if (ret)
+		return ret;
 	/*
 	 * Part of this would be better living in a separate allocation
 	 * function, leaving us with just the cgroup tree population work.
@@ -4638,6 +5321,9 @@ static int register_kmem_files(struct cgroup *cont, struct cgroup_subsys *ss)
 
 static void kmem_cgroup_destroy(struct cgroup *cont)
 {
+	struct mem_cgroup *memcg = mem_cgroup_from_cont(cont);
+
+	memcg_kmem_deactivate(memcg);
 	mem_cgroup_sockets_destroy(cont);
 }
 #else
@@ -4996,6 +5682,7 @@ mem_cgroup_create(struct cgroup *cont)
 	if (parent && parent->use_hierarchy) {
 		res_counter_init(&memcg->res, &parent->res);
 		res_counter_init(&memcg->memsw, &parent->memsw);
+		res_counter_init(&memcg->kmem, &parent->kmem);
 		/*
 		 * We increment refcnt of the parent to ensure that we can
 		 * safely access it on res_counter_charge/uncharge.
@@ -5006,7 +5693,9 @@ mem_cgroup_create(struct cgroup *cont)
 	} else {
 		res_counter_init(&memcg->res, NULL);
 		res_counter_init(&memcg->memsw, NULL);
+		res_counter_init(&memcg->kmem, NULL);
 	}
+	memcg_init_kmem(memcg, parent);
 	memcg->last_scanned_node = MAX_NUMNODES;
 	INIT_LIST_HEAD(&memcg->oom_notify);
 
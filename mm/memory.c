@@ -57,6 +57,7 @@
 #include <linux/swapops.h>
 #include <linux/elf.h>
 #include <linux/gfp.h>
+#include <linux/userfaultfd_k.h>
 
 #include <asm/io.h>
 #include <asm/pgalloc.h>
@@ -404,7 +405,10 @@ static void free_pte_range(struct mmu_gather *tlb, pmd_t *pmd,
 	pgtable_t token = pmd_pgtable(*pmd);
 	pmd_clear(pmd);
 	pte_free_tlb(tlb, token, addr);
+	/* munmap may free page tables while faults allocate others */
+	spin_lock(&tlb->mm->page_table_lock);
 	tlb->mm->nr_ptes--;
+	spin_unlock(&tlb->mm->page_table_lock);
 }
 
 static inline void free_pmd_range(struct mmu_gather *tlb, pud_t *pud,
@@ -715,20 +719,6 @@ static inline int is_cow_mapping(vm_flags_t flags)
 	return (flags & (VM_SHARED | VM_MAYWRITE)) == VM_MAYWRITE;
 }
 
-#ifndef is_zero_pfn
-static inline int is_zero_pfn(unsigned long pfn)
-{
-	return pfn == zero_pfn;
-}
-#endif
-
-#ifndef my_zero_pfn
-static inline unsigned long my_zero_pfn(unsigned long addr)
-{
-	return zero_pfn;
-}
-#endif
-
 /*
  * vm_normal_page -- This function gets the "struct page" associated with a pte.
  *
@@ -3094,6 +3084,51 @@ static inline int check_stack_guard_page(struct vm_area_struct *vma, unsigned lo
 	return 0;
 }
 
+/*
+ * Map and lock the pte, as pte_offset_map_lock() does, unless the fault
+ * is speculative: then neither the vma nor the page tables are held by
+ * anything, and false is returned if the vma was changed since the fault
+ * looked it up.  With interrupts disabled the page tables cannot be freed
+ * under us, as that waits for a TLB flush IPI or an RCU-sched grace
+ * period, and once the pte lock is held whoever changes the vma and then
+ * its ptes has to wait for us.  The lock is only tried, as its holder may
+ * be spinning on our IPI.
+ */
+static bool pte_map_lock(struct mm_struct *mm, struct vm_area_struct *vma,
+		unsigned long address, pmd_t *pmd, unsigned int flags,
+		unsigned int seq, pte_t **ptep, spinlock_t **ptlp)
+{
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+	if (flags & FAULT_FLAG_SPECULATIVE) {
+		spinlock_t *ptl;
+		pte_t *pte;
+		bool ret = false;
+
+		local_irq_disable();
+		if (read_seqcount_retry(&vma->vm_sequence, seq))
+			goto out;
+		ptl = pte_lockptr(mm, pmd);
+		pte = pte_offset_map(pmd, address);
+		if (!spin_trylock(ptl)) {
+			pte_unmap(pte);
+			goto out;
+		}
+		if (read_seqcount_retry(&vma->vm_sequence, seq)) {
+			pte_unmap_unlock(pte, ptl);
+			goto out;
+		}
+		*ptep = pte;
+		*ptlp = ptl;
+		ret = true;
+out:
+		local_irq_enable();
+		return ret;
+	}
+#endif
+	*ptep = pte_offset_map_lock(mm, pmd, address, ptlp);
+	return true;
+}
+
 /*
  * We enter with non-exclusive mmap_sem (to exclude vma changes,
  * but allow concurrent faults), and pte mapped but not yet locked.
@@ -3101,7 +3136,7 @@ static inline int check_stack_guard_page(struct vm_area_struct *vma, unsigned lo
  */
 static int do_anonymous_page(struct mm_struct *mm, struct vm_area_struct *vma,
 		unsigned long address, pte_t *page_table, pmd_t *pmd,
-		unsigned int flags)
+		unsigned int flags, unsigned int seq)
 {
 	struct page *page;
 	spinlock_t *ptl;
@@ -3113,11 +3148,17 @@ static int do_anonymous_page(struct mm_struct *mm, struct vm_area_struct *vma,
 	if (check_stack_guard_page(vma, address) < 0)
 		return VM_FAULT_SIGBUS;
 
+	/* Deliver the missing page fault to userland */
+	if (userfaultfd_missing(vma))
+		return handle_userfault(vma, address, flags);
+
 	/* Use the zero-page for reads */
 	if (!(flags & FAULT_FLAG_WRITE)) {
 		entry = pte_mkspecial(pfn_pte(my_zero_pfn(address),
 						vma->vm_page_prot));
-		page_table = pte_offset_map_lock(mm, pmd, address, &ptl);
+		if (!pte_map_lock(mm, vma, address, pmd, flags, seq,
+				  &page_table, &ptl))
+			return VM_FAULT_RETRY;
 		if (!pte_none(*page_table))
 			goto unlock;
 		goto setpte;
@@ -3138,7 +3179,12 @@ static int do_anonymous_page(struct mm_struct *mm, struct vm_area_struct *vma,
 	if (vma->vm_flags & VM_WRITE)
 		entry = pte_mkwrite(pte_mkdirty(entry));
 
-	page_table = pte_offset_map_lock(mm, pmd, address, &ptl);
+	if (!pte_map_lock(mm, vma, address, pmd, flags, seq,
+			  &page_table, &ptl)) {
+		mem_cgroup_uncharge_page(page);
+		page_cache_release(page);
+		return VM_FAULT_RETRY;
+	}
 	if (!pte_none(*page_table))
 		goto release;
 
@@ -3176,8 +3222,8 @@ oom:
  * We return with mmap_sem still held, but pte unmapped and unlocked.
  */
 static int __do_fault(struct mm_struct *mm, struct vm_area_struct *vma,
-		unsigned long address, pmd_t *pmd,
-		pgoff_t pgoff, unsigned int flags, pte_t orig_pte)
+		unsigned long address, pmd_t *pmd, pgoff_t pgoff,
+		unsigned int flags, pte_t orig_pte, unsigned int seq)
 {
 	pte_t *page_table;
 	spinlock_t *ptl;
@@ -3278,7 +3324,13 @@ static int __do_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 
 	}
 
-	page_table = pte_offset_map_lock(mm, pmd, address, &ptl);
+	if (!pte_map_lock(mm, vma, address, pmd, flags, seq,
+			  &page_table, &ptl)) {
+		unlock_page(vmf.page);
+		page_cache_release(vmf.page);
+		ret = VM_FAULT_RETRY;
+		goto uncharge_out;
+	}
 
 	/*
 	 * This silly early PAGE_DIRTY setting removes a race
@@ -3362,13 +3414,13 @@ uncharge_out:
 
 static int do_linear_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 		unsigned long address, pte_t *page_table, pmd_t *pmd,
-		unsigned int flags, pte_t orig_pte)
+		unsigned int flags, pte_t orig_pte, unsigned int seq)
 {
 	pgoff_t pgoff = (((address & PAGE_MASK)
 			- vma->vm_start) >> PAGE_SHIFT) + vma->vm_pgoff;
 
 	pte_unmap(page_table);
-	return __do_fault(mm, vma, address, pmd, pgoff, flags, orig_pte);
+	return __do_fault(mm, vma, address, pmd, pgoff, flags, orig_pte, seq);
 }
 
 /*
@@ -3400,7 +3452,7 @@ static int do_nonlinear_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 	}
 
 	pgoff = pte_to_pgoff(orig_pte);
-	return __do_fault(mm, vma, address, pmd, pgoff, flags, orig_pte);
+	return __do_fault(mm, vma, address, pmd, pgoff, flags, orig_pte, 0);
 }
 
 /*
@@ -3429,10 +3481,10 @@ int handle_pte_fault(struct mm_struct *mm,
 			if (vma->vm_ops) {
 				if (likely(vma->vm_ops->fault))
 					return do_linear_fault(mm, vma, address,
-						pte, pmd, flags, entry);
+						pte, pmd, flags, entry, 0);
 			}
 			return do_anonymous_page(mm, vma, address,
-						 pte, pmd, flags);
+						 pte, pmd, flags, 0);
 		}
 		if (pte_file(entry))
 			return do_nonlinear_fault(mm, vma, address,
@@ -3502,7 +3554,8 @@ int handle_mm_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 	pmd = pmd_alloc(mm, pud, address);
 	if (!pmd)
 		return VM_FAULT_OOM;
-	if (pmd_none(*pmd) && transparent_hugepage_enabled(vma)) {
+	if (pmd_none(*pmd) && transparent_hugepage_enabled(vma) &&
+	    !userfaultfd_armed(vma)) {
 		if (!vma->vm_ops)
 			return do_huge_pmd_anonymous_page(mm, vma, address,
 							  pmd, flags);
@@ -3540,6 +3593,127 @@ int handle_mm_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 	return handle_pte_fault(mm, vma, address, pte, pmd, flags);
 }
 
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+/*
+ * Try to handle a fault without mmap_sem, so that faulting threads are
+ * not serialized behind mmap, munmap or mprotect in other threads.  Only
+ * the common cases are handled: a missing page in a private anonymous
+ * vma, or in a page cache backed vma short of a shared write fault, and
+ * only where the page table is already present.  The vma is validated
+ * against its vm_sequence count before the pte is installed.
+ *
+ * VM_FAULT_RETRY is returned whenever the fault must be handled under
+ * mmap_sem instead; that includes errors, which are best reported by
+ * going through the usual path again.
+ */
+int handle_speculative_fault(struct mm_struct *mm, unsigned long address,
+			     unsigned int flags)
+{
+	struct vm_area_struct *vma;
+	unsigned int seq;
+	pgd_t *pgd;
+	pud_t *pud;
+	pmd_t *pmd, pmdval;
+	pte_t *pte, entry;
+	int ret = VM_FAULT_RETRY;
+
+	/* TLMM tasks fault through their own page tables */
+	if (current->tlmm_pgmap)
+		return VM_FAULT_RETRY;
+
+	/* there is no mmap_sem to drop */
+	flags &= ~(FAULT_FLAG_ALLOW_RETRY | FAULT_FLAG_KILLABLE);
+	flags |= FAULT_FLAG_SPECULATIVE;
+
+	vma = get_vma(mm, address, &seq);
+	if (!vma)
+		return VM_FAULT_RETRY;
+
+	/*
+	 * Stack expansion, hugetlb, nonlinear and pfn mappings, mempolicies
+	 * and userfaultfd all rely on mmap_sem one way or another.
+	 */
+	if (vma->vm_flags & (VM_GROWSDOWN | VM_GROWSUP | VM_HUGETLB |
+			     VM_NONLINEAR | VM_PFNMAP | VM_MIXEDMAP))
+		goto out_put;
+	if (vma_policy(vma) || userfaultfd_armed(vma))
+		goto out_put;
+
+	if (flags & FAULT_FLAG_WRITE) {
+		if (!(vma->vm_flags & VM_WRITE))
+			goto out_put;
+	} else if (!(vma->vm_flags & (VM_READ | VM_EXEC | VM_WRITE)))
+		goto out_put;
+
+	if (vma->vm_ops) {
+		/*
+		 * Only the generic page cache fault is known to do without
+		 * mmap_sem, and page_mkwrite is left to the usual path.
+		 */
+		if (vma->vm_ops->fault != filemap_fault)
+			goto out_put;
+		if ((flags & FAULT_FLAG_WRITE) && (vma->vm_flags & VM_SHARED))
+			goto out_put;
+	}
+	/* anon_vma_prepare() would need mmap_sem to set up the anon_vma */
+	if ((flags & FAULT_FLAG_WRITE) && !vma->anon_vma)
+		goto out_put;
+
+	__set_current_state(TASK_RUNNING);
+	check_sync_rss_stat(current);
+
+	/*
+	 * Walk the page tables with interrupts disabled, which keeps them
+	 * from being freed under us just as for get_user_pages_fast(); no
+	 * table is allocated here.
+	 */
+	local_irq_disable();
+	pgd = pgd_offset(mm, address);
+	if (pgd_none(*pgd) || unlikely(pgd_bad(*pgd)))
+		goto out_walk;
+	pud = pud_offset(pgd, address);
+	if (pud_none(*pud) || unlikely(pud_bad(*pud)))
+		goto out_walk;
+	pmd = pmd_offset(pud, address);
+	pmdval = *pmd;
+	barrier();
+	if (pmd_none(pmdval) || pmd_trans_huge(pmdval) ||
+	    unlikely(pmd_bad(pmdval)))
+		goto out_walk;
+	pte = pte_offset_map(pmd, address);
+	entry = *pte;
+	barrier();
+	local_irq_enable();
+
+	if (!pte_none(entry)) {
+		pte_unmap(pte);
+		goto out_put;
+	}
+
+	if (vma->vm_ops)
+		ret = do_linear_fault(mm, vma, address, pte, pmd, flags,
+				      entry, seq);
+	else
+		ret = do_anonymous_page(mm, vma, address, pte, pmd, flags,
+					seq);
+
+	if (ret & VM_FAULT_ERROR)
+		ret = VM_FAULT_RETRY;
+	if (!(ret & VM_FAULT_RETRY)) {
+		count_vm_event(PGFAULT);
+		count_vm_event(SPECULATIVE_PGFAULT);
+		mem_cgroup_count_vm_event(mm, PGFAULT);
+	}
+out_put:
+	put_vma(vma);
+	return ret;
+
+out_walk:
+	local_irq_enable();
+	goto out_put;
+}
+#endif /* CONFIG_SPECULATIVE_PAGE_FAULT */
+
 #ifndef __PAGETABLE_PUD_FOLDED
 /*
  * Allocate page upper directory.
@@ -131,6 +131,11 @@ unsigned long move_page_tables(struct vm_area_struct *vma,
 	old_end = old_addr + len;
 	flush_cache_range(vma, old_addr, old_end);
 
+	/* no speculative fault may install a pte while they are moved */
+	vm_write_begin(vma);
+	if (new_vma != vma)
+		vm_write_begin(new_vma);
+
 	mmu_notifier_invalidate_range_start(vma->vm_mm, old_addr, old_end);
 
 	for (; old_addr < old_end; old_addr += extent, new_addr += extent) {
@@ -177,6 +182,10 @@ unsigned long move_page_tables(struct vm_area_struct *vma,
 
 	mmu_notifier_invalidate_range_end(vma->vm_mm, old_end-len, old_end);
 
+	if (new_vma != vma)
+		vm_write_end(new_vma);
+	vm_write_end(vma);
+
 	return len + old_addr - old_end;	/* how much done */
 }
 
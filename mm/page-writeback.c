@@ -34,6 +34,7 @@
 #include <linux/syscalls.h>
 #include <linux/buffer_head.h> /* __set_page_dirty_buffers */
 #include <linux/pagevec.h>
+#include <linux/memcontrol.h>
 #include <trace/events/writeback.h>
 
 /*
@@ -1151,6 +1152,61 @@ static long bdi_min_pause(struct backing_dev_info *bdi,
 	return pages >= DIRTY_POLL_THRESH ? 1 + t / 2 : t;
 }
 
+/*
+ * Throttle a dirtier whose memcg is over its share of the dirty limits.
+ * The global control loop below cannot see this: a small memcg may fill
+ * itself with dirty pages and then stall in reclaim long before the
+ * system as a whole crosses any threshold.  The memcg limits are scaled
+ * down from the global ones, so the flusher is asked to write out the
+ * excess explicitly; background writeback alone would stop as soon as it
+ * found the system under the global background threshold.  Like the
+ * global loop, a dirtier is held for at most MAX_PAUSE at a time; it comes
+ * back here with its next batch of pages if the memcg is still over.
+ */
+static void balance_dirty_pages_memcg(struct backing_dev_info *bdi)
+{
+	struct mem_cgroup_dirty_info info;
+	unsigned long background_thresh;
+	unsigned long dirty_thresh;
+	unsigned long nr_dirty;
+	unsigned long start_time = jiffies;
+	bool queued = false;
+	long pause = 1;
+
+	for (;;) {
+		global_dirty_limits(&background_thresh, &dirty_thresh);
+		if (!mem_cgroup_dirty_info(global_dirtyable_memory(),
+					   background_thresh, dirty_thresh,
+					   &info))
+			break;
+
+		nr_dirty = info.nr_file_dirty + info.nr_writeback;
+		if (nr_dirty <= dirty_freerun_ceiling(info.dirty_thresh,
+						      info.background_thresh))
+			break;
+
+		if (!queued && info.nr_file_dirty > info.background_thresh) {
+			bdi_start_memcg_writeback(bdi, info.nr_file_dirty -
+						       info.background_thresh,
+						  info.memcg_id);
+			queued = true;
+		}
+
+		/* between the freerun ceiling and the limit: pause once */
+		if (pause > 1 && nr_dirty <= info.dirty_thresh)
+			break;
+		if (time_after_eq(jiffies, start_time + MAX_PAUSE))
+			break;
+
+		__set_current_state(TASK_KILLABLE);
+		io_schedule_timeout(pause);
+
+		if (fatal_signal_pending(current))
+			break;
+		pause = min_t(long, pause * 2, MAX_PAUSE);
+	}
+}
+
 /*
  * balance_dirty_pages() must be called by processes which are generating dirty
  * data.  It looks at the number of dirty pages in the machine and will force
@@ -1181,6 +1237,8 @@ static void balance_dirty_pages(struct address_space *mapping,
 	struct backing_dev_info *bdi = mapping->backing_dev_info;
 	unsigned long start_time = jiffies;
 
+	balance_dirty_pages_memcg(bdi);
+
 	for (;;) {
 		unsigned long now = jiffies;
 
@@ -1932,10 +1990,15 @@ int __set_page_dirty_no_writeback(struct page *page)
 /*
  * Helper function for set_page_dirty family.
  * NOTE: This relies on being atomic wrt interrupts.
+ *
+ * The caller must hold mem_cgroup_begin_update_page_stat() on @page
+ * across TestSetPageDirty() and this, or the memcg's dirty count could
+ * be moved by mem_cgroup_move_account() before it is incremented.
  */
 void account_page_dirtied(struct page *page, struct address_space *mapping)
 {
 	if (mapping_cap_account_dirty(mapping)) {
+		mem_cgroup_inc_page_stat(page, MEMCG_NR_FILE_DIRTY);
 		__inc_zone_page_state(page, NR_FILE_DIRTY);
 		__inc_zone_page_state(page, NR_DIRTIED);
 		__inc_bdi_stat(mapping->backing_dev_info, BDI_RECLAIMABLE);
@@ -1975,14 +2038,21 @@ EXPORT_SYMBOL(account_page_writeback);
  */
 int __set_page_dirty_nobuffers(struct page *page)
 {
+	unsigned long flags, memcg_flags;
+	bool locked;
+
+	mem_cgroup_begin_update_page_stat(page, &locked, &memcg_flags);
 	if (!TestSetPageDirty(page)) {
 		struct address_space *mapping = page_mapping(page);
 		struct address_space *mapping2;
 
-		if (!mapping)
+		if (!mapping) {
+			mem_cgroup_end_update_page_stat(page, &locked,
+							&memcg_flags);
 			return 1;
+		}
 
-		spin_lock_irq(&mapping->tree_lock);
+		spin_lock_irqsave(&mapping->tree_lock, flags);
 		mapping2 = page_mapping(page);
 		if (mapping2) { /* Race with truncate? */
 			BUG_ON(mapping2 != mapping);
@@ -1991,13 +2061,15 @@ int __set_page_dirty_nobuffers(struct page *page)
 			radix_tree_tag_set(&mapping->page_tree,
 				page_index(page), PAGECACHE_TAG_DIRTY);
 		}
-		spin_unlock_irq(&mapping->tree_lock);
+		spin_unlock_irqrestore(&mapping->tree_lock, flags);
+		mem_cgroup_end_update_page_stat(page, &locked, &memcg_flags);
 		if (mapping->host) {
 			/* !PageAnon && !swapper_space */
 			__mark_inode_dirty(mapping->host, I_DIRTY_PAGES);
 		}
 		return 1;
 	}
+	mem_cgroup_end_update_page_stat(page, &locked, &memcg_flags);
 	return 0;
 }
 EXPORT_SYMBOL(__set_page_dirty_nobuffers);
@@ -2113,6 +2185,9 @@ EXPORT_SYMBOL(set_page_dirty_lock);
 int clear_page_dirty_for_io(struct page *page)
 {
 	struct address_space *mapping = page_mapping(page);
+	bool locked;
+	unsigned long flags;
+	int ret = 0;
 
 	BUG_ON(!PageLocked(page));
 
@@ -2154,13 +2229,16 @@ int clear_page_dirty_for_io(struct page *page)
 		 * the desired exclusion. See mm/memory.c:do_wp_page()
 		 * for more comments.
 		 */
+		mem_cgroup_begin_update_page_stat(page, &locked, &flags);
 		if (TestClearPageDirty(page)) {
+			mem_cgroup_dec_page_stat(page, MEMCG_NR_FILE_DIRTY);
 			dec_zone_page_state(page, NR_FILE_DIRTY);
 			dec_bdi_stat(mapping->backing_dev_info,
 					BDI_RECLAIMABLE);
-			return 1;
+			ret = 1;
 		}
-		return 0;
+		mem_cgroup_end_update_page_stat(page, &locked, &flags);
+		return ret;
 	}
 	return TestClearPageDirty(page);
 }
@@ -2173,8 +2251,10 @@ int test_clear_page_writeback(struct page *page)
 
 	if (mapping) {
 		struct backing_dev_info *bdi = mapping->backing_dev_info;
-		unsigned long flags;
+		unsigned long flags, memcg_flags;
+		bool locked;
 
+		mem_cgroup_begin_update_page_stat(page, &locked, &memcg_flags);
 		spin_lock_irqsave(&mapping->tree_lock, flags);
 		ret = TestClearPageWriteback(page);
 		if (ret) {
@@ -2182,11 +2262,14 @@ int test_clear_page_writeback(struct page *page)
 						page_index(page),
 						PAGECACHE_TAG_WRITEBACK);
 			if (bdi_cap_account_writeback(bdi)) {
+				mem_cgroup_dec_page_stat(page,
+						MEMCG_NR_FILE_WRITEBACK);
 				__dec_bdi_stat(bdi, BDI_WRITEBACK);
 				__bdi_writeout_inc(bdi);
 			}
 		}
 		spin_unlock_irqrestore(&mapping->tree_lock, flags);
+		mem_cgroup_end_update_page_stat(page, &locked, &memcg_flags);
 	} else {
 		ret = TestClearPageWriteback(page);
 	}
@@ -2204,16 +2287,21 @@ int test_set_page_writeback(struct page *page)
 
 	if (mapping) {
 		struct backing_dev_info *bdi = mapping->backing_dev_info;
-		unsigned long flags;
+		unsigned long flags, memcg_flags;
+		bool locked;
 
+		mem_cgroup_begin_update_page_stat(page, &locked, &memcg_flags);
 		spin_lock_irqsave(&mapping->tree_lock, flags);
 		ret = TestSetPageWriteback(page);
 		if (!ret) {
 			radix_tree_tag_set(&mapping->page_tree,
 						page_index(page),
 						PAGECACHE_TAG_WRITEBACK);
-			if (bdi_cap_account_writeback(bdi))
+			if (bdi_cap_account_writeback(bdi)) {
+				mem_cgroup_inc_page_stat(page,
+						MEMCG_NR_FILE_WRITEBACK);
 				__inc_bdi_stat(bdi, BDI_WRITEBACK);
+			}
 		}
 		if (!PageDirty(page))
 			radix_tree_tag_clear(&mapping->page_tree,
@@ -2223,6 +2311,7 @@ int test_set_page_writeback(struct page *page)
 				     page_index(page),
 				     PAGECACHE_TAG_TOWRITE);
 		spin_unlock_irqrestore(&mapping->tree_lock, flags);
+		mem_cgroup_end_update_page_stat(page, &locked, &memcg_flags);
 	} else {
 		ret = TestSetPageWriteback(page);
 	}
@@ -110,7 +110,8 @@ static int read_pages(struct address_space *mapping, struct file *filp,
 		struct list_head *pages, unsigned nr_pages)
 {
 	struct blk_plug plug;
-	unsigned page_idx;
+	struct page *batch[PAGE_CACHE_ADD_BATCH];
+	unsigned page_idx, nr, added, i;
 	int ret;
 
 	blk_start_plug(&plug);
@@ -122,14 +123,18 @@ static int read_pages(struct address_space *mapping, struct file *filp,
 		goto out;
 	}
 
-	for (page_idx = 0; page_idx < nr_pages; page_idx++) {
-		struct page *page = list_to_page(pages);
-		list_del(&page->lru);
-		if (!add_to_page_cache_lru(page, mapping,
-					page->index, GFP_KERNEL)) {
-			mapping->a_ops->readpage(filp, page);
+	for (page_idx = 0; page_idx < nr_pages; page_idx += nr) {
+		nr = min_t(unsigned, nr_pages - page_idx, PAGE_CACHE_ADD_BATCH);
+		for (i = 0; i < nr; i++) {
+			batch[i] = list_to_page(pages);
+			list_del(&batch[i]->lru);
+		}
+		added = add_to_page_cache_lru_batch(mapping, batch, nr,
+						    GFP_KERNEL);
+		for (i = 0; i < added; i++) {
+			mapping->a_ops->readpage(filp, batch[i]);
+			page_cache_release(batch[i]);
 		}
-		page_cache_release(page);
 	}
 	ret = 0;
 
@@ -139,6 +144,44 @@ out:
 	return ret;
 }
 
+/*
+ * Allocate a page for readahead.  Mappings with large page cache units get
+ * their pages in physically contiguous runs of up to 1 << PAGE_CACHE_UNIT_ORDER,
+ * which costs one trip to the page allocator per unit and lets the bios
+ * built from consecutive pages use fewer segments.  The unit is split into
+ * ordinary pages; the ones not handed out yet are kept on @spare.
+ */
+static struct page *readahead_alloc_page(struct address_space *mapping,
+					 struct list_head *spare,
+					 unsigned long nr_left)
+{
+	struct page *page;
+	unsigned int order;
+	int i;
+
+	if (!list_empty(spare)) {
+		page = list_first_entry(spare, struct page, lru);
+		list_del(&page->lru);
+		return page;
+	}
+
+	if (mapping_large_units(mapping) && nr_left > 1) {
+		order = min_t(unsigned long, PAGE_CACHE_UNIT_ORDER,
+			      ilog2(nr_left));
+		page = __page_cache_alloc_order(mapping_gfp_mask(mapping) |
+				__GFP_COLD | __GFP_NORETRY | __GFP_NOWARN,
+				order);
+		if (page) {
+			split_page(page, order);
+			for (i = 1; i < (1 << order); i++)
+				list_add_tail(&page[i].lru, spare);
+			return page;
+		}
+	}
+
+	return page_cache_alloc_readahead(mapping);
+}
+
 /*
  * __do_page_cache_readahead() actually reads a chunk of disk.  It allocates all
  * the pages first, then submits them all for I/O. This avoids the very bad
@@ -156,6 +199,7 @@ __do_page_cache_readahead(struct address_space *mapping, struct file *filp,
 	struct page *page;
 	unsigned long end_index;	/* The last page we want to read */
 	LIST_HEAD(page_pool);
+	LIST_HEAD(spare);
 	int page_idx;
 	int ret = 0;
 	loff_t isize = i_size_read(inode);
@@ -180,7 +224,9 @@ __do_page_cache_readahead(struct address_space *mapping, struct file *filp,
 		if (page)
 			continue;
 
-		page = page_cache_alloc_readahead(mapping);
+		page = readahead_alloc_page(mapping, &spare,
+				min(nr_to_read - page_idx,
+				    end_index - page_offset + 1));
 		if (!page)
 			break;
 		page->index = page_offset;
@@ -198,6 +244,7 @@ __do_page_cache_readahead(struct address_space *mapping, struct file *filp,
 	if (ret)
 		read_pages(mapping, filp, &page_pool, ret);
 	BUG_ON(!list_empty(&page_pool));
+	put_pages_list(&spare);
 out:
 	return ret;
 }
@@ -1168,6 +1168,7 @@ void page_add_file_rmap(struct page *page)
 void page_remove_rmap(struct page *page)
 {
 	bool anon = PageAnon(page);
+	bool dirty = false;
 	bool locked;
 	unsigned long flags;
 
@@ -1189,10 +1190,12 @@ void page_remove_rmap(struct page *page)
 	 * this if the page is anon, so about to be freed; but perhaps
 	 * not if it's in swapcache - there might be another pte slot
 	 * containing the swap entry, but page not yet written to swap.
+	 * set_page_dirty() takes the page stat lock itself, so leave it
+	 * until that is dropped.
 	 */
 	if ((!anon || PageSwapCache(page)) &&
 	    page_test_and_clear_dirty(page_to_pfn(page), 1))
-		set_page_dirty(page);
+		dirty = true;
 	/*
 	 * Hugepages are not counted in NR_ANON_PAGES nor NR_FILE_MAPPED
 	 * and not charged by memcg for now.
@@ -1222,6 +1225,8 @@ void page_remove_rmap(struct page *page)
 out:
 	if (!anon)
 		mem_cgroup_end_update_page_stat(page, &locked, &flags);
+	if (dirty)
+		set_page_dirty(page);
 }
 
 /*
@@ -1281,6 +1286,17 @@ int try_to_unmap_one(struct page *page, struct vm_area_struct *vma,
 	} else if (PageAnon(page)) {
 		swp_entry_t entry = { .val = page_private(page) };
 
+		if ((flags & TTU_FREE) && !PageDirty(page)) {
+			/*
+			 * Neither the page nor any pte seen so far was
+			 * written after MADV_FREE: drop the mapping instead
+			 * of installing a swap entry.
+			 */
+			VM_BUG_ON(!PageSwapCache(page));
+			dec_mm_counter(mm, MM_ANONPAGES);
+			goto discard;
+		}
+
 		if (PageSwapCache(page)) {
 			/*
 			 * Store the swap location in the pte.
@@ -1319,6 +1335,7 @@ int try_to_unmap_one(struct page *page, struct vm_area_struct *vma,
 	} else
 		dec_mm_counter(mm, MM_FILEPAGES);
 
+discard:
 	page_remove_rmap(page);
 	page_cache_release(page);
 
@@ -1657,6 +1674,7 @@ out:
  * SWAP_AGAIN	- we missed a mapping, try again later
  * SWAP_FAIL	- the page is unswappable
  * SWAP_MLOCK	- page is mlocked.
+ * SWAP_LZFREE	- (TTU_FREE only) all mappings of a clean page were dropped
  */
 int try_to_unmap(struct page *page, enum ttu_flags flags)
 {
@@ -1671,8 +1689,16 @@ int try_to_unmap(struct page *page, enum ttu_flags flags)
 		ret = try_to_unmap_anon(page, flags);
 	else
 		ret = try_to_unmap_file(page, flags);
-	if (ret != SWAP_MLOCK && !page_mapped(page))
+	if (ret != SWAP_MLOCK && !page_mapped(page)) {
 		ret = SWAP_SUCCESS;
+		/*
+		 * A dirty pte moves its dirty bit to the page as it is
+		 * unmapped, so a page that is still clean had every mapping
+		 * discarded and no swap entry refers to it.
+		 */
+		if ((flags & TTU_FREE) && !PageDirty(page))
+			ret = SWAP_LZFREE;
+	}
 	return ret;
 }
 
@@ -30,6 +30,7 @@
 #include <linux/fault-inject.h>
 #include <linux/stacktrace.h>
 #include <linux/prefetch.h>
+#include <linux/memcontrol.h>
 
 #include <trace/events/kmem.h>
 
@@ -163,7 +164,7 @@ static inline int kmem_cache_debug(struct kmem_cache *s)
  */
 #define SLUB_NEVER_MERGE (SLAB_RED_ZONE | SLAB_POISON | SLAB_STORE_USER | \
 		SLAB_TRACE | SLAB_DESTROY_BY_RCU | SLAB_NOLEAKTRACE | \
-		SLAB_FAILSLAB)
+		SLAB_FAILSLAB | SLAB_ACCOUNT)
 
 #define SLUB_MERGE_SAME (SLAB_DEBUG_FREE | SLAB_RECLAIM_ACCOUNT | \
 		SLAB_CACHE_DMA | SLAB_NOTRACK)
@@ -175,6 +176,7 @@ static inline int kmem_cache_debug(struct kmem_cache *s)
 /* Internal SLUB flags */
 #define __OBJECT_POISON		0x80000000UL /* Poison object */
 #define __CMPXCHG_DOUBLE	0x40000000UL /* Use cmpxchg_double */
+#define __CACHE_RETIRED		0x20000000UL /* Keep no empty slabs */
 
 static int kmem_size = sizeof(struct kmem_cache);
 
@@ -220,6 +222,7 @@ static inline int sysfs_slab_alias(struct kmem_cache *s, const char *p)
 							{ return 0; }
 static inline void sysfs_slab_remove(struct kmem_cache *s)
 {
+	memcg_release_cache(s);
 	kfree(s->name);
 	kfree(s);
 }
@@ -1266,6 +1269,69 @@ static inline void slab_free_hook(struct kmem_cache *s, void *x) {}
 
 #endif /* CONFIG_SLUB_DEBUG */
 
+#ifdef CONFIG_CGROUP_MEM_RES_CTLR_KMEM_SLAB
+/*
+ * Allocations from a SLAB_ACCOUNT cache are redirected to the clone of
+ * the current task's memory cgroup, whose slabs are charged to it.
+ */
+static __always_inline struct kmem_cache *memcg_get_cache(struct kmem_cache *s,
+							  gfp_t flags)
+{
+	if (memcg_kmem_enabled() && s->memcg_params)
+		return __memcg_kmem_get_cache(s, flags);
+	return s;
+}
+
+static __always_inline void memcg_put_cache(struct kmem_cache *s)
+{
+	if (unlikely(s->memcg_params) && !s->memcg_params->is_root_cache)
+		__memcg_kmem_put_cache(s);
+}
+
+/* Objects of a SLAB_ACCOUNT cache may be freed to one of its clones */
+static inline struct kmem_cache *cache_from_obj(struct kmem_cache *s,
+						struct page *page)
+{
+	if (unlikely(page->slab != s) && s->memcg_params)
+		return page->slab;
+	return s;
+}
+
+static inline int charge_slab(struct kmem_cache *s, gfp_t flags, int order)
+{
+	if (!s->memcg_params || s->memcg_params->is_root_cache)
+		return 0;
+	return memcg_charge_slab(s, flags, order);
+}
+
+static inline void uncharge_slab(struct kmem_cache *s, int order)
+{
+	if (s->memcg_params && !s->memcg_params->is_root_cache)
+		memcg_uncharge_slab(s, order);
+}
+#else
+static inline struct kmem_cache *memcg_get_cache(struct kmem_cache *s,
+						 gfp_t flags)
+{
+	return s;
+}
+
+static inline void memcg_put_cache(struct kmem_cache *s) {}
+
+static inline struct kmem_cache *cache_from_obj(struct kmem_cache *s,
+						struct page *page)
+{
+	return s;
+}
+
+static inline int charge_slab(struct kmem_cache *s, gfp_t flags, int order)
+{
+	return 0;
+}
+
+static inline void uncharge_slab(struct kmem_cache *s, int order) {}
+#endif
+
 /*
  * Slab allocation and freeing
  */
@@ -1314,6 +1380,11 @@ static struct page *allocate_slab(struct kmem_cache *s, gfp_t flags, int node)
 			stat(s, ORDER_FALLBACK);
 	}
 
+	if (page && charge_slab(s, flags, oo_order(oo))) {
+		__free_pages(page, oo_order(oo));
+		page = NULL;
+	}
+
 	if (flags & __GFP_WAIT)
 		local_irq_disable();
 
@@ -1418,6 +1489,7 @@ static void __free_slab(struct kmem_cache *s, struct page *page)
 	if (current->reclaim_state)
 		current->reclaim_state->reclaimed_slab += pages;
 	__free_pages(page, order);
+	uncharge_slab(s, order);
 }
 
 #define need_reserve_slab_rcu						\
@@ -1464,6 +1536,17 @@ static void discard_slab(struct kmem_cache *s, struct page *page)
 	free_slab(s, page);
 }
 
+/*
+ * Whether an empty slab should stay on the node's partial list rather
+ * than go back to the page allocator.  Retired caches keep none.
+ */
+static inline int keep_empty_slab(struct kmem_cache *s,
+				  struct kmem_cache_node *n)
+{
+	return n->nr_partial <= s->min_partial &&
+		!(s->flags & __CACHE_RETIRED);
+}
+
 /*
  * Management of partially allocated slabs.
  *
@@ -1810,7 +1893,7 @@ redo:
 
 	new.frozen = 0;
 
-	if (!new.inuse && n->nr_partial > s->min_partial)
+	if (!new.inuse && !keep_empty_slab(s, n))
 		m = M_FREE;
 	else if (new.freelist) {
 		m = M_PARTIAL;
@@ -1903,7 +1986,7 @@ static void unfreeze_partials(struct kmem_cache *s)
 
 			new.frozen = 0;
 
-			if (!new.inuse && (!n || n->nr_partial > s->min_partial))
+			if (!new.inuse && (!n || !keep_empty_slab(s, n)))
 				m = M_FREE;
 			else {
 				struct kmem_cache_node *n2 = get_node(s,
@@ -2309,6 +2392,7 @@ static __always_inline void *slab_alloc(struct kmem_cache *s,
 	if (slab_pre_alloc_hook(s, gfpflags))
 		return NULL;
 
+	s = memcg_get_cache(s, gfpflags);
 redo:
 
 	/*
@@ -2364,6 +2448,7 @@ redo:
 		memset(object, 0, s->objsize);
 
 	slab_post_alloc_hook(s, gfpflags, object);
+	memcg_put_cache(s);
 
 	return object;
 }
@@ -2457,7 +2542,8 @@ static void __slab_free(struct kmem_cache *s, struct page *page,
 		new.inuse--;
 		if ((!new.inuse || !prior) && !was_frozen && !n) {
 
-			if (!kmem_cache_debug(s) && !prior)
+			if (!kmem_cache_debug(s) && !prior &&
+			    !(s->flags & __CACHE_RETIRED))
 
 				/*
 				 * Slab was on no list before and will be partially empty
@@ -2513,7 +2599,7 @@ static void __slab_free(struct kmem_cache *s, struct page *page,
 	if (was_frozen)
 		stat(s, FREE_FROZEN);
 	else {
-		if (unlikely(!inuse && n->nr_partial > s->min_partial))
+		if (unlikely(!inuse && !keep_empty_slab(s, n)))
                         goto slab_empty;
 
 		/*
@@ -2600,7 +2686,7 @@ void kmem_cache_free(struct kmem_cache *s, void *x)
 
 	page = virt_to_head_page(x);
 
-	slab_free(s, page, x, _RET_IP_);
+	slab_free(cache_from_obj(s, page), page, x, _RET_IP_);
 
 	trace_kmem_cache_free(_RET_IP_, x);
 }
@@ -3189,6 +3275,8 @@ static inline int kmem_cache_close(struct kmem_cache *s)
  */
 void kmem_cache_destroy(struct kmem_cache *s)
 {
+	memcg_destroy_cache_clones(s);
+
 	down_write(&slub_lock);
 	s->refcount--;
 	if (!s->refcount) {
@@ -3957,11 +4045,13 @@ struct kmem_cache *kmem_cache_create(const char *name, size_t size,
 	if (s) {
 		if (kmem_cache_open(s, n,
 				size, align, flags, ctor)) {
+			memcg_register_cache(s);
 			list_add(&s->list, &slab_caches);
 			up_write(&slub_lock);
 			if (sysfs_slab_add(s)) {
 				down_write(&slub_lock);
 				list_del(&s->list);
+				memcg_release_cache(s);
 				kfree(n);
 				kfree(s);
 				goto err;
@@ -3982,6 +4072,55 @@ err:
 }
 EXPORT_SYMBOL(kmem_cache_create);
 
+#ifdef CONFIG_CGROUP_MEM_RES_CTLR_KMEM_SLAB
+/*
+ * Create the clone of SLAB_ACCOUNT cache @root for a memory cgroup.
+ * @name and @params are provided by the memory controller and belong
+ * to the clone on success.  Clones are never merged.
+ */
+struct kmem_cache *kmem_cache_create_memcg(struct kmem_cache *root,
+		char *name, struct memcg_cache_params *params)
+{
+	struct kmem_cache *s;
+
+	s = kmalloc(kmem_size, GFP_KERNEL);
+	if (!s)
+		return NULL;
+
+	down_write(&slub_lock);
+	if (!kmem_cache_open(s, name, root->objsize, root->align,
+			root->flags & ~(__OBJECT_POISON | __CMPXCHG_DOUBLE),
+			root->ctor))
+		goto err;
+	s->memcg_params = params;
+	list_add(&s->list, &slab_caches);
+	up_write(&slub_lock);
+
+	if (sysfs_slab_add(s)) {
+		down_write(&slub_lock);
+		list_del(&s->list);
+		goto err;
+	}
+	return s;
+err:
+	up_write(&slub_lock);
+	kfree(s);
+	return NULL;
+}
+
+/*
+ * The memory cgroup of clone @s is going away and nothing will be
+ * allocated from @s again.  Free its empty slabs now and as soon as
+ * they become empty from now on, so that it drains as its last objects
+ * are freed.
+ */
+void kmem_cache_retire(struct kmem_cache *s)
+{
+	s->flags |= __CACHE_RETIRED;
+	kmem_cache_shrink(s);
+}
+#endif
+
 #ifdef CONFIG_SMP
 /*
  * Use the cpu notifier to insure that the cpu slabs are flushed when
@@ -5212,6 +5351,7 @@ static void kmem_cache_release(struct kobject *kobj)
 {
 	struct kmem_cache *s = to_slab(kobj);
 
+	memcg_release_cache(s);
 	kfree(s->name);
 	kfree(s);
 }
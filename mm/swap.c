@@ -36,9 +36,22 @@
 /* How many pages do we try to swap or page in/out together? */
 int page_cluster;
 
-static DEFINE_PER_CPU(struct pagevec[NR_LRU_LISTS], lru_add_pvecs);
+/*
+ * Pages on their way onto the LRU are gathered per cpu in vectors several
+ * times the size of a pagevec, so that a burst of page cache insertions
+ * takes each zone's lru_lock once per LRU_ADD_BATCH pages.
+ */
+#define LRU_ADD_BATCH	(4 * PAGEVEC_SIZE)
+
+struct lru_add_vec {
+	unsigned long nr;
+	struct page *pages[LRU_ADD_BATCH];
+};
+
+static DEFINE_PER_CPU(struct lru_add_vec[NR_LRU_LISTS], lru_add_pvecs);
 static DEFINE_PER_CPU(struct pagevec, lru_rotate_pvecs);
 static DEFINE_PER_CPU(struct pagevec, lru_deactivate_pvecs);
+static DEFINE_PER_CPU(struct pagevec, lru_lazyfree_pvecs);
 
 /*
  * This path almost never happens for VM activity - pages are normally
@@ -201,16 +214,16 @@ void put_pages_list(struct list_head *pages)
 }
 EXPORT_SYMBOL(put_pages_list);
 
-static void pagevec_lru_move_fn(struct pagevec *pvec,
-				void (*move_fn)(struct page *page, void *arg),
-				void *arg)
+static void lru_move_pages(struct page **pages, int nr, int cold,
+			   void (*move_fn)(struct page *page, void *arg),
+			   void *arg)
 {
 	int i;
 	struct zone *zone = NULL;
 	unsigned long flags = 0;
 
-	for (i = 0; i < pagevec_count(pvec); i++) {
-		struct page *page = pvec->pages[i];
+	for (i = 0; i < nr; i++) {
+		struct page *page = pages[i];
 		struct zone *pagezone = page_zone(page);
 
 		if (pagezone != zone) {
@@ -224,10 +237,33 @@ static void pagevec_lru_move_fn(struct pagevec *pvec,
 	}
 	if (zone)
 		spin_unlock_irqrestore(&zone->lru_lock, flags);
-	release_pages(pvec->pages, pvec->nr, pvec->cold);
+	release_pages(pages, nr, cold);
+}
+
+static void pagevec_lru_move_fn(struct pagevec *pvec,
+				void (*move_fn)(struct page *page, void *arg),
+				void *arg)
+{
+	lru_move_pages(pvec->pages, pagevec_count(pvec), pvec->cold,
+		       move_fn, arg);
 	pagevec_reinit(pvec);
 }
 
+static void __pagevec_lru_add_fn(struct page *page, void *arg);
+
+/*
+ * Add the pages gathered in @vec to the LRU, then drop the references
+ * __lru_cache_add() took on them.
+ */
+static void lru_add_vec_drain(struct lru_add_vec *vec, enum lru_list lru)
+{
+	VM_BUG_ON(is_unevictable_lru(lru));
+
+	lru_move_pages(vec->pages, vec->nr, 0, __pagevec_lru_add_fn,
+		       (void *)lru);
+	vec->nr = 0;
+}
+
 static void pagevec_move_tail_fn(struct page *page, void *arg)
 {
 	int *pgmoved = arg;
@@ -373,11 +409,12 @@ EXPORT_SYMBOL(mark_page_accessed);
 
 void __lru_cache_add(struct page *page, enum lru_list lru)
 {
-	struct pagevec *pvec = &get_cpu_var(lru_add_pvecs)[lru];
+	struct lru_add_vec *vec = &get_cpu_var(lru_add_pvecs)[lru];
 
 	page_cache_get(page);
-	if (!pagevec_add(pvec, page))
-		__pagevec_lru_add(pvec, lru);
+	vec->pages[vec->nr++] = page;
+	if (vec->nr == LRU_ADD_BATCH)
+		lru_add_vec_drain(vec, lru);
 	put_cpu_var(lru_add_pvecs);
 }
 EXPORT_SYMBOL(__lru_cache_add);
@@ -491,6 +528,28 @@ static void lru_deactivate_fn(struct page *page, void *arg)
 	update_page_reclaim_stat(zone, page, file, 0);
 }
 
+/*
+ * Pages freed with MADV_FREE are clean anonymous pages whose contents
+ * the application no longer cares about.  Move them from the active to
+ * the inactive anon list, so reclaim finds them before pages that are
+ * still in use and can discard them without swapping.
+ */
+static void lru_lazyfree_fn(struct page *page, void *arg)
+{
+	struct zone *zone = page_zone(page);
+
+	if (PageLRU(page) && PageAnon(page) && PageActive(page) &&
+	    !PageUnevictable(page)) {
+		del_page_from_lru_list(zone, page, LRU_ACTIVE_ANON);
+		ClearPageActive(page);
+		ClearPageReferenced(page);
+		add_page_to_lru_list(zone, page, LRU_INACTIVE_ANON);
+
+		__count_vm_event(PGDEACTIVATE);
+		update_page_reclaim_stat(zone, page, 0, 0);
+	}
+}
+
 /*
  * Drain pages out of the cpu's pagevecs.
  * Either "cpu" is the current CPU, and preemption has already been
@@ -498,14 +557,15 @@ static void lru_deactivate_fn(struct page *page, void *arg)
  */
 void lru_add_drain_cpu(int cpu)
 {
-	struct pagevec *pvecs = per_cpu(lru_add_pvecs, cpu);
+	struct lru_add_vec *vecs = per_cpu(lru_add_pvecs, cpu);
 	struct pagevec *pvec;
 	int lru;
 
 	for_each_lru(lru) {
-		pvec = &pvecs[lru - LRU_BASE];
-		if (pagevec_count(pvec))
-			__pagevec_lru_add(pvec, lru);
+		struct lru_add_vec *vec = &vecs[lru - LRU_BASE];
+
+		if (vec->nr)
+			lru_add_vec_drain(vec, lru);
 	}
 
 	pvec = &per_cpu(lru_rotate_pvecs, cpu);
@@ -522,6 +582,10 @@ void lru_add_drain_cpu(int cpu)
 	if (pagevec_count(pvec))
 		pagevec_lru_move_fn(pvec, lru_deactivate_fn, NULL);
 
+	pvec = &per_cpu(lru_lazyfree_pvecs, cpu);
+	if (pagevec_count(pvec))
+		pagevec_lru_move_fn(pvec, lru_lazyfree_fn, NULL);
+
 	activate_page_drain(cpu);
 }
 
@@ -551,6 +615,25 @@ void deactivate_page(struct page *page)
 	}
 }
 
+/**
+ * lazyfree_page - move an anonymous page to the inactive list
+ * @page: page to move
+ *
+ * Used by MADV_FREE: @page has been marked clean and old, so it is a
+ * good candidate for reclaim to discard without writing it to swap.
+ */
+void lazyfree_page(struct page *page)
+{
+	if (PageLRU(page) && PageActive(page) && !PageUnevictable(page)) {
+		struct pagevec *pvec = &get_cpu_var(lru_lazyfree_pvecs);
+
+		page_cache_get(page);
+		if (!pagevec_add(pvec, page))
+			pagevec_lru_move_fn(pvec, lru_lazyfree_fn, NULL);
+		put_cpu_var(lru_lazyfree_pvecs);
+	}
+}
+
 void lru_add_drain(void)
 {
 	lru_add_drain_cpu(get_cpu());
@@ -167,13 +167,17 @@ int add_to_swap(struct page *page)
 	 * deadlock in the swap out path.
 	 */
 	/*
-	 * Add it to the swap cache and mark it dirty
+	 * Add it to the swap cache and mark it dirty, unless it was freed
+	 * with MADV_FREE: then try_to_unmap() moves the dirty bit over from
+	 * the ptes, and a page that stays clean can be discarded instead
+	 * of written out.
 	 */
 	err = add_to_swap_cache(page, entry,
 			__GFP_HIGH|__GFP_NOMEMALLOC|__GFP_NOWARN);
 
 	if (!err) {	/* Success */
-		SetPageDirty(page);
+		if (!PageLazyFree(page))
+			SetPageDirty(page);
 		return 1;
 	} else {	/* -ENOMEM radix-tree allocation failure */
 		/*
@@ -786,6 +786,9 @@ const char * const vmstat_text[] = {
 	"thp_collapse_alloc_failed",
 	"thp_split",
 #endif
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+	"speculative_pgfault",
+#endif
 
 #endif /* CONFIG_VM_EVENTS_COUNTERS */
 };